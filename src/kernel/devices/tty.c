@@ -60,7 +60,7 @@ struct tty {
 
     key_event_t keys_buffer[KEYS_BUFFER_SIZE];
     int keys_buffer_len;
-    lock_t keys_buffer_lock;
+    mcs_lock_t keys_buffer_lock;
 };
 
 typedef struct tty tty_t;
@@ -93,6 +93,7 @@ void init_tty_manager(int num_of_ttys, int lines_scroll_capacity) {
     for (int i = 0; i < num_of_ttys; i++) {
         tty = kmalloc(sizeof(tty_t));
         memset(tty, 0, sizeof(tty_t));
+        lock_stats_register(&tty->keys_buffer_lock, "tty keys buffer");
 
         tty->dev_no = i;
         tty->total_buffer_rows = lines_scroll_capacity;
@@ -317,10 +318,11 @@ static void enqueue_key_event(tty_t *tty, key_event_t *event) {
         return;
     }
     // klog_trace("tty: enqueueing key event on tty %d", tty->dev_no);
-    acquire(&tty->keys_buffer_lock);
+    mcs_node_t lock_node;
+    mcs_acquire(&tty->keys_buffer_lock, &lock_node);
     memcpy(&tty->keys_buffer[tty->keys_buffer_len], event, sizeof(key_event_t));
     tty->keys_buffer_len++;
-    release(&tty->keys_buffer_lock);
+    mcs_release(&tty->keys_buffer_lock, &lock_node);
 }
 
 static void dequeue_key_event(tty_t *tty, key_event_t *event) {
@@ -329,12 +331,13 @@ static void dequeue_key_event(tty_t *tty, key_event_t *event) {
         return;
     }
     // klog_trace("tty: dequeueing key event from tty %d", tty->dev_no);
-    acquire(&tty->keys_buffer_lock);
+    mcs_node_t lock_node;
+    mcs_acquire(&tty->keys_buffer_lock, &lock_node);
     memcpy(event, &tty->keys_buffer[0], sizeof(key_event_t));
     tty->keys_buffer_len--;
     // shift everything one place up
     memmove(&tty->keys_buffer[0], &tty->keys_buffer[1], tty->keys_buffer_len * sizeof(key_event_t));
-    release(&tty->keys_buffer_lock);
+    mcs_release(&tty->keys_buffer_lock, &lock_node);
 }
 
 static void draw_tty_buffer_to_screen(tty_t *tty) {
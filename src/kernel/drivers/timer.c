@@ -1,6 +1,10 @@
 #include <cpu.h>
 #include <idt.h>
 #include <drivers/screen.h>
+#include <drivers/timer.h>
+#include <klog.h>
+
+MODULE("TIMER");
 
 
 
@@ -35,12 +39,83 @@
 #define DIGIT_FOUR_DIGIT_BCD               (0x1)
 
 
+#define PIT_FREQUENCY         1193180
+#define PIT_COUNTS_PER_MSEC   (PIT_FREQUENCY / 1000)
+
+// channel 2 gate and output, in the keyboard controller port B
+#define PORT_B                0x61
+#define PORT_B_GATE_2         0x01
+#define PORT_B_SPEAKER        0x02
+#define PORT_B_OUT_2          0x20
+
+#define TSC_CALIBRATION_MSECS       10
+#define TSC_CALIBRATION_MAX_POLLS   10000000
+#define NSECS_PER_SEC               1000000000ULL
+
+
 // 32 bits overflow in 49 days
 // 64 bits overflow in... 585 M years
 volatile uint64_t milliseconds_since_boot = 0;
 
+// while the idle task sleeps, the PIT is a one shot timer, without periodic ticks
+static volatile bool tickless = false;
+static uint32_t oneshot_counts = 0;
+static uint32_t leftover_counts = 0;
+
+// zero if the cpu has no TSC, or it could not be calibrated
+static uint64_t tsc_frequency = 0;
+static uint64_t tsc_at_boot = 0;
 
 
+static void program_channel_0(uint8_t mode, uint16_t count) {
+    outb(MODE_COMMAND_PORT, SELECT_CHANNEL_0 | ACCESS_LO_HI_BYTE | mode);
+    outb(CHANNEL_0_DATA_PORT, (uint8_t)(count & 0xFF));
+    outb(CHANNEL_0_DATA_PORT, (uint8_t)((count >> 8) & 0xFF));
+}
+
+static uint16_t read_channel_0_count() {
+    outb(MODE_COMMAND_PORT, SELECT_CHANNEL_0 | LATCH_COUNT_VALUE);
+    uint8_t low = inb(CHANNEL_0_DATA_PORT);
+    uint8_t high = inb(CHANNEL_0_DATA_PORT);
+    return ((uint16_t)high << 8) | low;
+}
+
+// counts the TSC cycles while the PIT channel 2 counts down a few msecs,
+// polling its output, so it works before interrupts are enabled
+static void calibrate_tsc() {
+    if (!cpu_has_features(CPU_FEATURE_TSC)) {
+        klog_info("No time stamp counter, clock resolution will be 1 msec");
+        return;
+    }
+
+    // gate low stops the counter, speaker must stay silent
+    uint8_t port_b = inb(PORT_B) & ~(PORT_B_GATE_2 | PORT_B_SPEAKER);
+    outb(PORT_B, port_b);
+    uint16_t count = TSC_CALIBRATION_MSECS * PIT_COUNTS_PER_MSEC;
+    outb(MODE_COMMAND_PORT, SELECT_CHANNEL_2 | ACCESS_LO_HI_BYTE | MODE_INTERRUPT_ON_TERMINAL_COUNT);
+    outb(CHANNEL_2_DATA_PORT, (uint8_t)(count & 0xFF));
+    outb(CHANNEL_2_DATA_PORT, (uint8_t)((count >> 8) & 0xFF));
+
+    // gate high starts counting, output goes high at zero
+    outb(PORT_B, port_b | PORT_B_GATE_2);
+    uint64_t start = rdtsc();
+    uint32_t polls = 0;
+    while ((inb(PORT_B) & PORT_B_OUT_2) == 0 && polls < TSC_CALIBRATION_MAX_POLLS)
+        polls++;
+    uint64_t end = rdtsc();
+    outb(PORT_B, port_b);
+
+    if (polls == TSC_CALIBRATION_MAX_POLLS) {
+        klog_warn("PIT channel 2 did not expire, clock resolution will be 1 msec");
+        return;
+    }
+
+    tsc_frequency = (end - start) * 1000 / TSC_CALIBRATION_MSECS;
+    // the tick has not started yet, close enough to boot time
+    tsc_at_boot = start;
+    klog_info("Time stamp counter runs at %u KHz", (uint32_t)(tsc_frequency / 1000));
+}
+
 void init_timer() {
 
     // we are using the Programmable Interval Timer (PIT)
@@ -49,22 +124,58 @@ void init_timer() {
     // see https://wiki.osdev.org/Programmable_Interval_Timer
 
     // aim for millisecond frequency. In practive this will drift a bit.
-    uint32_t frequency = 1000;
-    uint32_t divisor = 1193180 / frequency;
-    uint8_t mode = ACCESS_LO_HI_BYTE | MODE_SQUARE_WAVE_GENERATOR;
-    outb(MODE_COMMAND_PORT, mode);
-    outb(CHANNEL_0_DATA_PORT, (uint8_t)(divisor & 0xFF));
-    outb(CHANNEL_0_DATA_PORT, (uint8_t)((divisor >> 8) & 0xFF));
+    program_channel_0(MODE_SQUARE_WAVE_GENERATOR, PIT_COUNTS_PER_MSEC);
+
+    calibrate_tsc();
+}
+
+// adds the time the one shot counted, goes back to the periodic tick
+static void leave_tickless(bool expired) {
+    uint32_t elapsed = oneshot_counts;
+    if (!expired) {
+        // after reaching zero, the counter wraps and keeps going
+        uint16_t remaining = read_channel_0_count();
+        if (remaining <= oneshot_counts)
+            elapsed = oneshot_counts - remaining;
+    }
+
+    elapsed += leftover_counts;
+    milliseconds_since_boot += elapsed / PIT_COUNTS_PER_MSEC;
+    leftover_counts = elapsed % PIT_COUNTS_PER_MSEC;
+
+    program_channel_0(MODE_SQUARE_WAVE_GENERATOR, PIT_COUNTS_PER_MSEC);
+    tickless = false;
 }
 
 void timer_interrupt_handler(registers_t *regs) {
-    milliseconds_since_boot++;
+    if (tickless)
+        leave_tickless(true);
+    else
+        milliseconds_since_boot++;
     // if (milliseconds_since_boot % 1000 == 0)
     //     printk("(%u)", milliseconds_since_boot / 1000);
     
     ((void)regs);
 }
 
+// to be called with interrupts disabled, right before halting
+void timer_enter_tickless(uint32_t msecs) {
+    if (tickless || msecs < TICKLESS_MIN_MSECS)
+        return;
+    if (msecs > TICKLESS_MAX_MSECS)
+        msecs = TICKLESS_MAX_MSECS;
+
+    oneshot_counts = msecs * PIT_COUNTS_PER_MSEC;
+    program_channel_0(MODE_INTERRUPT_ON_TERMINAL_COUNT, (uint16_t)oneshot_counts);
+    tickless = true;
+}
+
+// other interrupts may wake us before the one shot expires
+void timer_leave_tickless() {
+    if (tickless)
+        leave_tickless(false);
+}
+
 
 // 32 bits overflow in 49 days
 // 64 bits overflow in... 585 M years
@@ -72,6 +183,18 @@ uint64_t timer_get_uptime_msecs() {
     return milliseconds_since_boot;
 }
 
+// nanoseconds since boot, from the TSC, or the ticks if there is none.
+// split in seconds and remainder, so the multiplication cannot overflow
+uint64_t clock_monotonic_ns() {
+    if (tsc_frequency == 0)
+        return milliseconds_since_boot * 1000000;
+
+    uint64_t cycles = rdtsc() - tsc_at_boot;
+    uint64_t secs = cycles / tsc_frequency;
+    uint64_t remainder = cycles % tsc_frequency;
+    return secs * NSECS_PER_SEC + remainder * NSECS_PER_SEC / tsc_frequency;
+}
+
 void timer_pause_blocking(int msecs) {
     uint64_t target = milliseconds_since_boot + msecs;
     while (milliseconds_since_boot < target);
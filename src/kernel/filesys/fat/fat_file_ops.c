@@ -3,6 +3,7 @@
 
 #include <filesys/vfs.h>
 #include <memory/kheap.h>
+#include <memory/slab.h>
 #include <klib/string.h>
 #include <klog.h>
 #include <errors.h>
@@ -10,22 +11,32 @@
 #include <lock.h>
 
 
+// files are opened and closed all the time, keep their structures in caches
+static kmem_cache_t *priv_file_info_cache = NULL;
+static kmem_cache_t *sector_cache = NULL;
+static kmem_cache_t *cluster_cache = NULL;
+
 
 static int priv_file_open(fat_info *fat, uint32_t cluster_no, uint32_t file_size, fat_priv_file_info **ppf) {
     klog_trace("priv_file_open(cluster=%d, size=%d)", cluster_no, file_size);
     int err;
 
-    fat_priv_file_info *pf = kmalloc(sizeof(fat_priv_file_info));
+    if (priv_file_info_cache == NULL) {
+        priv_file_info_cache = kmem_cache_create("fat_priv_file_info", sizeof(fat_priv_file_info), NULL);
+        sector_cache = kmem_cache_create("sector_t", sizeof(sector_t), NULL);
+        cluster_cache = kmem_cache_create("cluster_t", sizeof(cluster_t), NULL);
+    }
+
+    fat_priv_file_info *pf = kmem_cache_alloc(priv_file_info_cache);
     *ppf = pf;
     memset(pf, 0, sizeof(fat_priv_file_info));
-    pf->sector = kmalloc(sizeof(sector_t));
+    pf->sector = kmem_cache_alloc(sector_cache);
     memset(pf->sector, 0, sizeof(sector_t));
-    pf->cluster = kmalloc(sizeof(cluster_t));
+    pf->cluster = kmem_cache_alloc(cluster_cache);
     memset(pf->cluster, 0, sizeof(cluster_t));
-    pf->sector->buffer = kmalloc(fat->bytes_per_sector);
-    memset(pf->sector->buffer, 0, fat->bytes_per_sector);
-    pf->cluster->buffer = kmalloc(fat->bytes_per_cluster);
-    memset(pf->cluster->buffer, 0, fat->bytes_per_cluster);
+    // buffers are only used after being filled by disk reads, no need to clear them
+    pf->sector->buffer = kmalloc_nozero(fat->bytes_per_sector);
+    pf->cluster->buffer = kmalloc_nozero(fat->bytes_per_cluster);
 
     // read the first cluster, to prepare for reading
     if (file_size > 0 && cluster_no > 0) {
@@ -42,9 +53,9 @@ static int priv_file_open(fat_info *fat, uint32_t cluster_no, uint32_t file_size
 error:
     if (pf->cluster != NULL && pf->cluster->buffer != NULL) kfree(pf->cluster->buffer);
     if (pf->sector != NULL && pf->sector->buffer != NULL) kfree(pf->sector->buffer);
-    if (pf->cluster != NULL) kfree(pf->cluster);
-    if (pf->sector != NULL) kfree(pf->sector);
-    if (pf != NULL) kfree(pf);
+    if (pf->cluster != NULL) kmem_cache_free(cluster_cache, pf->cluster);
+    if (pf->sector != NULL) kmem_cache_free(sector_cache, pf->sector);
+    if (pf != NULL) kmem_cache_free(priv_file_info_cache, pf);
 out:
     return err;
 }
@@ -187,10 +198,10 @@ static int priv_file_close(fat_info *fat, fat_priv_file_info *pf) {
 
     // we must free what we allocated in open()
     kfree(pf->sector->buffer);
-    kfree(pf->sector);
+    kmem_cache_free(sector_cache, pf->sector);
     kfree(pf->cluster->buffer);
-    kfree(pf->cluster);
-    kfree(pf);
+    kmem_cache_free(cluster_cache, pf->cluster);
+    kmem_cache_free(priv_file_info_cache, pf);
 
     return SUCCESS;
 }
@@ -1,13 +1,22 @@
 #include <filesys/vfs.h>
 #include <klib/string.h>
 #include <memory/kheap.h>
+#include <memory/slab.h>
 #include <klog.h>
 
 MODULE("VFS");
 
+static kmem_cache_t *file_descriptor_cache = NULL;
+
+static file_descriptor_t *alloc_file_descriptor() {
+    if (file_descriptor_cache == NULL)
+        file_descriptor_cache = kmem_cache_create("file_descriptor_t", sizeof(file_descriptor_t), NULL);
+    return kmem_cache_alloc(file_descriptor_cache);
+}
+
 
 file_descriptor_t *create_file_descriptor(superblock_t *superblock, const char *name, uint32_t location, file_descriptor_t *owning_dir) {
-    file_descriptor_t *fd = kmalloc(sizeof(file_descriptor_t));
+    file_descriptor_t *fd = alloc_file_descriptor();
     memset(fd, 0, sizeof(file_descriptor_t));
 
     fd->superblock = superblock;
@@ -21,7 +30,7 @@ file_descriptor_t *create_file_descriptor(superblock_t *superblock, const char *
 file_descriptor_t *clone_file_descriptor(const file_descriptor_t *fd) {
     if (fd == NULL)
         return NULL;
-    file_descriptor_t *clone = kmalloc(sizeof(file_descriptor_t));
+    file_descriptor_t *clone = alloc_file_descriptor();
     memcpy(clone, fd, sizeof(file_descriptor_t));
     clone->name = strdup(fd->name);
     
@@ -78,7 +87,7 @@ void destroy_file_descriptor(file_descriptor_t *fd) {
     if (fd->owning_directory != NULL)
         destroy_file_descriptor(fd->owning_directory);
     kfree(fd->name);
-    kfree(fd);
+    kmem_cache_free(file_descriptor_cache, fd);
 }
 
 void debug_file_descriptor(const file_descriptor_t *fd, int depth) {
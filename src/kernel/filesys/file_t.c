@@ -1,13 +1,19 @@
 #include <filesys/vfs.h>
 #include <klib/string.h>
 #include <memory/kheap.h>
+#include <memory/slab.h>
 #include <klog.h>
 
 MODULE("VFS");
 
+static kmem_cache_t *file_t_cache = NULL;
+
 
 file_t *create_file_t(superblock_t *superblock, file_descriptor_t *descriptor) {
-    file_t *file = kmalloc(sizeof(file_t));
+    if (file_t_cache == NULL)
+        file_t_cache = kmem_cache_create("file_t", sizeof(file_t), NULL);
+    file_t *file = kmem_cache_alloc(file_t_cache);
+    memset(file, 0, sizeof(file_t));
 
     file->superblock = superblock; // referenced, not freed
     file->descriptor = descriptor; // referenced, not freed
@@ -26,6 +32,6 @@ void destroy_file_t(file_t *file) {
     // superblock is referenced, not owned, we don't free() it
     // same with file descriptor.
 
-    kfree(file);
+    kmem_cache_free(file_t_cache, file);
 }
 
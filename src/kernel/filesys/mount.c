@@ -4,6 +4,7 @@
 #include <filesys/drivers.h>
 #include <filesys/mount.h>
 #include <memory/kheap.h>
+#include <multitask/rwlock.h>
 #include <klib/string.h>
 #include <klog.h>
 #include <errors.h>
@@ -12,6 +13,7 @@ MODULE("MOUNT");
 
 static struct mount_info *root_mount_info = NULL;
 static struct mount_info *mounts_list = NULL;
+static rwlock_t mounts_lock;  // lookups read, mount and umount write
 
 static void add_mount_info_to_list(struct mount_info *info);
 static void remove_mount_info_from_list(struct mount_info *info);
@@ -31,13 +33,13 @@ struct mount_info *vfs_get_mount_info_by_numbers(int dev_no, int part_no) {
     struct mount_info *p = mounts_list;
     while (p != NULL) {
         if (p->dev->dev_no == dev_no && p->part->part_no == part_no)
-            return p;
+            break;
         p = p->next;
     }
-    return NULL;
+    return p;
 }
 
-struct mount_info *vfs_get_mount_info_by_path(char *path) {
+static struct mount_info *find_by_path(char *path) {
     struct mount_info *p = mounts_list;
     while (p != NULL) {
         if (strcmp(p->mount_point, path) == 0)
@@ -47,6 +49,18 @@ struct mount_info *vfs_get_mount_info_by_path(char *path) {
     return NULL;
 }
 
+struct mount_info *vfs_get_mount_info_by_path(char *path) {
+    return find_by_path(path);
+}
+
+void vfs_mounts_read_lock() {
+    acquire_rwlock_read(&mounts_lock);
+}
+
+void vfs_mounts_read_unlock() {
+    release_rwlock_read(&mounts_lock);
+}
+
 int vfs_mount(uint8_t dev_no, uint8_t part_no, char *path) {
     klog_trace("vfs_mount(%d, %d, \"%s\")", dev_no, part_no, path);
 
@@ -74,6 +88,7 @@ int vfs_mount(uint8_t dev_no, uint8_t part_no, char *path) {
     sb = kmalloc(sizeof(struct superblock));
     sb->driver = driver;
     memset(sb, 0, sizeof(struct superblock));
+    lock_stats_register(&sb->write_lock, "superblock write");
     err = driver->open_superblock(part, sb);
     if (err) {
         klog_error("Error %d, driver opening superblock", err);
@@ -112,9 +127,11 @@ int vfs_mount(uint8_t dev_no, uint8_t part_no, char *path) {
     } 
 
     // add to list, keep as root
+    acquire_rwlock_write(&mounts_lock);
     add_mount_info_to_list(mount);
     if (strcmp(mount->mount_point, "/") == 0)
         root_mount_info = mount;
+    release_rwlock_write(&mounts_lock);
 
     klog_info("Device %d partition %d, driver \"%s\", now mounted on \"%s\"",
         mount->dev->dev_no,
@@ -123,7 +140,10 @@ int vfs_mount(uint8_t dev_no, uint8_t part_no, char *path) {
         mount->mount_point);
     return SUCCESS;
 error:
-    if (sb != NULL) kfree(sb);
+    if (sb != NULL) {
+        lock_stats_unregister(&sb->write_lock);
+        kfree(sb);
+    }
     if (mount != NULL) {
         if (mount->mount_point != NULL) kfree(mount->mount_point);
         if (mount->root_dir != NULL) kfree(mount->root_dir);
@@ -136,29 +156,42 @@ int vfs_umount(char *path) {
     klog_trace("vfs_umount(\"%s\")", path);
     int err;
 
-    mount_info_t *mount = vfs_get_mount_info_by_path(path);
+    // out of the list first, so that nobody finds it while closing
+    acquire_rwlock_write(&mounts_lock);
+    mount_info_t *mount = find_by_path(path);
+    if (mount != NULL) {
+        remove_mount_info_from_list(mount);
+        if (root_mount_info == mount)
+            root_mount_info = NULL;
+    }
+    release_rwlock_write(&mounts_lock);
     if (mount == NULL)
         return ERR_NOT_FOUND;
 
     if (mount->root_dir != NULL) {
         err = mount->superblock->ops->closedir(mount->root_dir);
-        if (err) return err;
+        if (err) goto error;
     }
 
     err = mount->driver->close_superblock(mount->superblock);
-    if (err) return err;
-
-    remove_mount_info_from_list(mount);
-    if (strcmp(mount->mount_point, "/") == 0)
-        root_mount_info = NULL;
+    if (err) goto error;
 
 
     if (mount->root_dir != NULL) kfree(mount->root_dir);
+    lock_stats_unregister(&mount->superblock->write_lock);
     kfree(mount->superblock);
     kfree(mount->mount_point);
     kfree(mount);
 
     return SUCCESS;
+error:
+    // still mounted, put it back
+    acquire_rwlock_write(&mounts_lock);
+    add_mount_info_to_list(mount);
+    if (strcmp(mount->mount_point, "/") == 0)
+        root_mount_info = mount;
+    release_rwlock_write(&mounts_lock);
+    return err;
 }
 
 int vfs_discover_and_mount_filesystems(char *kernel_cmd_line) {
@@ -182,7 +215,10 @@ int vfs_discover_and_mount_filesystems(char *kernel_cmd_line) {
     struct partition *part = get_partitions_list();
     while (part != NULL) {
         int dev_no = part->dev->dev_no;
-        if (vfs_get_mount_info_by_numbers(dev_no, part->part_no) != NULL) {
+        vfs_mounts_read_lock();
+        bool mounted = vfs_get_mount_info_by_numbers(dev_no, part->part_no) != NULL;
+        vfs_mounts_read_unlock();
+        if (mounted) {
             // already mounted
             part = part->next;
             continue;
@@ -72,12 +72,15 @@ static void debug_dir_entry_t(dir_entry_t *dir_entry) {
 
 
 // similar to namei() in unix/linux
+// callers hold vfs_mounts_read_lock(), so that the mount of the descriptors
+// cannot go away while they resolve and use them
 int vfs_resolve(const char *path, const file_descriptor_t *root_dir, const file_descriptor_t *curr_dir, bool containing_folder, file_descriptor_t **target) {
     klog_trace("vfs_resolve(\"%s\", root=0x%x, curr=0x%x, container=%d)",
         path, root_dir, curr_dir, (int)containing_folder);
     int err = SUCCESS;
     char *path_copy = NULL;
     char *final_path = NULL;
+    char *next_name = NULL;
     
     // test edge cases first
     if (path == NULL)
@@ -132,10 +135,7 @@ int vfs_resolve(const char *path, const file_descriptor_t *root_dir, const file_
     // but, to not implement this in every filesys driver, 
     // we must implement something on VFS level. 
 
-    // TODO: we may need to lock here, to avoid reentrance 
-    // from another task, as the strtok() is not thread safe?
-
-    char *name = strtok(final_path, "/");
+    char *name = strtok_r(final_path, "/", &next_name);
     while (true) {
         klog_trace("Looking for name \"%s\" in base directory \"%s\"", name, base_dir->name);
 
@@ -158,7 +158,7 @@ int vfs_resolve(const char *path, const file_descriptor_t *root_dir, const file_
         // we could substitute the other dir (fs B, "/")
 
         // let's check if we finished
-        name = strtok(NULL, "/");
+        name = strtok_r(NULL, "/", &next_name);
         if (name == NULL || strlen(name) == 0) {
             // we are done, target contains the... target, so free base_dir
             destroy_file_descriptor(base_dir);
@@ -185,6 +185,7 @@ out:
 int vfs_open(char *path, file_t **file) {
     int err;
 
+    vfs_mounts_read_lock();
     if (vfs_get_root_mount() == NULL) {
         err = ERR_NO_FS_MOUNTED;
         goto out;
@@ -206,11 +207,14 @@ int vfs_open(char *path, file_t **file) {
     klog_debug("vfs_open(), resolved descriptor follows");
     debug_file_descriptor(target, 0);
 
-    if (target->superblock->ops->open == NULL)
-        return ERR_NOT_SUPPORTED;
+    if (target->superblock->ops->open == NULL) {
+        err = ERR_NOT_SUPPORTED;
+        goto out;
+    }
     err = target->superblock->ops->open(target, 0, file);
 
 out:
+    vfs_mounts_read_unlock();
     klog_trace("vfs_open(\"%s\") -> %d", path, err);
     return err;
 }
@@ -245,10 +249,30 @@ int vfs_close(file_t *file) {
     return file->superblock->ops->close(file);
 }
 
+int vfs_reopen(file_t *source, file_t **target) {
+    file_descriptor_t *fd = source->descriptor;
+    if (fd->flags & FD_DIR) {
+        if (fd->superblock->ops->opendir == NULL)
+            return ERR_NOT_SUPPORTED;
+        return fd->superblock->ops->opendir(fd, target);
+    }
+
+    if (fd->superblock->ops->open == NULL)
+        return ERR_NOT_SUPPORTED;
+    int err = fd->superblock->ops->open(fd, 0, target);
+    if (err)
+        return err;
+    int position = vfs_seek(source, 0, SEEK_CURRENT);
+    if (position > 0)
+        vfs_seek(*target, position, SEEK_START);
+    return SUCCESS;
+}
+
 int vfs_opendir(char *path, file_t **file) {
     klog_trace("vfs_opendir(path=\"%s\")", path);
     int err;
 
+    vfs_mounts_read_lock();
     if (vfs_get_root_mount() == NULL) {
         err = ERR_NO_FS_MOUNTED;
         goto out;
@@ -270,10 +294,13 @@ int vfs_opendir(char *path, file_t **file) {
     klog_debug("vfs_opendir(), resolved descriptor follows");
     debug_file_descriptor(target, 0);
 
-    if (target->superblock->ops->opendir == NULL)
-        return ERR_NOT_SUPPORTED;
+    if (target->superblock->ops->opendir == NULL) {
+        err = ERR_NOT_SUPPORTED;
+        goto out;
+    }
     err = target->superblock->ops->opendir(target, file);
 out:
+    vfs_mounts_read_unlock();
     klog_trace("vfs_opendir(\"%s\") -> %d", path, err);
     return err;
 }
@@ -304,6 +331,7 @@ int vfs_touch(char *path) {
     int err;
     char *copy = NULL;
 
+    vfs_mounts_read_lock();
     if (vfs_get_root_mount() == NULL) {
         err = ERR_NO_FS_MOUNTED;
         goto out;
@@ -330,6 +358,7 @@ int vfs_touch(char *path) {
     err = parent->superblock->ops->touch(parent, pathname(copy));
 
 out:
+    vfs_mounts_read_unlock();
     if (copy != NULL)
         kfree(copy);
     klog_trace("vfs_touch(\"%s\") -> %d", path, err);
@@ -341,6 +370,7 @@ int vfs_unlink(char *path) {
     int err;
     char *copy = NULL;
 
+    vfs_mounts_read_lock();
     if (vfs_get_root_mount() == NULL) {
         err = ERR_NO_FS_MOUNTED;
         goto out;
@@ -367,6 +397,7 @@ int vfs_unlink(char *path) {
     err = parent->superblock->ops->unlink(parent, pathname(copy));
 
 out:
+    vfs_mounts_read_unlock();
     if (copy != NULL)
         kfree(copy);
     klog_trace("vfs_unlink(\"%s\") -> %d", path, err);
@@ -378,6 +409,7 @@ int vfs_mkdir(char *path) {
     int err;
     char *copy = NULL;
 
+    vfs_mounts_read_lock();
     if (vfs_get_root_mount() == NULL) {
         err = ERR_NO_FS_MOUNTED;
         goto out;
@@ -404,6 +436,7 @@ int vfs_mkdir(char *path) {
     err = parent->superblock->ops->mkdir(parent, pathname(copy));
 
 out:
+    vfs_mounts_read_unlock();
     if (copy != NULL)
         kfree(copy);
     klog_trace("vfs_mkdir(\"%s\") -> %d", path, err);
@@ -415,6 +448,7 @@ int vfs_rmdir(char *path) {
     int err;
     char *copy = NULL;
 
+    vfs_mounts_read_lock();
     if (vfs_get_root_mount() == NULL) {
         err = ERR_NO_FS_MOUNTED;
         goto out;
@@ -467,6 +501,7 @@ int vfs_rmdir(char *path) {
     err = parent->superblock->ops->rmdir(parent, pathname(copy));
 
 out:
+    vfs_mounts_read_unlock();
     if (copy != NULL)
         kfree(copy);
     klog_trace("vfs_rmdir(\"%s\") -> %d", path, err);
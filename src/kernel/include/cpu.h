@@ -38,4 +38,31 @@ void enable_nmi();
 // a non-zero means CPUID is supported
 extern uint32_t get_cpuid_availability();
 
+// executes the CPUID instruction, caller must check availability first
+void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx);
+
+// feature bits of CPUID leaf 1, in EDX
+#define CPU_FEATURE_PSE    (1 << 3)    // 4 MB pages
+#define CPU_FEATURE_TSC    (1 << 4)    // time stamp counter
+#define CPU_FEATURE_MSR    (1 << 5)    // rdmsr / wrmsr
+#define CPU_FEATURE_APIC   (1 << 9)    // on chip local APIC
+#define CPU_FEATURE_SEP    (1 << 11)   // sysenter / sysexit
+#define CPU_FEATURE_PGE    (1 << 13)   // global pages
+
+// true if all the requested feature bits are supported, false on cpus without CPUID
+bool cpu_has_features(uint32_t features);
+
+// reads the time stamp counter, caller must check CPU_FEATURE_TSC first
+uint64_t rdtsc();
+
+// model specific registers, caller must check CPU_FEATURE_MSR first
+#define MSR_SYSENTER_CS    0x174
+#define MSR_SYSENTER_ESP   0x175
+#define MSR_SYSENTER_EIP   0x176
+
+void wrmsr(uint32_t msr, uint64_t value);
+
+// the SEP bit, except for the early Pentium Pro that report it without supporting it
+bool cpu_has_sysenter();
+
 #endif
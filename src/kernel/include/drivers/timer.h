@@ -7,7 +7,21 @@ void init_timer();
 void timer_interrupt_handler(registers_t *regs);
 uint64_t timer_get_uptime_msecs();
 
+// nanoseconds since boot, using the TSC calibrated at boot, if available
+uint64_t clock_monotonic_ns();
+
 void timer_pause_blocking(int milliseconds);
 
+// when idle, the periodic tick is replaced by a one shot interrupt, at most 50 msecs away,
+// the PIT counter cannot hold much more. not worth it for one or two ticks.
+#define TICKLESS_MIN_MSECS   3
+#define TICKLESS_MAX_MSECS   50
+
+// stop ticking for up to msecs, to be called with interrupts disabled, before halting.
+void timer_enter_tickless(uint32_t msecs);
+
+// restart the periodic tick, accounting for the time passed. called on interrupts.
+void timer_leave_tickless();
+
 
 #endif
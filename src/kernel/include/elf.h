@@ -19,6 +19,19 @@ int get_elf_load_information(file_t *file, void **virt_addr_start, void **virt_a
 // loads segments from the file into memory
 int load_elf_into_memory(file_t *file);
 
+// a loadable segment, as it should appear in memory
+typedef struct elf_segment {
+    void *vaddr;
+    uint32_t memory_size;
+    uint32_t file_offset;
+    uint32_t file_size;
+    bool writable;
+    bool executable;
+} elf_segment_t;
+
+// fills up to max_segments loadable segments, returns their count or a negative error
+int get_elf_loadable_segments(file_t *file, elf_segment_t *segments, int max_segments);
+
 // logs debug information about the elf, and how we understand it.
 int dump_elf_information(file_t *file);
 
@@ -19,6 +19,13 @@ typedef struct mount_info {
     struct mount_info *next;
 } mount_info_t;
 
+// keeps mounts from going away while using them, lookups may run concurrently.
+// hold it around the functions below and for as long as the returned pointers
+// or descriptors of the mounted filesystems are used. do not nest it,
+// a waiting umount would deadlock us.
+void vfs_mounts_read_lock();
+void vfs_mounts_read_unlock();
+
 struct mount_info *vfs_get_mounts_list();
 struct mount_info *vfs_get_root_mount();
 struct mount_info *vfs_get_mount_info_by_numbers(int dev_no, int part_no);
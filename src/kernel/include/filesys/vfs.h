@@ -3,6 +3,7 @@
 
 #include <ctypes.h>
 #include <lock.h>
+#include <multitask/mutex.h>
 #include <filesys/drivers.h>
 #include <filesys/partition.h>
 
@@ -13,7 +14,7 @@ typedef struct superblock {
     struct filesys_driver *driver;
     struct partition *partition;
     struct file_ops *ops;
-    lock_t write_lock;
+    mutex_t write_lock;  // held across disk i/o, so waiters sleep
     void *priv_fs_driver_data;
 } superblock_t;
 
@@ -206,6 +207,9 @@ int vfs_seek(file_t *file, int offset, enum seek_origin origin);
 int vfs_flush(file_t *file);
 int vfs_close(file_t *file);
 
+// opens the same file or directory again, with its own position
+int vfs_reopen(file_t *source, file_t **target);
+
 int vfs_opendir(char *path, file_t **file);
 int vfs_rewinddir(file_t *file);
 int vfs_readdir(file_t *file, file_descriptor_t **fd); // caller must destroy fd
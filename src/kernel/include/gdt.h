@@ -1,7 +1,43 @@
 #ifndef _GDT_H
 #define _GDT_H
 
+#include <ctypes.h>
+
+// null, kernel code and data, user code and data, then the per cpu ones
+#define GDT_ENTRIES              7
+
+#define KERNEL_CODE_SELECTOR     0x08
+#define KERNEL_DATA_SELECTOR     0x10
+#define TSS_SELECTOR             0x28
+#define PER_CPU_DATA_SELECTOR    0x30   // GS, based at the cpu's cpu_t, see smp.h
+
+// the 32 bits task state segment. everything runs in ring 0, so the cpu
+// does not load esp0 from it yet, but each cpu needs one for its task register.
+typedef struct tss {
+    uint32_t prev_task_link;
+    uint32_t esp0;
+    uint32_t ss0;
+    uint32_t esp1;
+    uint32_t ss1;
+    uint32_t esp2;
+    uint32_t ss2;
+    uint32_t cr3;
+    uint32_t eip;
+    uint32_t eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs;
+    uint32_t ldt_selector;
+    uint16_t trap;
+    uint16_t iomap_base;
+} __attribute__((packed)) tss_t;
+
+struct cpu;
+
+// prepares the common descriptors and loads the bootstrap cpu's table
 void init_gdt();
 
+// each cpu loads its own copy, with its TSS and its per cpu data segment
+void load_cpu_gdt(struct cpu *cpu);
+
 
 #endif
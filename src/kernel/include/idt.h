@@ -15,6 +15,9 @@ typedef struct registers
 
 void init_idt(uint16_t code_segment_selector);
 
+// init_idt() does it for the bootstrap cpu, the others call it on their own
+void init_sysenter(uint16_t code_segment_selector);
+
 
 
 #endif
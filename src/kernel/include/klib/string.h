@@ -18,6 +18,9 @@ char *strstr(char *heystack, char *needle);
 // returns NULL if there are no more tokens
 char *strtok(char *str, char *delimiters);
 
+// same, with the position kept in *next, so that it can be used concurrently
+char *strtok_r(char *str, char *delimiters, char **next);
+
 // caller is supposed to free the duplicate
 char *strdup(const char *str);
 
@@ -1,10 +1,66 @@
 #ifndef _LOCK_H
 #define _LOCK_H
 
-typedef volatile int lock_t;
+#include <ctypes.h>
+
+
+// ticket lock, waiters get the lock in the order they asked for it.
+// the low half hands out tickets, the high half is the ticket being served.
+// zero means unlocked, so locks in zeroed memory are ready to use.
+typedef volatile uint32_t lock_t;
 
 void acquire(lock_t* lock);
 void release(lock_t *lock);
 
 
+// MCS lock, for heavily contended locks: each waiter spins on its own node,
+// not on the lock, and the holder hands the lock to the next one in line.
+// the node must stay alive until released, e.g. a local variable.
+typedef struct mcs_node {
+    struct mcs_node *volatile next;
+    volatile bool locked;
+} mcs_node_t;
+
+typedef struct mcs_lock {
+    mcs_node_t *volatile tail;  // NULL means unlocked
+} mcs_lock_t;
+
+void mcs_acquire(mcs_lock_t *lock, mcs_node_t *node);
+void mcs_release(mcs_lock_t *lock, mcs_node_t *node);
+
+
+// uncomment to count acquisitions, spins and hold time of registered locks.
+// it slows every lock operation down, it is meant for finding hotspots.
+// #define LOCK_STATS
+
+#define LOCK_STATS_MAX_LOCKS   32
+
+typedef struct lock_stats {
+    const char *name;
+    void *lock;
+    uint32_t acquisitions;
+    uint32_t contended;      // acquisitions that had to wait
+    uint64_t spins;
+    uint64_t hold_nsecs;
+    uint64_t max_hold_nsecs;
+    uint64_t acquired_at;
+} lock_stats_t;
+
+#ifdef LOCK_STATS
+// locks are tracked by address, a lock_t, an mcs_lock_t or a mutex_t
+void lock_stats_register(void *lock, const char *name);
+void lock_stats_unregister(void *lock);
+
+// for lock implementations, called after acquiring and before releasing
+void lock_stats_acquired(void *lock, uint32_t spins);
+void lock_stats_releasing(void *lock);
+#else
+#define lock_stats_register(lock, name)   ((void)0)
+#define lock_stats_unregister(lock)       ((void)0)
+#endif
+
+// for viewing, returns the number of entries copied, zero without LOCK_STATS
+int lock_stats_snapshot(lock_stats_t *stats, int max_entries);
+
+
 #endif
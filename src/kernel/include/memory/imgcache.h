@@ -0,0 +1,22 @@
+#ifndef _IMGCACHE_H
+#define _IMGCACHE_H
+
+#include <ctypes.h>
+#include <filesys/vfs.h>
+
+
+// keeps the read only pages of executables (text, rodata), as they were loaded,
+// so that processes running the same executable share them, without reading the disk.
+// images are keyed by the file location and modification time.
+
+// returns the cached physical page for the virtual page of the executable, or NULL.
+// a reference is added to the page, for the caller to map it.
+void *imgcache_get_page(file_t *file, void *page_address);
+
+// keeps a loaded page for future processes, the cache takes its own reference
+void imgcache_put_page(file_t *file, void *page_address, void *physical_page);
+
+void imgcache_dump();
+
+
+#endif
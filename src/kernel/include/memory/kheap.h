@@ -4,11 +4,14 @@
 #include <ctypes.h>
 
 
-// naive effort, needs to rewrite completely
+// boundary tagged blocks, free ones also kept in power-of-two size class lists
 void init_kernel_heap(void *heap_start, size_t heap_size);
 
+// flags for __kmalloc()
+#define KMALLOC_ZERO    0x01    // clear the memory before returning it
+
 // define DEBUG_HEAP_OPS to help debugging overflows
-void *__kmalloc(size_t size, char *expl, char *file, uint16_t line);
+void *__kmalloc(size_t size, int flags, char *expl, char *file, uint16_t line);
 
 // checks magic numbers and logs possible overflow/underflow
 void __kcheck(void *ptr, char *name, char *file, int line);
@@ -25,11 +28,15 @@ void __kernel_heap_verify(char *file, int line);
 
 #define DEBUG_HEAP_OPS  1
 #ifdef DEBUG_HEAP_OPS
-    #define kmalloc(size)          __kmalloc(size, #size, __FILE__, __LINE__)
+    // fill freed memory with a pattern, to catch use after free
+    #define DEBUG_HEAP_POISON  1
+    #define kmalloc(size)          __kmalloc(size, KMALLOC_ZERO, #size, __FILE__, __LINE__)
+    #define kmalloc_nozero(size)   __kmalloc(size, 0, #size, __FILE__, __LINE__)
     #define kcheck(ptr, name)      __kcheck(ptr, name, __FILE__, __LINE__)
     #define kernel_heap_verify()   __kernel_heap_verify(__FILE__, __LINE__)
 #else
-    #define kmalloc(size)          __kmalloc(size, NULL, NULL, 0)
+    #define kmalloc(size)          __kmalloc(size, KMALLOC_ZERO, NULL, NULL, 0)
+    #define kmalloc_nozero(size)   __kmalloc(size, 0, NULL, NULL, 0)
     #define kcheck(ptr, name)      ((void)0)
     #define kernel_heap_verify()   ((void)0)
 #endif
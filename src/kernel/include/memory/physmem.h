@@ -8,12 +8,56 @@ int physical_page_size();
 
 void init_physical_memory_manager(multiboot_info_t *info, void *kernel_start_address, void *kernel_end_address);
 
+// end of the memory reserved for the kernel and the memory manager structures
+void *get_kernel_reserved_memory_end();
+
+// for pages reached through their physical address (page tables, slabs, buffers),
+// taken from the low memory, that all address spaces identity map
 void *allocate_physical_page(void *minimum_address);
 void free_physical_page(void *address);
 
 void *allocate_consecutive_physical_pages(size_t size_in_bytes, void *minimum_address);
 void free_consecutive_physical_pages(void *address, size_t size_in_bytes);
 
+// returns a cleared page of low memory
+void *allocate_physical_page_zeroed(void *minimum_address);
+
+// for pages only reached through a mapping (process pages, kernel heap), taken above
+// the low memory while possible. zeroed ones come from the pool of pre-zeroed pages if possible
+void *allocate_mapped_physical_page(bool zeroed);
+
+// clears free pages into the pre-zeroed pool, meant for the idle task.
+// interrupts stay enabled while clearing. returns the pages added.
+int refill_zeroed_pages_pool();
+
+// what a physical page was allocated for
+enum page_owner {
+    PAGE_OWNER_NONE = 0,
+    PAGE_OWNER_KERNEL,      // kernel buffers, slabs, heap
+    PAGE_OWNER_PAGE_TABLE,  // page directories and tables
+    PAGE_OWNER_USER,        // mapped in process address spaces
+};
+
+#define PAGE_FRAME_RESERVED   0x01  // kernel image, memory manager structures, firmware
+
+// one per physical page, allocated pages start with a reference count of one
+typedef struct page_frame {
+    uint16_t refcount;
+    uint8_t flags;
+    uint8_t owner;
+} page_frame_t;
+
+// returns the frame of the page containing the address, or NULL if beyond memory
+page_frame_t *get_page_frame(void *address);
+
+void set_physical_page_owner(void *address, enum page_owner owner);
+
+// another mapping or user now refers to the page
+void physical_page_add_ref(void *address);
+
+// drops a reference, the page is freed when none remain. returns remaining references
+int physical_page_release(void *address);
+
 typedef struct phys_mem_info {
     int kb_total;
     int kb_used;
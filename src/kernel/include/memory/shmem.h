@@ -0,0 +1,31 @@
+#ifndef _SHMEM_H
+#define _SHMEM_H
+
+#include <ctypes.h>
+
+
+// the physical pages behind an anonymous MAP_SHARED mapping.
+// the mapping and its copies in forked processes all point to the same object,
+// so that they map the same pages, whichever process touches a page first.
+typedef struct shared_memory {
+    int refcount;           // areas using it
+    uint32_t pages_count;
+    void **pages;           // physical pages, NULL until first touched
+} shared_memory_t;
+
+// creates an object for a mapping of the size, with no pages yet
+shared_memory_t *shmem_create(uint32_t size);
+
+// for another area using the object, e.g. after fork()
+void shmem_add_ref(shared_memory_t *shmem);
+
+// when the last area lets go, the object releases its pages.
+// pages still mapped are freed with their page directories.
+void shmem_release(shared_memory_t *shmem);
+
+// returns the physical page at the offset, allocating a zeroed one the first time.
+// a reference is added to the page, for the caller to map it.
+void *shmem_get_page(shared_memory_t *shmem, uint32_t offset);
+
+
+#endif
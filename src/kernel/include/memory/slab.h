@@ -0,0 +1,48 @@
+#ifndef _SLAB_H
+#define _SLAB_H
+
+#include <ctypes.h>
+
+
+// a cache of same sized objects, packed in slabs of one physical page each
+typedef struct kmem_cache kmem_cache_t;
+
+// called once for each object, when a new slab is populated.
+// objects should be returned to this state before being freed.
+typedef void (*kmem_cache_ctor_t)(void *object);
+
+typedef struct kmem_cache_stats {
+    const char *name;
+    uint32_t object_size;
+    uint32_t objects_per_slab;
+    uint32_t slabs;
+    uint32_t objects_total;
+    uint32_t objects_in_use;
+    uint32_t allocations;
+    uint32_t frees;
+} kmem_cache_stats_t;
+
+// creates a cache of objects of the given size, ctor can be NULL
+kmem_cache_t *kmem_cache_create(const char *name, size_t object_size, kmem_cache_ctor_t ctor);
+
+// gets an object from the cache, in constant time. contents are not cleared.
+void *kmem_cache_alloc(kmem_cache_t *cache);
+
+// returns an object to the cache, the slab is found from the pointer
+void kmem_cache_free(kmem_cache_t *cache, void *object);
+
+// returns the unused slabs of the cache to the physical memory manager
+void kmem_cache_shrink(kmem_cache_t *cache);
+
+// frees all slabs and the cache itself, all objects must have been freed
+void kmem_cache_destroy(kmem_cache_t *cache);
+
+void kmem_cache_get_stats(kmem_cache_t *cache, kmem_cache_stats_t *stats);
+
+// allows iterating the caches, pass NULL to get the first one
+kmem_cache_t *kmem_cache_next(kmem_cache_t *cache);
+
+void kmem_caches_dump();
+
+
+#endif
@@ -9,6 +9,17 @@ void *resolve_virtual_to_physical_address(void *virtual_addr, void *page_dir_add
 // map a virtual address to a physical one
 void map_virtual_address_to_physical(void *virtual_addr, void *physical_addr, void *page_dir_addr, bool skip_logging);
 
+// map a page that belongs to the address space, it is released when the page directory
+// is destroyed, and shared copy on write when the page directory is cloned
+void map_owned_page(void *virtual_addr, void *physical_addr, void *page_dir_addr);
+
+// map a read only page, that may also be mapped by other address spaces.
+// the reference of the address space is released when the page directory is destroyed.
+void map_shared_page(void *virtual_addr, void *physical_addr, void *page_dir_addr);
+
+// map a writable page of shared memory, cloned page directories keep writing to it
+void map_shared_memory_page(void *virtual_addr, void *physical_addr, void *page_dir_addr);
+
 // unmap a virtual address (remove paging entries)
 void unmap_virtual_address(void *virtual_addr, void *page_dir_addr);
 
@@ -36,12 +47,44 @@ void *get_page_directory_register();
 
 
 
+// physical memory below this is identity mapped in all address spaces, processes live above it.
+// it holds what the kernel reaches through a physical address, page tables, slabs and buffers.
+#define LOW_MEMORY_IDENTITY_END  0x08000000
+
+// the kernel heap grows into this area, mapped the same way in all address spaces
+#define KERNEL_HEAP_AREA_START   0xD0000000
+#define KERNEL_HEAP_AREA_SIZE    (256 * 1024 * 1024)
+
+// pages of processes are filled through this area, not through their physical address,
+// which may be in use by the current process for something else. one page table, shared as well.
+#define KERNEL_TEMP_AREA_START   0xCFC00000
+#define KERNEL_TEMP_AREA_SIZE    (4 * 1024 * 1024)
+
+// maps a physical page in the temporary area, returns the address to reach it with
+void *map_temporary_page(void *physical_page);
+
+// releases an address returned by map_temporary_page()
+void unmap_temporary_page(void *virtual_address);
+
+// backs pages of the kernel heap area with newly allocated physical pages
+void map_kernel_heap_area_pages(void *virt_addr, int pages);
+
+// unmaps pages of the kernel heap area and frees their physical pages
+void unmap_kernel_heap_area_pages(void *virt_addr, int pages);
+
 // allocates and creates a new page directory
 void *create_page_directory(bool map_kernel_space);
 
 // allocates pages and maps them to the virtual addresses requested (end_addr exclusive)
 void allocate_virtual_memory_range(void *virt_addr_start, void *virt_addr_end, void *page_dir_addr);
 
+// unmaps the virtual addresses, releasing the pages owned by the address space (end_addr exclusive)
+void release_virtual_memory_range(void *virt_addr_start, void *virt_addr_end, void *page_dir_addr);
+
+// creates a page directory sharing the owned pages, read only, copied on the first write.
+// pages in [skip_start, skip_end) are not cloned, the caller maps them.
+void *clone_page_directory_copy_on_write(void *page_dir_address, void *skip_start, void *skip_end);
+
 // frees any pointed pages, page tables, and the page directory itself
 void destroy_page_directory(void *page_dir_address);
 
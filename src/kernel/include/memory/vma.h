@@ -0,0 +1,71 @@
+#ifndef _VMA_H
+#define _VMA_H
+
+#include <ctypes.h>
+#include <filesys/vfs.h>
+#include <memory/shmem.h>
+
+
+// the kind of memory a virtual memory area holds
+enum vma_type { VMA_STACK, VMA_HEAP, VMA_ELF_SEGMENT, VMA_MMAP };
+
+#define VMA_WRITABLE     0x01
+#define VMA_EXECUTABLE   0x02
+
+// mmap() areas are placed here, below 2 GB, so that addresses are positive syscall return values
+#define MMAP_AREA_START  ((void *)0x40000000)
+#define MMAP_AREA_END    ((void *)0x80000000)
+
+// a page aligned range of a process address space (end exclusive).
+// pages are backed by physical memory on first touch, by the page fault handler.
+// for file backed areas, the bytes in [file_vaddr, file_vaddr + file_size)
+// are read from file_offset onwards, everything else is zero filled.
+// file backed areas read from the executable, unless they have their own file.
+// shared memory areas map the pages of their object, in all processes that have it.
+typedef struct vma {
+    struct vma *next;
+    void *start;
+    void *end;
+    uint8_t type;
+    uint8_t flags;
+
+    file_t *file;
+    void *file_vaddr;
+    uint32_t file_offset;
+    uint32_t file_size;
+
+    shared_memory_t *shared;
+} vma_t;
+
+// creates an area, page aligning the range, and adds it to the list
+vma_t *vma_add(vma_t **list, enum vma_type type, uint8_t flags, void *start, void *end);
+
+// returns the area that contains the address, or NULL
+vma_t *vma_find(vma_t *list, void *address);
+
+// returns the first area of the given type, or NULL
+vma_t *vma_find_type(vma_t *list, enum vma_type type);
+
+// finds the lowest free range of the size, between the two addresses, or returns NULL
+void *vma_find_free_range(vma_t *list, uint32_t size, void *low, void *high);
+
+// removes the area from the list, closing its file and releasing its shared memory.
+// pages must be unmapped by the caller.
+void vma_remove(vma_t **list, vma_t *vma);
+
+// backs the page with a zeroed physical page, mapped in the current page directory,
+// after reading the parts of any file backed areas that overlap the page.
+// pages holding only read only segments are shared, through the executable image cache.
+int vma_populate_page(vma_t *list, file_t *file, void *page_address);
+
+// copies all areas of the list, for a forked process, files are reopened, shared memory is kept
+vma_t *vma_clone_all(vma_t *list);
+
+// frees all areas of the list, closes their files and releases their shared memory.
+// pages are freed with the page directory
+void vma_free_all(vma_t **list);
+
+void vma_dump(vma_t *list);
+
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _FAIRQ_H
+#define _FAIRQ_H
+
+#include <multitask/process.h>
+
+
+// ready processes of the fair scheduling class, kept in a balanced (AVL) tree,
+// ordered by virtual runtime. the one that has run the least is picked first.
+struct fair_queue {
+    process_t *root;
+    int count;
+
+    // never decreases, new and waking processes are placed relative to it
+    uint64_t min_vruntime;
+};
+typedef struct fair_queue fair_queue_t;
+
+
+// add a ready process, by its vruntime. O(log n)
+void fairq_insert(fair_queue_t *queue, process_t *proc);
+
+// the process with the smallest vruntime, or NULL. O(log n)
+process_t *fairq_first(fair_queue_t *queue);
+
+// extract the process with the smallest vruntime, or NULL. O(log n)
+process_t *fairq_pop_first(fair_queue_t *queue);
+
+// remove a process from anywhere in the tree, e.g. to change its priority. O(log n)
+void fairq_remove(fair_queue_t *queue, process_t *proc);
+
+// calls the function for each process, in vruntime order
+void fairq_walk(fair_queue_t *queue, void (*func)(process_t *proc, void *data), void *data);
+
+
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _FUTEX_H
+#define _FUTEX_H
+
+#include <ctypes.h>
+
+
+// user space synchronization, see libc's sync.h.
+// processes wait on a 32 bits word of their address space, so that the uncontended
+// paths stay in user space. private words are keyed by (page directory, address),
+// words in shared memory by their physical address, the same in all processes.
+#define FUTEX_HASH_BUCKETS   64
+
+// blocks the running process, unless *address no longer holds the expected value.
+// returns SUCCESS when woken up, ERR_TRY_AGAIN if the value had changed.
+int futex_wait(uint32_t *address, uint32_t expected);
+
+// wakes up to count processes waiting on the address, returns how many
+int futex_wake(uint32_t *address, int count);
+
+
+#endif
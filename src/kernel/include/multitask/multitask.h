@@ -13,8 +13,15 @@ bool multitasking_enabled();
 // start mutlitasking the started processes. this method never returns.
 void start_multitasking();
 
+// application processors wait here for start_multitasking(), then run processes too.
+// this method never returns either.
+void multitasking_start_on_application_processor();
+
 // expected to be called from timer IRQ handler, every msec
 void multitasking_timer_ticked();
 
+// expected to be called from the reschedule IPI handler, see smp_send_reschedule()
+void multitasking_reschedule_requested();
+
 
 #endif
\ No newline at end of file
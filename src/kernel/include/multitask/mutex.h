@@ -0,0 +1,36 @@
+#ifndef _MUTEX_H
+#define _MUTEX_H
+
+#include <ctypes.h>
+
+struct process;
+
+
+// sleeping mutex, with priority inheritance: while a higher priority process
+// waits for it, the owner runs at that priority, so that it gets out of the way.
+// inheritance follows chains of owners waiting for other mutexes.
+// not acquired for real before multitasking starts, there is nobody to exclude.
+typedef struct mutex {
+    struct process *volatile owner;  // NULL when free
+    int waiting_processes;
+    struct mutex *next_held;         // in the list of the owner
+} mutex_t;
+
+// how many times to retry while the owner is running on another cpu, before blocking
+#define MUTEX_SPIN_LIMIT              1000
+
+// how far to follow owners waiting for other mutexes
+#define MUTEX_INHERITANCE_DEPTH       8
+
+
+// allocates, initializes and returns a mutex - remember to free() when done
+mutex_t *create_mutex();
+
+// blocks until mutex acquired
+void acquire_mutex(mutex_t *mutex);
+
+// releases mutex, handing it to the highest priority waiter
+void release_mutex(mutex_t *mutex);
+
+
+#endif
@@ -5,6 +5,7 @@
 #include <lock.h>
 #include <devices/tty.h>
 #include <filesys/vfs.h>
+#include <memory/vma.h>
 
 // used to detect stack overflows
 #define STACK_BOTTOM_MAGIC_VALUE    0x12345678
@@ -54,7 +55,7 @@ typedef struct switched_stack_snapshot switched_stack_snapshot_t;
 enum process_state { READY, RUNNING, BLOCKED, TERMINATED };
 
 // reasons a process can be blocked
-enum block_reasons { SLEEPING = 1, SEMAPHORE, WAIT_USER_INPUT, WAIT_CHILD_EXIT };
+enum block_reasons { SLEEPING = 1, SEMAPHORE, WAIT_USER_INPUT, WAIT_CHILD_EXIT, MUTEX, RWLOCK_READ, RWLOCK_WRITE, FUTEX };
 
 // flags of the process
 #define PROC_FLAG_IS_USER_PROCESS     0x01
@@ -70,7 +71,11 @@ struct process {
     process_t *parent;
     char *name;
     uint8_t flags;
-    uint8_t  priority;
+    uint8_t  priority;        // may be raised, while holding a mutex others wait for
+    uint8_t  base_priority;   // the one given at creation
+
+    // mutexes held, to know what priority to return to, see mutex.h
+    struct mutex *held_mutexes;
 
     func_ptr entry_point; // where to jump after initializing this process
     
@@ -80,11 +85,23 @@ struct process {
         switched_stack_snapshot_t *stack_snapshot;  // pointer to pushed data on the stack
     };
 
-    // for housekeeping, not good if runtimes < 1 msecs...
+    // for housekeeping, in nanoseconds
     uint64_t cpu_ticks_total;
     uint64_t cpu_ticks_last;
 
-    // should mirror where the process is: running_proc variable, ready_list, block_list, terminated_list.
+    // fair scheduling class: run time in usecs, weighted by priority,
+    // and the links of the ready tree, see fairq.h
+    uint64_t vruntime;
+    struct {
+        struct process *left;
+        struct process *right;
+        int height;
+    } fair_node;
+
+    // index of the cpu whose ready queue has it, or where it ran last, see scheduler.c
+    uint8_t cpu;
+
+    // should mirror where the process is: running_proc variable, ready_list, block_list (or sleeping_queue), terminated_list.
     enum process_state state;
 
     // see relevant enums, populated when a process is blocked
@@ -94,6 +111,9 @@ struct process {
     // the msetcs uptime in the future, that we are to be woken up
     uint64_t wake_up_time;
 
+    // position in the heap of sleeping processes, see sleepq.h
+    int sleep_queue_index;
+
     // possibly, the process has an associated tty
     tty_t *tty;
 
@@ -116,6 +136,12 @@ struct process {
     struct {
         char *executable_path;
 
+        // kept open, segments are read from it on first touch
+        file_t *executable;
+
+        // stack, heap and elf segments, see vma.h
+        vma_t *vmas;
+
         char **argv;
         char **envp;
 
@@ -123,8 +149,8 @@ struct process {
         void *heap;           // heap will grow upwards
         uint32_t heap_size;   // to allow sbrk() to work
 
-        // this stack allocated from physical memory
-        // along with the other segments (e.g. .code, .data, .bss)
+        // the stack is allocated from physical memory upfront, the other segments
+        // (e.g. .code, .data, .bss) are populated on demand.
         // stack bottom used to set and detect stack underflow
         void *stack_bottom;
         uint32_t stack_size;
@@ -150,12 +176,16 @@ void start_process(process_t *process);
 process_t *running_process();
 
 // actions that a running task can use
-int proc_fork(); // clone, return child's PID on parent, zero on child
+int proc_fork(void *syscall_frame); // clone, return child's PID on parent, zero on child
 int proc_wait_child(int *exit_code); // returns error or exited PID
 void proc_yield();  // voluntarily give up the CPU to another task
 void proc_sleep(int milliseconds);  // sleep self for some milliseconds
 void proc_block(int reason, void *channel); // blocks task, someone else must unblock it
 void proc_exit(int exit_code);  // terminate self, give exit code
+
+// populates the page if the address belongs to a memory area of the running process.
+// a fault on a present page (writing a read only one) terminates the process.
+bool proc_handle_page_fault(void *address, void *page_dir, bool page_present);
 pid_t proc_getpid(); // get pid of current process
 pid_t proc_getppid(); // get parent pid of running process
 
@@ -177,9 +207,13 @@ int proc_rewinddir(process_t *proc, int handle);
 int proc_readdir(process_t *proc, int handle, dirent_t *entry);
 int proc_closedir(process_t *proc, int handle);
 
+// maps anonymous memory or a file, read only, in the process address space. returns address or error
+int proc_mmap(process_t *proc, uint32_t length, int prot, int flags, int handle, uint32_t offset);
+int proc_munmap(process_t *proc, void *address, uint32_t length);
+
 // this is how someone can unblock a different process
 void unblock_process(process_t *proc);
-void unblock_process_that(enum block_reasons block_reason, void *block_channel);
+bool unblock_process_that(enum block_reasons block_reason, void *block_channel); // false if none was waiting
 
 // utility tools
 void dump_process_table();
@@ -0,0 +1,25 @@
+#ifndef _RWLOCK_H
+#define _RWLOCK_H
+
+#include <ctypes.h>
+
+
+// many readers, or one writer. all zeros is an unlocked rwlock, so it can be static.
+// waiting writers keep new readers out, so that they are not starved.
+// the releasing process hands the lock over, woken up processes already hold it.
+typedef struct rwlock {
+    int readers;
+    bool writer;
+    int waiting_readers;
+    int waiting_writers;
+} rwlock_t;
+
+
+void acquire_rwlock_read(rwlock_t *rw);
+void release_rwlock_read(rwlock_t *rw);
+
+void acquire_rwlock_write(rwlock_t *rw);
+void release_rwlock_write(rwlock_t *rw);
+
+
+#endif
@@ -3,6 +3,9 @@
 
 #include <multitask/process.h>
 #include <multitask/proclist.h>
+#include <multitask/sleepq.h>
+#include <multitask/fairq.h>
+#include <smp.h>
 
 // 0=highest priority, 1,2... lower priorities. 
 #define PROCESS_PRIORITY_LEVELS   8
@@ -10,37 +13,104 @@
 // how many msecs to allow each process. Something between 5 and 100
 #define DEFAULT_TASK_TIMESLICE_MSECS   30
 
+// user program priorities form a fair scheduling class, instead of round robin:
+// the ready process that has run the least (in time weighted by priority) goes first.
+// waking processes get a small head start, which keeps interactive ones responsive.
+// comment out to go back to round robin for all priorities.
+#define FAIR_SCHEDULING
+#define FAIR_PRIORITY_FIRST            (PRIORITY_USER_PROGRAM - 1)
+#define FAIR_PRIORITY_LAST             (PRIORITY_IDLE_TASK - 1)
+#define FAIR_NICE_0_WEIGHT             1024   // weight of PRIORITY_USER_PROGRAM, doubles per level up
+#define FAIR_SCHED_LATENCY_MSECS       DEFAULT_TASK_TIMESLICE_MSECS  // all ready ones run within this
+#define FAIR_MIN_TIMESLICE_MSECS       5
+#define FAIR_WAKEUP_GRANULARITY_USECS  2000
 
-// the current running process
-extern volatile process_t *running_proc;
 
-// ready lists, one per priority 0=high, 3,4,5=lower
-extern proc_list_t ready_lists[PROCESS_PRIORITY_LEVELS];
+// the process running on this cpu, one instruction reads it, see smp_running_process()
+#define running_proc   ((volatile process_t *)smp_running_process())
 
-// list of blocked processes, see block_reason and channel
-extern proc_list_t blocked_list;
+// processes waiting for a cpu, one queue per cpu. a process goes back to the cpu
+// it ran on last, unless another one is idle, and idle cpus steal from busy ones.
+typedef struct ready_queue {
+    // ready lists, one per priority 0=high, 3,4,5=lower
+    proc_list_t lists[PROCESS_PRIORITY_LEVELS];
+
+    // bit N is set when ready list N is not empty
+    uint32_t priorities_bitmap;
+
+    // number of processes in each ready list, and in all of them
+    int counts[PROCESS_PRIORITY_LEVELS];
+    int total;
+
+    // ready processes of the fair class, they use the bit and count of FAIR_PRIORITY_FIRST
+    fair_queue_t fair_queue;
+} ready_queue_t;
+
+extern ready_queue_t ready_queues[MAX_CPUS];
+
+// blocked processes, hashed by block channel, so that waking up the processes
+// waiting on something only looks at a few. each list is in blocking order (FIFO).
+#define BLOCKED_LIST_BUCKETS   32
+extern proc_list_t blocked_lists[BLOCKED_LIST_BUCKETS];
+
+// the blocked list for processes waiting on the channel
+proc_list_t *blocked_list_for(void *channel);
+
+// sleeping processes are blocked too, but kept apart, ordered by wake up time
+extern sleep_queue_t sleeping_queue;
 
 // terminated processes, to be removed by the idle task later
 extern proc_list_t terminated_list;
 
-// the next time that timeshare will expire. 
-// allows for faster checking in the timer irq handler
-extern uint64_t next_switching_time;
-
 // the next time that a sleeping task needs to be awaken
 // allows for faster checking in the timer irq handler
 extern uint64_t next_wake_up_time;
 
 
 
-// use this pair to lock/unlock scheduler
+// use this pair to lock/unlock scheduler.
+// it is pushcli(), so it keeps the other cpus out too, see cpu.c
 void lock_scheduler();
 void unlock_scheduler();
 
+// new processes start with the scheduler locked by whoever switched to them,
+// this unlocks it for them, as if they had called lock_scheduler() themselves
+void unlock_scheduler_in_new_process();
+
 // caller is responsible to always lock/unlock scheduler,
 // before calling schedule()
 void schedule();
 
+// put a process on the ready list of its priority, keeping the bitmap and counts in sync.
+// prepending lets unblocked processes run before others of the same priority.
+// it picks the cpu, and wakes that one up if it should preempt what runs there.
+void ready_list_append(process_t *proc);
+void ready_list_prepend(process_t *proc);
+
+// remove a ready process, wherever it is kept
+void ready_list_remove(process_t *proc);
+
+// changes the priority a process runs at, moving it if ready. caller locks the scheduler
+void scheduler_set_priority(process_t *proc, uint8_t priority);
+
+// whether a process just made ready should take this cpu from the running one.
+// false for processes queued on other cpus, appending them woke those up.
+bool ready_process_should_preempt(process_t *proc);
+
+// whether this cpu has ready processes, or can steal one from a busy cpu
+bool ready_process_available();
+
+// true when no cpu runs anything but its idle process, and none are ready
+bool all_cpus_idle();
+
+bool is_fair_priority(uint8_t priority);
+
+// calls the function for every ready process, in both lists and the fair tree, of all cpus
+void ready_processes_walk(void (*func)(process_t *proc, void *data), void *data);
+
+// calls the function for the process running on each cpu, idle ones included
+void running_processes_walk(void (*func)(process_t *proc, void *data), void *data);
+
 
 
 #endif
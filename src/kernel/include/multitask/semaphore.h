@@ -15,17 +15,7 @@ void release_semaphore(semaphore_t *semaphore);
 
 
 
-// mutex is same as semaphore, but only one process can hold it
-typedef struct semaphore mutex_t;
-
-// allocates, initializes and returns a mutex - remember to free() when done
-mutex_t *create_mutex();
-
-// blocks until mutex acquired
-void acquire_mutex(mutex_t *mutex);
-
-// releases mutex 
-void release_mutex(mutex_t *mutex);
+// for mutual exclusion, see mutex.h, it knows its owner and lends it priority
 
 
 
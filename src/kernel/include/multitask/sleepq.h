@@ -0,0 +1,31 @@
+#ifndef _SLEEPQ_H
+#define _SLEEPQ_H
+
+#include <multitask/process.h>
+
+
+// sleeping processes, kept in a binary min-heap ordered by wake up time.
+// the earliest to wake up is always at the top.
+struct sleep_queue {
+    process_t **heap;
+    int count;
+    int capacity;
+};
+typedef struct sleep_queue sleep_queue_t;
+
+
+// add a sleeping process, by its wake_up_time. O(log n)
+void sleepq_insert(sleep_queue_t *queue, process_t *proc);
+
+// the process to wake up first, or NULL. O(1)
+process_t *sleepq_peek(sleep_queue_t *queue);
+
+// extract the process to wake up first, or NULL. O(log n)
+process_t *sleepq_pop(sleep_queue_t *queue);
+
+// remove a process woken up before its time. O(log n)
+void sleepq_remove(sleep_queue_t *queue, process_t *proc);
+
+
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef _SMP_H
+#define _SMP_H
+
+#include <ctypes.h>
+#include <gdt.h>
+
+#define MAX_CPUS   8
+
+// application processors start in real mode from this page, below 1 MB.
+// it must match smp_low.asm, the physical memory manager keeps it reserved.
+#define SMP_TRAMPOLINE_ADDRESS   0x8000
+
+// local APIC interrupts, above the PIC ones and below the syscall
+#define LAPIC_TIMER_VECTOR       0x40   // each application processor's timeslice tick
+#define RESCHEDULE_VECTOR        0x41   // another cpu queued work for an idle one
+
+struct process;
+
+// one per processor found in the ACPI MADT table, the bootstrap one is always first
+typedef struct cpu {
+    struct cpu *self;        // must be first, read through GS, see smp_this_cpu()
+    int index;
+    uint8_t apic_id;
+    bool bootstrap;          // the one that booted us, it gets the PIC interrupts
+    volatile bool online;    // application processors set it, once in protected mode
+    void *kernel_stack;      // allocated for application processors
+
+    // own descriptor table and task state segment, see gdt.c
+    uint64_t gdt[GDT_ENTRIES];
+    tss_t tss;
+
+    // pushcli() nesting on this cpu, see cpu.c
+    int cli_depth;
+    bool zero_depth_enabled;
+
+    // what runs here, see scheduler.c for the ready queues
+    struct process *volatile current_proc;
+    struct process *idle_proc;
+    volatile int switching_postpone_depth;
+    volatile bool task_switching_pending;
+    uint64_t next_switching_time;
+} cpu_t;
+
+
+// finds the processors and starts the application ones.
+// to be called with interrupts enabled, as we wait for them with the timer.
+void init_smp();
+
+// number of processors found, and how many of them are running
+int smp_cpus_count();
+int smp_cpus_online();
+
+// valid before init_smp(), the GDT is loaded for it first
+cpu_t *smp_bootstrap_cpu();
+
+cpu_t *smp_get_cpu(int index);
+
+// the processor executing this. callers that may be preempted must not keep it,
+// the process may continue on another cpu, see smp_this_cpu_index() for sampling
+static inline cpu_t *smp_this_cpu() {
+    cpu_t *cpu;
+    __asm__ __volatile__("mov %%gs:0, %0" : "=r"(cpu));
+    return cpu;
+}
+
+// one instruction, so it is right at the moment it runs, even if preemptible
+static inline int smp_this_cpu_index() {
+    int index;
+    __asm__ __volatile__("mov %%gs:%c1, %0" : "=r"(index) : "i"(offsetof(cpu_t, index)));
+    return index;
+}
+
+// the running process is the one executing this, whichever cpu that is right now
+static inline struct process *smp_running_process() {
+    struct process *proc;
+    __asm__ __volatile__("mov %%gs:%c1, %0" : "=r"(proc) : "i"(offsetof(cpu_t, current_proc)));
+    return proc;
+}
+
+// asks an idle cpu to look at its ready queue, or to steal work
+void smp_send_reschedule(cpu_t *cpu);
+
+// end of a local APIC interrupt, they do not go through the PIC
+void smp_lapic_eoi();
+
+
+#endif
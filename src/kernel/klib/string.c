@@ -216,16 +216,15 @@ char *strstr(char *haystack, char *needle) {
 }
 
 
-// first call str has to have a string, subsequent calls must pass NULL
-char *strtok(char *str, char *delimiters) {
+// as strtok(), the caller keeps where to continue, for concurrent tokenizing
+char *strtok_r(char *str, char *delimiters, char **next) {
     // printf("strtok(\"%s\", \"%s\")\n", str, delimiters);
-    static char *next = NULL;
 
     // if NULL is passed, remember last tokenized pointer
     if (str == NULL) {
-        if (next == NULL) // user has not called us with valid string yet
+        if (*next == NULL) // user has not called us with valid string yet
             return NULL;
-        str = next;
+        str = *next;
         // printf("strtok(): Continuing at... [%s]\n", str);
     }
 
@@ -246,19 +245,25 @@ char *strtok(char *str, char *delimiters) {
     char *end = str;
     while (true) {
         if (*end == '\0') {
-            next = NULL;
+            *next = NULL;
             return str;
         } else if (strchr(delimiters, *end) != NULL) {
             // we found a delimiter
             // printf("strtok(): Found delimiter [%c]\n", *end);
             *end = '\0';
-            next = end + 1; // save for later
+            *next = end + 1; // save for later
             return str;
         }
         end++;
     }
 }
 
+// first call str has to have a string, subsequent calls must pass NULL
+char *strtok(char *str, char *delimiters) {
+    static char *next = NULL;
+    return strtok_r(str, delimiters, &next);
+}
+
 int atoi(char *str) {
     while (*str == ' ')
         str++;
@@ -30,6 +30,7 @@
 #include <filesys/drivers.h>
 #include <filesys/mount.h>
 #include <monitor.h>
+#include <smp.h>
 
 // Check if the compiler thinks you are targeting the wrong operating system.
 #if defined(__linux__)
@@ -68,6 +69,7 @@ multiboot_info_t saved_multiboot_info;
 
 void launch_initial_processes();
 void shell_launcher();
+void multitasking_tests_runner();
 void print_multiboot_info(multiboot_info_t *info);
 
 
@@ -145,12 +147,15 @@ void kernel_main(multiboot_info_t* mbi, unsigned int boot_magic)
     init_kernel_heap((void *)heap_start, KERNEL_HEAP_SIZE_KB * 1024);
 
     klog_info("Initializing virtual memory mapping...");
-    init_virtual_memory_paging(0, (void *)ramdisk_end);
+    init_virtual_memory_paging(0, get_kernel_reserved_memory_end());
 
     klog_info("Enabling interrupts & NMI...");
     sti();
     enable_nmi();
 
+    klog_info("Starting application processors...");
+    init_smp();
+
     klog_info("Detecting PCI devices...");
     ata_register_pci_driver();
     sata_register_pci_driver();
@@ -177,6 +182,13 @@ void kernel_main(multiboot_info_t* mbi, unsigned int boot_magic)
         for (;;) asm("hlt");
     }
 
+    char *cmdline = (char *)saved_multiboot_info.cmdline;
+    if (cmdline != NULL && strstr(cmdline, "bench") != NULL) {
+        klog_info("Running benchmarks...");
+        extern bool run_frameworked_benchmarks();
+        run_frameworked_benchmarks();
+    }
+
     klog_info("Giving the console to TTY manager...");
     klog_appender_level(LOGAPP_SCREEN, LOGLEV_NONE);
 
@@ -217,6 +229,17 @@ void launch_initial_processes() {
 
     proc = create_process("VFS Monitor", vfs_monitor_main, pri, 0, tty_manager_get_device(tty++));
     start_process(proc);
+
+    proc = create_process("Tests", multitasking_tests_runner, PRIORITY_KERNEL, 0, NULL);
+    start_process(proc);
+}
+
+// some tests need other processes to run and block, so they cannot run in main()
+void multitasking_tests_runner() {
+    extern bool run_frameworked_multitasking_tests();
+    if (!run_frameworked_multitasking_tests())
+        klog_error("Multitasking tests failed");
+    proc_exit(0);
 }
 
 void shell_launcher() {
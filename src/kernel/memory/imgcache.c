@@ -0,0 +1,149 @@
+#include <klog.h>
+#include <cpu.h>
+#include <memory/kheap.h>
+#include <memory/physmem.h>
+#include <memory/imgcache.h>
+
+MODULE("IMGC");
+
+// least recently used images are dropped, when the cache holds more pages than this
+#define IMGCACHE_MAX_PAGES   1024
+
+
+struct cached_page {
+    struct cached_page *next;
+    void *page_address;
+    void *physical_page;
+};
+
+struct cached_image {
+    struct cached_image *next;
+    superblock_t *superblock;
+    uint32_t location;
+    uint32_t mtime;
+    uint32_t size;
+    uint32_t pages_count;
+    struct cached_page *pages;
+};
+
+// most recently used first
+static struct cached_image *images = NULL;
+static uint32_t total_pages = 0;
+static uint32_t hits = 0;
+static uint32_t misses = 0;
+
+
+static void drop_image(struct cached_image **pp) {
+    struct cached_image *image = *pp;
+    *pp = image->next;
+
+    // pages still mapped by processes are freed when they exit
+    while (image->pages != NULL) {
+        struct cached_page *page = image->pages;
+        image->pages = page->next;
+        physical_page_release(page->physical_page);
+        kfree(page);
+    }
+    total_pages -= image->pages_count;
+    kfree(image);
+}
+
+// finds the image of the file, moving it to the front. images of older versions are dropped.
+static struct cached_image *find_image(file_t *file, bool create) {
+    file_descriptor_t *fd = file->descriptor;
+    struct cached_image **pp = &images;
+
+    while (*pp != NULL) {
+        struct cached_image *image = *pp;
+        if (image->superblock != file->superblock || image->location != fd->location) {
+            pp = &image->next;
+            continue;
+        }
+        if (image->mtime != fd->mtime || image->size != fd->size) {
+            klog_debug("Executable at location %u was modified, dropping its cached image", fd->location);
+            drop_image(pp);
+            break;
+        }
+        *pp = image->next;
+        image->next = images;
+        images = image;
+        return image;
+    }
+
+    if (!create)
+        return NULL;
+
+    struct cached_image *image = kmalloc(sizeof(struct cached_image));
+    image->superblock = file->superblock;
+    image->location = fd->location;
+    image->mtime = fd->mtime;
+    image->size = fd->size;
+    image->pages_count = 0;
+    image->pages = NULL;
+    image->next = images;
+    images = image;
+    return image;
+}
+
+void *imgcache_get_page(file_t *file, void *page_address) {
+    void *physical_page = NULL;
+    pushcli();
+
+    struct cached_image *image = find_image(file, false);
+    if (image != NULL) {
+        for (struct cached_page *page = image->pages; page != NULL; page = page->next) {
+            if (page->page_address == page_address) {
+                physical_page = page->physical_page;
+                physical_page_add_ref(physical_page);
+                break;
+            }
+        }
+    }
+    if (physical_page != NULL)
+        hits++;
+    else
+        misses++;
+
+    popcli();
+    return physical_page;
+}
+
+void imgcache_put_page(file_t *file, void *page_address, void *physical_page) {
+    pushcli();
+    struct cached_image *image = find_image(file, true);
+
+    // another process may have loaded the same page meanwhile
+    for (struct cached_page *page = image->pages; page != NULL; page = page->next) {
+        if (page->page_address == page_address) {
+            popcli();
+            return;
+        }
+    }
+
+    struct cached_page *page = kmalloc(sizeof(struct cached_page));
+    page->page_address = page_address;
+    page->physical_page = physical_page;
+    page->next = image->pages;
+    image->pages = page;
+    image->pages_count++;
+    total_pages++;
+    physical_page_add_ref(physical_page);
+
+    // the image just used is first, drop from the end
+    while (total_pages > IMGCACHE_MAX_PAGES && images->next != NULL) {
+        struct cached_image **pp = &images;
+        while ((*pp)->next != NULL)
+            pp = &(*pp)->next;
+        drop_image(pp);
+    }
+
+    popcli();
+}
+
+void imgcache_dump() {
+    klog_debug("Executable image cache: %u pages, %u hits, %u misses", total_pages, hits, misses);
+    for (struct cached_image *image = images; image != NULL; image = image->next) {
+        klog_debug("  location %u, size %u, mtime %u, %u pages",
+            image->location, image->size, image->mtime, image->pages_count);
+    }
+}
@@ -1,10 +1,25 @@
 #include <drivers/screen.h>
 #include <klib/string.h>
 #include <klog.h>
+#include <bits.h>
 #include <memory/physmem.h>
+#include <memory/virtmem.h>
 #include <memory/kheap.h>
+#include <cpu.h>
+#include <smp.h>
 
 #define KMEM_MAGIC       0xAAA // something that fits in 12 bits
+#define KMEM_POISON      0xDD  // freed memory is filled with this, in debug builds
+
+// free blocks are also kept in segregated lists, one per power-of-two size class,
+// class 0 holds sizes 8..15, class 1 holds 16..31 etc.
+#define SIZE_CLASSES         29
+#define MIN_CLASS_SHIFT      3
+
+// when out of memory, the heap grows into the kernel heap area by at least this much,
+// and gives back pages at its end, when at least this much is free there.
+#define HEAP_GROWTH_MIN_SIZE  (1024 * 1024)
+#define HEAP_SHRINK_MIN_SIZE  (1024 * 1024)
 
 MODULE("KHEAP");
 
@@ -30,18 +45,41 @@ struct memory_block {
 } __attribute__((packed));
 typedef struct memory_block memory_block_t;
 
+// a free block keeps its size class list links in its (unused) memory area,
+// therefore no allocation can be smaller than this structure
+struct free_links {
+    struct memory_block *next_free;
+    struct memory_block *prev_free;
+};
+#define MIN_ALLOCATION_SIZE   sizeof(struct free_links)
+#define FREE_LINKS(block)     ((struct free_links *)((char *)(block) + sizeof(memory_block_t)))
+
+// the initial region is given at init, the growth region is mapped on demand.
+// the tail block of the initial region links to the first block of the growth region
 struct memory_heap {
     void *start_address;
     void *end_address;
+    void *growth_start;
+    void *growth_end;
     uint32_t available_memory; // remaining actual memory, leaves out allocated and blocks
     memory_block_t *list_head;
     memory_block_t *list_tail;
+    memory_block_t *free_lists[SIZE_CLASSES];
+    uint32_t non_empty_classes; // bit N set means free_lists[N] has blocks
 };
 typedef struct memory_heap memory_heap_t;
 
 memory_heap_t kernel_heap;
 
 static bool __check_block(memory_block_t *block);
+static int size_class(uint32_t size);
+static void add_to_free_list(memory_block_t *block);
+static void remove_from_free_list(memory_block_t *block);
+static memory_block_t *find_free_block(size_t size);
+static memory_block_t *release_block(memory_block_t *block);
+static bool grow_heap(size_t size);
+static void shrink_heap(memory_block_t *last_block);
+static bool address_in_heap(void *address);
 
 
 void init_kernel_heap(void *heap_start, size_t heap_size) {
@@ -68,6 +106,12 @@ void init_kernel_heap(void *heap_start, size_t heap_size) {
 
     kernel_heap.list_head = head;
     kernel_heap.list_tail = tail;
+    kernel_heap.growth_start = (void *)KERNEL_HEAP_AREA_START;
+    kernel_heap.growth_end = (void *)KERNEL_HEAP_AREA_START;
+
+    memset(kernel_heap.free_lists, 0, sizeof(kernel_heap.free_lists));
+    kernel_heap.non_empty_classes = 0;
+    add_to_free_list(head);
 
     klog_debug("Kernel heap initialized in range 0x%x - 0x%x, %u KB available",
         kernel_heap.start_address,
@@ -77,29 +121,28 @@ void init_kernel_heap(void *heap_start, size_t heap_size) {
 }
 
 // allocate a chunk of memory from kernel heap
-void *__kmalloc(size_t size, char *explanation, char *file, uint16_t line) {
-    // size = size < 256 ? 256 : size;
+void *__kmalloc(size_t size, int flags, char *explanation, char *file, uint16_t line) {
+    // free blocks must be able to hold the free list links
+    if (size < MIN_ALLOCATION_SIZE)
+        size = MIN_ALLOCATION_SIZE;
     
-    // find the first free block that is equal or larger than size
-    memory_block_t *curr = kernel_heap.list_head;
-    while (curr != NULL) {
-        // look for a free block that is either the exact size, or big enough to split.
-        if ((curr->used == false) &&
-            (curr->size == size || curr->size > size + sizeof(memory_block_t)))
-            break;
-        curr = curr->next;
-    }
+    // the lists are shared by all processes and cpus, pushcli() keeps them out
+    pushcli();
+    memory_block_t *curr = find_free_block(size);
+    if (curr == NULL && grow_heap(size))
+        curr = find_free_block(size);
     if (curr == NULL) {
         klog_warn("kmalloc(%u) -> Could not find a free block, returning null", size);
         panic("malloc failed. what now?");
         return NULL;
     }
+    remove_from_free_list(curr);
 
     if (curr->size == size) {
         // no need to split, just reuse this as is.
         // happens often, as the same structure types may be requested in a loop
-    } else if (curr->size > size + sizeof(memory_block_t)) {
-        // big enough to split into two
+    } else if (curr->size >= size + sizeof(memory_block_t) + MIN_ALLOCATION_SIZE) {
+        // big enough to split into two, the remainder must fit the free list links
         // keep the memory we need, create a new memory block
         // sequence of operations (pointers etc) is important
         memory_block_t *new_free = (memory_block_t *)((char *)curr + sizeof(memory_block_t) + size);
@@ -122,7 +165,9 @@ void *__kmalloc(size_t size, char *explanation, char *file, uint16_t line) {
         curr->next = new_free;
         if (next != NULL)
             next->prev = new_free;
+        add_to_free_list(new_free);
     }
+    // otherwise the block is too small to split, give it all away
 
     // in any case do the following:
     #ifdef DEBUG_HEAP_OPS
@@ -133,8 +178,12 @@ void *__kmalloc(size_t size, char *explanation, char *file, uint16_t line) {
     #endif
     curr->used = 1;
     kernel_heap.available_memory -= curr->size; // we should take memory_block size into account 
+    popcli();
+
     char *ptr = (char *)curr + sizeof(memory_block_t);
-    memset(ptr, 0, curr->size); // contrary to traditional unix, we clear our memory
+    // contrary to traditional unix, we clear our memory, unless told not to
+    if (flags & KMALLOC_ZERO)
+        memset(ptr, 0, curr->size);
 
     klog_trace("kmalloc(%u = %s) -> 0x%p, at %s:%d", size, explanation, ptr, file, line);
     return ptr;
@@ -147,9 +196,10 @@ void __kcheck(void *ptr, char *name, char *file, int line) {
     memory_block_t *block = (memory_block_t *)(ptr - sizeof(memory_block_t));
     bool healthy = false;
 
-    if (ptr < kernel_heap.start_address || ptr > kernel_heap.end_address) {
-        klog_crit("- ptr 0x%p (%s): pointer is not managed by kernel heap (heap is 0x%x..0x%x)", 
-            ptr, name, kernel_heap.start_address, kernel_heap.end_address);
+    if (!address_in_heap(ptr)) {
+        klog_crit("- ptr 0x%p (%s): pointer is not managed by kernel heap (heap is 0x%x..0x%x and 0x%x..0x%x)", 
+            ptr, name, kernel_heap.start_address, kernel_heap.end_address,
+            kernel_heap.growth_start, kernel_heap.growth_end);
         healthy = false;
     } else {
         // these checks only make sense if we deal with our allocated pointers
@@ -170,6 +220,22 @@ void kfree(void *ptr) {
     klog_trace("kfree(0x%p)", ptr);
 
     memory_block_t *block = (memory_block_t *)(ptr - sizeof(memory_block_t));
+
+    #ifdef DEBUG_HEAP_POISON
+        // poison memory to cause errors if app still refers to it.
+        memset((char *)block + sizeof(memory_block_t), KMEM_POISON, block->size);
+    #endif
+
+    pushcli();
+    block = release_block(block);
+
+    if (block->next == kernel_heap.list_tail && (void *)block >= kernel_heap.growth_start)
+        shrink_heap(block);
+    popcli();
+}
+
+// marks a block as free, merges it with free neighbors, returns the resulting free block
+static memory_block_t *release_block(memory_block_t *block) {
     memory_block_t *next = block->next;
     memory_block_t *prev = block->prev;
     
@@ -182,9 +248,6 @@ void kfree(void *ptr) {
         block->size_explanation = NULL;
     #endif
 
-    // clean up memory to cause errors if app still refers to it.
-    memset((char *)block + sizeof(memory_block_t), 0, block->size);
-
     // Initial state
     // [ mbt ] ----next---> [ mbt ] ----next---> [ mbt ] ----next---> [ mbt ]
     // [ mbt ] <---prev---- [ mbt ] <---prev---- [ mbt ] <---prev---- [ mbt ]
@@ -205,6 +268,7 @@ void kfree(void *ptr) {
 
     // see if consolidatable with next (if so, remove next block, keep this)
     if (next != NULL && !next->used) {
+        remove_from_free_list(next);
         block->next = next->next;
         if (next->next != NULL)
             next->next->prev = block;
@@ -212,17 +276,194 @@ void kfree(void *ptr) {
         kernel_heap.available_memory += sizeof(memory_block_t);
     }
     if (prev != NULL && !prev->used) {
+        remove_from_free_list(prev);
         prev->next = block->next;
         if (block->next != NULL)
             block->next->prev = prev;
         prev->size += sizeof(memory_block_t) + block->size;
         kernel_heap.available_memory += sizeof(memory_block_t);
+        block = prev;
     }
+
+    // the size may have changed, so the class too
+    add_to_free_list(block);
+    return block;
+}
+
+static void init_sentinel_block(memory_block_t *block, memory_block_t *prev) {
+    block->used = 1; // marked used to avoid consolidation
+    block->size = 0;
+    block->magic1 = KMEM_MAGIC;
+    block->magic2 = KMEM_MAGIC;
+    block->prev = prev;
+    block->next = NULL;
+    #ifdef DEBUG_HEAP_OPS
+        block->size_explanation = NULL;
+        block->file = NULL;
+        block->ff_indicator = 0;
+        block->line = 0;
+    #endif
+}
+
+// maps more pages at the end of the growth region, enough for the size requested
+static bool grow_heap(size_t size) {
+    if (get_kernel_page_directory() == NULL)
+        return false; // no paging yet
+
+    uint32_t bytes = ROUND_UP_4K(size + 2 * sizeof(memory_block_t));
+    if (bytes < HEAP_GROWTH_MIN_SIZE)
+        bytes = HEAP_GROWTH_MIN_SIZE;
+    uint32_t area_end = KERNEL_HEAP_AREA_START + KERNEL_HEAP_AREA_SIZE;
+    if ((uint32_t)kernel_heap.growth_end + bytes > area_end) {
+        bytes = area_end - (uint32_t)kernel_heap.growth_end;
+        if (bytes < size + 2 * sizeof(memory_block_t))
+            return false;
+    }
+    klog_debug("Growing kernel heap by %u KB, at 0x%p", bytes / 1024, kernel_heap.growth_end);
+
+    map_kernel_heap_area_pages(kernel_heap.growth_end, bytes / 4096);
+
+    memory_block_t *block;
+    if (kernel_heap.growth_end == kernel_heap.growth_start) {
+        // first block of the growth region, follows the tail of the initial region
+        block = (memory_block_t *)kernel_heap.growth_start;
+        init_sentinel_block(block, kernel_heap.list_tail);
+        kernel_heap.list_tail->next = block;
+        block->size = bytes - 2 * sizeof(memory_block_t);
+    } else {
+        // the old tail becomes the header of the new space
+        block = kernel_heap.list_tail;
+        block->size = bytes - sizeof(memory_block_t);
+    }
+    kernel_heap.growth_end += bytes;
+
+    memory_block_t *tail = (memory_block_t *)(kernel_heap.growth_end - sizeof(memory_block_t));
+    init_sentinel_block(tail, block);
+    block->next = tail;
+    kernel_heap.list_tail = tail;
+
+    // block is marked used, freeing it will merge it with any free block before it
+    release_block(block);
+    return true;
+}
+
+// gives back the pages of the free block at the end of the growth region
+static void shrink_heap(memory_block_t *last_block) {
+    void *payload = (void *)last_block + sizeof(memory_block_t);
+
+    // other cpus may still have the pages in their TLBs, and there is no shootdown yet.
+    // if the pages were mapped again, they could keep writing to the old ones.
+    if (smp_cpus_online() > 1)
+        return;
+
+    if ((void *)last_block == kernel_heap.growth_start) {
+        // the whole growth region is free
+        uint32_t bytes = kernel_heap.growth_end - kernel_heap.growth_start;
+        if (bytes < HEAP_SHRINK_MIN_SIZE)
+            return;
+        remove_from_free_list(last_block);
+        kernel_heap.available_memory -= last_block->size;
+        kernel_heap.list_tail = last_block->prev;
+        kernel_heap.list_tail->next = NULL;
+        unmap_kernel_heap_area_pages(kernel_heap.growth_start, bytes / 4096);
+        kernel_heap.growth_end = kernel_heap.growth_start;
+        klog_debug("Kernel heap shrunk by %u KB, growth region released", bytes / 1024);
+        return;
+    }
+
+    // keep the block with a minimum size, followed by the new tail
+    void *keep_end = (void *)ROUND_UP_4K((uint32_t)payload + MIN_ALLOCATION_SIZE + sizeof(memory_block_t));
+    uint32_t bytes = kernel_heap.growth_end - keep_end;
+    if (keep_end >= kernel_heap.growth_end || bytes < HEAP_SHRINK_MIN_SIZE)
+        return;
+
+    remove_from_free_list(last_block);
+    kernel_heap.available_memory -= last_block->size;
+
+    memory_block_t *tail = (memory_block_t *)(keep_end - sizeof(memory_block_t));
+    init_sentinel_block(tail, last_block);
+    last_block->next = tail;
+    last_block->size = (void *)tail - payload;
+    kernel_heap.list_tail = tail;
+
+    kernel_heap.available_memory += last_block->size;
+    add_to_free_list(last_block);
+
+    unmap_kernel_heap_area_pages(keep_end, bytes / 4096);
+    kernel_heap.growth_end = keep_end;
+    klog_debug("Kernel heap shrunk by %u KB", bytes / 1024);
+}
+
+static bool address_in_heap(void *address) {
+    return (address >= kernel_heap.start_address && address <= kernel_heap.end_address) ||
+        (address >= kernel_heap.growth_start && address < kernel_heap.growth_end);
+}
+
+// class index is the position of the highest bit of the size
+static int size_class(uint32_t size) {
+    int cls = (31 - __builtin_clz(size)) - MIN_CLASS_SHIFT;
+    if (cls < 0)
+        cls = 0;
+    if (cls >= SIZE_CLASSES)
+        cls = SIZE_CLASSES - 1;
+    return cls;
+}
+
+static void add_to_free_list(memory_block_t *block) {
+    int cls = size_class(block->size);
+    struct free_links *links = FREE_LINKS(block);
+
+    links->prev_free = NULL;
+    links->next_free = kernel_heap.free_lists[cls];
+    if (links->next_free != NULL)
+        FREE_LINKS(links->next_free)->prev_free = block;
+    kernel_heap.free_lists[cls] = block;
+    kernel_heap.non_empty_classes |= (1u << cls);
+}
+
+static void remove_from_free_list(memory_block_t *block) {
+    int cls = size_class(block->size);
+    struct free_links *links = FREE_LINKS(block);
+
+    if (links->prev_free != NULL)
+        FREE_LINKS(links->prev_free)->next_free = links->next_free;
+    else
+        kernel_heap.free_lists[cls] = links->next_free;
+    if (links->next_free != NULL)
+        FREE_LINKS(links->next_free)->prev_free = links->prev_free;
+
+    links->next_free = NULL;
+    links->prev_free = NULL;
+    if (kernel_heap.free_lists[cls] == NULL)
+        kernel_heap.non_empty_classes &= ~(1u << cls);
+}
+
+// finds a free block that is either the exact size, or big enough to split.
+static memory_block_t *find_free_block(size_t size) {
+    int cls = size_class(size);
+
+    // the size's own class may hold smaller blocks, walk it first-fit
+    memory_block_t *block = kernel_heap.free_lists[cls];
+    while (block != NULL) {
+        if (block->size == size || block->size >= size + sizeof(memory_block_t) + MIN_ALLOCATION_SIZE)
+            return block;
+        block = FREE_LINKS(block)->next_free;
+    }
+
+    // any block of a larger class is large enough, take the first non empty class
+    if (cls + 1 >= SIZE_CLASSES)
+        return NULL;
+    uint32_t larger_classes = kernel_heap.non_empty_classes & ~((1u << (cls + 1)) - 1);
+    if (larger_classes == 0)
+        return NULL;
+
+    return kernel_heap.free_lists[__builtin_ctz(larger_classes)];
 }
 
 // returns the amount of memory the heap is managing
 uint32_t kernel_heap_total_size() {
-    return (kernel_heap.end_address - kernel_heap.start_address);
+    return (kernel_heap.end_address - kernel_heap.start_address) +
+        (kernel_heap.growth_end - kernel_heap.growth_start);
 }
 
 // returns the remaining memory size that can be allocated
@@ -275,19 +516,29 @@ void kernel_heap_dump() {
     used_mem /= 1024;
     int utilization = (used_mem * 100) / (free_mem + used_mem);
 
-    int percent_free = (kernel_heap.available_memory * 100) / (kernel_heap.end_address - kernel_heap.start_address);
-    klog_debug("Free memory %u KB (%u%%), out of %u KB total",
+    int percent_free = (kernel_heap.available_memory * 100) / kernel_heap_total_size();
+    klog_debug("Free memory %u KB (%u%%), out of %u KB total (%u KB grown)",
         kernel_heap.available_memory / 1024,
         percent_free,
-        (kernel_heap.end_address - kernel_heap.start_address) / 1024
+        kernel_heap_total_size() / 1024,
+        (kernel_heap.growth_end - kernel_heap.growth_start) / 1024
     );
     klog_debug("Total free memory  %u KB (%u blocks)", (uint32_t)free_mem, free_blocks);
     klog_debug("Total used memory  %u KB (%u blocks) - %d%% utilization", (uint32_t)used_mem, used_blocks, utilization);
+
+    for (int cls = 0; cls < SIZE_CLASSES; cls++) {
+        if (kernel_heap.free_lists[cls] == NULL)
+            continue;
+        int count = 0;
+        for (block = kernel_heap.free_lists[cls]; block != NULL; block = FREE_LINKS(block)->next_free)
+            count++;
+        klog_debug("Free list class %d (%u+ bytes): %d blocks", cls, 1u << (cls + MIN_CLASS_SHIFT), count);
+    }
 }
 
 
 static bool __check_block(memory_block_t *block) {
-    uint32_t max_size = (kernel_heap.end_address - kernel_heap.start_address);
+    uint32_t max_size = kernel_heap_total_size();
     bool healthy = true;
     void *ptr = ((void *)block) + sizeof(memory_block_t);
 
@@ -303,22 +554,18 @@ static bool __check_block(memory_block_t *block) {
         klog_error("block for 0x%x bad size (%d, max is %d)", ptr, block->size, max_size);
         healthy = false;
     }
-    if (block->prev != NULL && (
-        (void *)block->prev < kernel_heap.start_address ||
-        (void *)block->prev > kernel_heap.end_address)) {
+    if (block->prev != NULL && !address_in_heap(block->prev)) {
         klog_error("block for 0x%x prev ptr outside heap boundaries (0x%x)", ptr, block->prev, max_size);
         healthy = false;
     }
-    if (block->next != NULL && (
-        (void *)block->next < kernel_heap.start_address ||
-        (void *)block->next > kernel_heap.end_address)) {
+    if (block->next != NULL && !address_in_heap(block->next)) {
         klog_error("block for 0x%x next ptr outside heap boundaries (0x%x)", ptr, block->next, max_size);
         healthy = false;
     }
 
     #ifdef DEBUG_HEAP_OPS
-        bool is_last_block = block->size == 0 && block->next == NULL;
-        if (block->used && !is_last_block) {
+        bool is_tail_block = block->size == 0;
+        if (block->used && !is_tail_block) {
             if (block->ff_indicator != 0xFFFF) {
                 klog_error("block for 0x%x bad ff indicator (0x%x)", ptr, block->ff_indicator);
                 healthy = false;
@@ -352,6 +599,25 @@ void __kernel_heap_verify(char *file, int line) {
         block = block->next;
     }
 
+    // every block in the free lists must be free and in the correct class
+    for (int cls = 0; cls < SIZE_CLASSES; cls++) {
+        bool expect_non_empty = (kernel_heap.non_empty_classes & (1u << cls)) != 0;
+        if (expect_non_empty != (kernel_heap.free_lists[cls] != NULL)) {
+            klog_error("free list class %d does not agree with classes bitmap", cls);
+            healthy = false;
+        }
+        block = kernel_heap.free_lists[cls];
+        while (block != NULL) {
+            if (!__check_block(block) || block->used || size_class(block->size) != cls) {
+                klog_error("block 0x%x in free list class %d is not free or has wrong size (%u)",
+                    block, cls, block->size);
+                healthy = false;
+                break;
+            }
+            block = FREE_LINKS(block)->next_free;
+        }
+    }
+
     if (healthy) {
         klog_debug("kernel heap healthy at %s:%d", file, line);
     } else {
@@ -4,6 +4,8 @@
 #include <klog.h>
 #include <multiboot.h>
 #include <memory/physmem.h>
+#include <memory/virtmem.h>
+#include <smp.h>
 
 MODULE("PMEM");
 
@@ -19,11 +21,60 @@ MODULE("PMEM");
 #define PAGE_SIZE 4096
 #define ONE_MB    0x100000
 #define ONE_GB    0x40000000
+#define min(a, b)   ((a) < (b) ? (a) : (b))
+#define max(a, b)   ((a) > (b) ? (a) : (b))
 uint32_t page_status_bitmaps[32768];
+#define BITMAP_WORDS    ((int)(sizeof(page_status_bitmaps) / sizeof(page_status_bitmaps[0])))
+
+// summary of the bitmap, one bit per bitmap word, set when the word has free pages,
+// and a hint of the lowest page that may be free, to skip the used low memory quickly.
+#define SUMMARY_WORDS   (BITMAP_WORDS / 32)
+static uint32_t free_words_summary[SUMMARY_WORDS];
+static int lowest_free_page_hint;
+
 uint32_t highest_memory_address;
 uint32_t total_free_pages;
 uint32_t total_used_pages;
 
+// a binary buddy allocator serves the memory above 1MB, in blocks of 2^order pages.
+// the first page of each free block is in the free list of the block's order.
+// the bitmap is kept in sync, it still tracks the status of every page,
+// the low memory is served by the bitmap only.
+#define MAX_ORDER          10
+#define NO_PAGE            0xFFFFFFFF
+#define BUDDY_FIRST_PAGE   (ONE_MB / PAGE_SIZE)
+
+// pages reached through their physical address stay below this, as it is identity mapped everywhere
+#define LOW_MEMORY_PAGES   (LOW_MEMORY_IDENTITY_END / PAGE_SIZE)
+
+struct buddy_page {
+    uint32_t next;     // next free block of the same order
+    uint32_t prev;     // previous free block of the same order
+    uint8_t order;     // valid for the first page of a free block
+    uint8_t free_block_head;
+} __attribute__((packed));
+
+static struct buddy_page *buddy_pages; // one entry per physical page, placed after the kernel
+static page_frame_t *page_frames;      // one entry per physical page, after the buddy entries
+static uint32_t buddy_free_lists[MAX_ORDER + 1];
+static uint32_t buddy_free_blocks[MAX_ORDER + 1];
+static uint32_t total_pages;
+
+// pages cleared in the background by the idle task, for mapped pages only.
+// the pool is not refilled when memory runs low, to keep pages available.
+#define ZEROED_POOL_SIZE        64
+#define ZEROED_POOL_MIN_FREE    1024
+static void *zeroed_pool[ZEROED_POOL_SIZE];
+static int zeroed_pool_count;
+static uint32_t zeroed_pool_hits;
+static uint32_t zeroed_pool_misses;
+static void *reserved_end_address;
+
+static void init_buddy_allocator(void *metadata_address);
+static int buddy_allocate_block(int order);
+static void buddy_free_block(uint32_t page_no, int order);
+static bool buddy_take_page(uint32_t page_no);
+
 static void mark_physical_memory_available(void *address, size_t size);
 static void mark_physical_memory_unavailable(void *address, size_t size);
 static bool page_is_used(int page_no);
@@ -45,6 +96,8 @@ int physical_page_size() {
 void init_physical_memory_manager(multiboot_info_t *info, void *kernel_start_address, void *kernel_end_address) {
     // mark all of it as used, will open up the available physical_memory_upper_limit
     memset((char *)page_status_bitmaps, 0xFF, sizeof(page_status_bitmaps));
+    memset((char *)free_words_summary, 0, sizeof(free_words_summary));
+    lowest_free_page_hint = 0;
     highest_memory_address = 0;
     total_free_pages = 0;
     total_used_pages = 0;
@@ -81,9 +134,186 @@ void init_physical_memory_manager(multiboot_info_t *info, void *kernel_start_add
     // the very first page is unusable, to allow NULL pointers to be invalid
     mark_page_used(0); 
 
+    // application processors start from here, see smp.c
+    mark_physical_memory_unavailable((void *)SMP_TRAMPOLINE_ADDRESS, PAGE_SIZE);
+
     // also, exclude the pages where the kernel is loaded
     size_t kernel_size = (size_t)kernel_end_address - (size_t)kernel_start_address;
     mark_physical_memory_unavailable((void *)kernel_start_address, kernel_size);
+
+    // buddy metadata goes right after the kernel, to be identity mapped along with it
+    init_buddy_allocator((void *)round_up_4k((uint32_t)kernel_end_address));
+}
+
+// end of the memory reserved for the kernel and the memory manager structures
+void *get_kernel_reserved_memory_end() {
+    return reserved_end_address;
+}
+
+static void init_buddy_allocator(void *metadata_address) {
+    total_pages = round_up_4k(highest_memory_address) / PAGE_SIZE;
+    if (total_pages == 0 || total_pages > sizeof(page_status_bitmaps) * 8)
+        total_pages = sizeof(page_status_bitmaps) * 8;
+    size_t buddy_size = total_pages * sizeof(struct buddy_page);
+    size_t metadata_size = round_up_4k(buddy_size + total_pages * sizeof(page_frame_t));
+
+    int first_page_no = address_to_page_num(metadata_address);
+    for (int i = 0; i < (int)(metadata_size / PAGE_SIZE); i++) {
+        if (page_is_used(first_page_no + i))
+            panic("Memory after kernel is not available for memory manager structures");
+    }
+    mark_physical_memory_unavailable(metadata_address, metadata_size);
+    reserved_end_address = metadata_address + metadata_size;
+
+    buddy_pages = (struct buddy_page *)metadata_address;
+    page_frames = (page_frame_t *)(metadata_address + buddy_size);
+    memset(buddy_pages, 0, metadata_size);
+
+    // whatever is not available at this point, will never be allocated
+    for (uint32_t p = 0; p < total_pages; p++) {
+        if (page_is_used(p)) {
+            page_frames[p].flags = PAGE_FRAME_RESERVED;
+            page_frames[p].owner = PAGE_OWNER_KERNEL;
+        }
+    }
+
+    for (int order = 0; order <= MAX_ORDER; order++) {
+        buddy_free_lists[order] = NO_PAGE;
+        buddy_free_blocks[order] = 0;
+    }
+
+    // carve the free pages into the largest aligned blocks possible.
+    // we walk downwards, so that the lowest blocks end up first in the lists.
+    uint32_t page_no = total_pages;
+    while (page_no > BUDDY_FIRST_PAGE) {
+        if (page_is_used(page_no - 1)) {
+            page_no--;
+            continue;
+        }
+        int order = MAX_ORDER;
+        uint32_t start = 0;
+        while (order > 0) {
+            start = page_no - (1 << order);
+            bool all_free = (page_no >= (uint32_t)(1 << order)) &&
+                (start % (1 << order) == 0) &&
+                (start >= BUDDY_FIRST_PAGE);
+            for (uint32_t p = start; all_free && p < page_no; p++)
+                all_free = page_is_free(p);
+            if (all_free)
+                break;
+            order--;
+        }
+        start = page_no - (1 << order);
+        buddy_free_block(start, order);
+        page_no = start;
+    }
+
+    klog_debug("Buddy allocator initialized, %u pages, metadata at 0x%p - 0x%p",
+        total_pages, metadata_address, reserved_end_address);
+}
+
+static void buddy_list_add(uint32_t page_no, int order) {
+    struct buddy_page *bp = &buddy_pages[page_no];
+    bp->order = order;
+    bp->free_block_head = 1;
+    bp->prev = NO_PAGE;
+    bp->next = buddy_free_lists[order];
+    if (bp->next != NO_PAGE)
+        buddy_pages[bp->next].prev = page_no;
+    buddy_free_lists[order] = page_no;
+    buddy_free_blocks[order]++;
+}
+
+static void buddy_list_remove(uint32_t page_no) {
+    struct buddy_page *bp = &buddy_pages[page_no];
+    if (bp->prev != NO_PAGE)
+        buddy_pages[bp->prev].next = bp->next;
+    else
+        buddy_free_lists[bp->order] = bp->next;
+    if (bp->next != NO_PAGE)
+        buddy_pages[bp->next].prev = bp->prev;
+    buddy_free_blocks[bp->order]--;
+    bp->free_block_head = 0;
+    bp->next = NO_PAGE;
+    bp->prev = NO_PAGE;
+}
+
+static inline bool is_free_block_of_order(uint32_t page_no, int order) {
+    return page_no >= BUDDY_FIRST_PAGE && page_no < total_pages &&
+        buddy_pages[page_no].free_block_head && buddy_pages[page_no].order == order;
+}
+
+// splits larger blocks as needed. the lower half is kept, so allocations tend to go upwards.
+// returns the first page of the block, or -1. does not touch the bitmap
+static int buddy_allocate_block(int order) {
+    int block_order = order;
+    while (block_order <= MAX_ORDER && buddy_free_lists[block_order] == NO_PAGE)
+        block_order++;
+    if (block_order > MAX_ORDER)
+        return -1;
+
+    uint32_t page_no = buddy_free_lists[block_order];
+    buddy_list_remove(page_no);
+    while (block_order > order) {
+        block_order--;
+        buddy_list_add(page_no + (1 << block_order), block_order);
+    }
+    return (int)page_no;
+}
+
+// returns a block, merging it with its free buddies. does not touch the bitmap
+static void buddy_free_block(uint32_t page_no, int order) {
+    while (order < MAX_ORDER) {
+        uint32_t buddy = page_no ^ (1 << order);
+        if (!is_free_block_of_order(buddy, order))
+            break;
+        buddy_list_remove(buddy);
+        page_no = min(page_no, buddy);
+        order++;
+    }
+    buddy_list_add(page_no, order);
+}
+
+// removes a specific page from the free block that contains it, if any
+static bool buddy_take_page(uint32_t page_no) {
+    for (int order = 0; order <= MAX_ORDER; order++) {
+        uint32_t head = page_no & ~((1 << order) - 1);
+        if (!is_free_block_of_order(head, order))
+            continue;
+
+        // split, giving back the halves that do not contain our page
+        buddy_list_remove(head);
+        while (order > 0) {
+            order--;
+            uint32_t half = 1 << order;
+            if (page_no >= head + half) {
+                buddy_list_add(head, order);
+                head += half;
+            } else {
+                buddy_list_add(head + half, order);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+static void mark_pages_allocated(int first_page_no, int pages) {
+    for (int i = 0; i < pages; i++) {
+        mark_page_used(first_page_no + i);
+        page_frames[first_page_no + i].refcount = 1;
+        page_frames[first_page_no + i].flags = 0;
+        page_frames[first_page_no + i].owner = PAGE_OWNER_KERNEL;
+    }
+    total_used_pages += pages;
+    total_free_pages -= pages;
+}
+
+// takes a page found free in the bitmap, from the buddy allocator as well
+static void take_free_page(int page_no) {
+    if (page_no >= BUDDY_FIRST_PAGE && !buddy_take_page(page_no))
+        panic("Page free in bitmap, but not in buddy allocator");
+    mark_pages_allocated(page_no, 1);
 }
 
 static void mark_physical_memory_available(void *address, size_t size) {
@@ -99,9 +329,13 @@ static void mark_physical_memory_unavailable(void *address, size_t size) {
     klog_debug("marking as unavailable, p=%p, len=%u", address, size);
     int first_page_no = address_to_page_num((void *)round_down_4k((uint32_t)address));
     int num_of_pages = round_up_4k(size) / PAGE_SIZE;
-    for (int i = 0; i < num_of_pages; i++)
+    for (int i = 0; i < num_of_pages; i++) {
+        if (page_is_free(first_page_no + i)) {
+            total_free_pages--;
+            total_used_pages++;
+        }
         mark_page_used(first_page_no + i);
-    total_used_pages += num_of_pages;
+    }
 }
 
 static inline bool page_is_used(int page_no) {
@@ -113,11 +347,18 @@ static inline bool page_is_free(int page_no) {
 }
 
 static inline void mark_page_used(int page_no) {
-    page_status_bitmaps[page_no / 32] |= (1 << (page_no % 32));
+    int word_no = page_no / 32;
+    page_status_bitmaps[word_no] |= (1 << (page_no % 32));
+    if (page_status_bitmaps[word_no] == 0xFFFFFFFF)
+        free_words_summary[word_no / 32] &= ~(1 << (word_no % 32));
 }
 
 static inline void mark_page_free(int page_no) {
-    page_status_bitmaps[page_no / 32] &= ~(1 << (page_no % 32));
+    int word_no = page_no / 32;
+    page_status_bitmaps[word_no] &= ~(1 << (page_no % 32));
+    free_words_summary[word_no / 32] |= (1 << (word_no % 32));
+    if (page_no < lowest_free_page_hint)
+        lowest_free_page_hint = page_no;
 }
 
 static inline uint32_t round_up_4k(uint32_t number) {
@@ -136,32 +377,76 @@ static inline uint32_t address_to_page_num(void *address) {
     return ((uint32_t)address >> 12);
 }
 
+// one bit per bitmap word, a set bit means the word has free pages
+static int find_next_word_with_free_pages(int word_no) {
+    int summary_no = word_no / 32;
+    if (summary_no >= SUMMARY_WORDS)
+        return -1;
+    uint32_t bits = free_words_summary[summary_no] & (0xFFFFFFFF << (word_no % 32));
+    while (bits == 0) {
+        if (++summary_no >= SUMMARY_WORDS)
+            return -1;
+        bits = free_words_summary[summary_no];
+    }
+    return summary_no * 32 + __builtin_ctz(bits);
+}
+
 static int find_first_free_physical_page_no(int min_page_no) {
-    int starting_i = min_page_no / 32;
-    for (int i = starting_i; i < (int)(sizeof(page_status_bitmaps) / sizeof(page_status_bitmaps[0])); i++) {
-        if (page_status_bitmaps[i] == 0xFFFFFFFF)
-            continue;
-        
-        int starting_bit = (i == starting_i) ? min_page_no % 32 : 0;
-        for (int bit = starting_bit; bit <= 32; bit++) {
-            if ((page_status_bitmaps[i] & (1 << bit)) == 0) {
-                return i * 32 + bit;
-            }
+    // there are no free pages below the hint
+    int start_page_no = max(min_page_no, lowest_free_page_hint);
+    int word_no = start_page_no / 32;
+    int page_no = -1;
+
+    if (word_no < BITMAP_WORDS) {
+        // the first word may be partially before our starting page
+        uint32_t free_bits = ~page_status_bitmaps[word_no] & (0xFFFFFFFF << (start_page_no % 32));
+        if (free_bits == 0) {
+            word_no = find_next_word_with_free_pages(word_no + 1);
+            if (word_no != -1)
+                free_bits = ~page_status_bitmaps[word_no];
         }
+        if (word_no != -1)
+            page_no = word_no * 32 + __builtin_ctz(free_bits);
     }
 
-    return -1;
+    // if we looked from the hint, we now know the first free page
+    if (min_page_no <= lowest_free_page_hint)
+        lowest_free_page_hint = (page_no == -1) ? BITMAP_WORDS * 32 : page_no;
+
+    return page_no;
 }
 
 void *allocate_physical_page(void *minimum_address) {
     pushcli();
     int min_page_no = round_up_4k((uint32_t)minimum_address) / PAGE_SIZE;
-    int page_no = find_first_free_physical_page_no(min_page_no);
-    if (page_no == -1)
-        panic("Cannot find free page to allocate");
-    mark_page_used(page_no);
-    total_free_pages--;
-    total_used_pages++;
+    int page_no = -1;
+
+    // low memory first, if allowed, then the buddy allocator
+    if (min_page_no < BUDDY_FIRST_PAGE) {
+        page_no = find_first_free_physical_page_no(min_page_no);
+        if (page_no >= BUDDY_FIRST_PAGE)
+            page_no = -1;
+    }
+    if (page_no == -1 && min_page_no <= BUDDY_FIRST_PAGE)
+        page_no = buddy_allocate_block(0);
+
+    if (page_no != -1 && page_no >= LOW_MEMORY_PAGES) {
+        // freed mapped pages end up in the buddy lists too, low memory may still have some
+        buddy_free_block(page_no, 0);
+        page_no = -1;
+    }
+
+    if (page_no != -1) {
+        mark_pages_allocated(page_no, 1);
+    } else {
+        // a specific minimum address, or no luck with buddy
+        page_no = find_first_free_physical_page_no(min_page_no);
+        if (page_no == -1)
+            panic("Cannot find free page to allocate");
+        if (page_no >= LOW_MEMORY_PAGES && min_page_no < LOW_MEMORY_PAGES)
+            panic("Low memory exhausted");
+        take_free_page(page_no);
+    }
     popcli();
     void *ptr = page_num_to_address(page_no);
     klog_trace("allocate_physical_page() -> 0x%p (page_no %d)", ptr, page_no);
@@ -174,8 +459,32 @@ void *allocate_consecutive_physical_pages(size_t size_in_bytes, void *minimum_ad
     
     pushcli();
     int pages_needed = round_up_4k(size_in_bytes) / PAGE_SIZE;
-    int search_starting_page = round_up_4k((uint32_t)minimum_address) / PAGE_SIZE;
+    int min_page_no = round_up_4k((uint32_t)minimum_address) / PAGE_SIZE;
+    int search_starting_page = min_page_no;
     int first_free_page_no = -1;
+
+    // the buddy allocator serves up to 2^MAX_ORDER pages, the rest of the block is given back
+    int order = 0;
+    while ((1 << order) < pages_needed)
+        order++;
+    if (order <= MAX_ORDER && search_starting_page <= BUDDY_FIRST_PAGE) {
+        first_free_page_no = buddy_allocate_block(order);
+        if (first_free_page_no >= LOW_MEMORY_PAGES) {
+            buddy_free_block(first_free_page_no, order);
+            first_free_page_no = -1;
+        }
+        if (first_free_page_no != -1) {
+            mark_pages_allocated(first_free_page_no, pages_needed);
+            for (int i = pages_needed; i < (1 << order); i++)
+                buddy_free_block(first_free_page_no + i, 0);
+            popcli();
+            void *ptr = page_num_to_address(first_free_page_no);
+            klog_trace("allocate_consecutive_physical_pages() -> 0x%p (%d pages, order %d block)", ptr, pages_needed, order);
+            return ptr;
+        }
+    }
+
+    // larger than the largest block, or at a specific minimum address, probe the bitmap
     while (true) {
         first_free_page_no = find_first_free_physical_page_no(search_starting_page);
         if (first_free_page_no == -1)
@@ -188,17 +497,17 @@ void *allocate_consecutive_physical_pages(size_t size_in_bytes, void *minimum_ad
                 break;
             }
         }
-        if (all_needed_extra_pages_are_free)
+        if (all_needed_extra_pages_are_free) {
+            if (first_free_page_no + pages_needed > LOW_MEMORY_PAGES && min_page_no < LOW_MEMORY_PAGES)
+                panic("Low memory exhausted");
             break;
+        }
         // otherwise, search another region
         search_starting_page = first_free_page_no + extra_page + 1;
     }
 
-    for (int i = 0; i < pages_needed; i++) {
-        mark_page_used(first_free_page_no + i);
-        total_used_pages++;
-        total_free_pages--;
-    }
+    for (int i = 0; i < pages_needed; i++)
+        take_free_page(first_free_page_no + i);
     popcli();
     void *ptr = page_num_to_address(first_free_page_no);
     klog_trace("allocate_consecutive_physical_pages() -> 0x%p (%d pages, first page is %d)", ptr, pages_needed, first_free_page_no);
@@ -211,9 +520,18 @@ void free_physical_page(void *address) {
     int page_no = address_to_page_num(address);
     if (!page_is_used(page_no))
         panic("Freeing unused memory page");
+    if (page_frames[page_no].refcount > 1 || (page_frames[page_no].flags & PAGE_FRAME_RESERVED)) {
+        klog_crit("Freeing page 0x%p, refcount %d, flags 0x%x",
+            address, page_frames[page_no].refcount, page_frames[page_no].flags);
+        panic("Freeing shared or reserved memory page");
+    }
+    page_frames[page_no].refcount = 0;
+    page_frames[page_no].owner = PAGE_OWNER_NONE;
     mark_page_free(page_no);
     total_free_pages++;
     total_used_pages--;
+    if (page_no >= BUDDY_FIRST_PAGE)
+        buddy_free_block(page_no, 0);
     popcli();
 }
 
@@ -226,6 +544,116 @@ void free_consecutive_physical_pages(void *address, size_t size_in_bytes) {
     }
 }
 
+void *allocate_physical_page_zeroed(void *minimum_address) {
+    void *page = allocate_physical_page(minimum_address);
+    memset(page, 0, PAGE_SIZE);
+    return page;
+}
+
+// the memory above the low memory is used first, if there is any
+static void *allocate_mapped_page() {
+    pushcli();
+    int page_no = find_first_free_physical_page_no(LOW_MEMORY_PAGES);
+    if (page_no == -1)
+        page_no = find_first_free_physical_page_no(BUDDY_FIRST_PAGE);
+    if (page_no == -1)
+        panic("Cannot find free page to allocate");
+    take_free_page(page_no);
+    popcli();
+    return page_num_to_address(page_no);
+}
+
+// cleared through a temporary mapping, the page may be in a range that a process maps elsewhere
+static void clear_mapped_page(void *page) {
+    void *mapped = map_temporary_page(page);
+    memset(mapped, 0, PAGE_SIZE);
+    unmap_temporary_page(mapped);
+}
+
+void *allocate_mapped_physical_page(bool zeroed) {
+    void *page = NULL;
+
+    if (zeroed) {
+        pushcli();
+        if (zeroed_pool_count > 0) {
+            page = zeroed_pool[--zeroed_pool_count];
+            zeroed_pool_hits++;
+        } else {
+            zeroed_pool_misses++;
+        }
+        popcli();
+        if (page != NULL)
+            return page;
+    }
+
+    page = allocate_mapped_page();
+    if (zeroed)
+        clear_mapped_page(page);
+    klog_trace("allocate_mapped_physical_page() -> 0x%p", page);
+    return page;
+}
+
+int refill_zeroed_pages_pool() {
+    int added = 0;
+
+    while (zeroed_pool_count < ZEROED_POOL_SIZE && total_free_pages > ZEROED_POOL_MIN_FREE) {
+        void *page = allocate_mapped_page();
+        clear_mapped_page(page);
+
+        pushcli();
+        if (zeroed_pool_count < ZEROED_POOL_SIZE) {
+            zeroed_pool[zeroed_pool_count++] = page;
+            page = NULL;
+        }
+        popcli();
+
+        // someone else filled the pool while we were clearing
+        if (page != NULL) {
+            free_physical_page(page);
+            break;
+        }
+        added++;
+    }
+
+    return added;
+}
+
+page_frame_t *get_page_frame(void *address) {
+    uint32_t page_no = address_to_page_num(address);
+    return page_no < total_pages ? &page_frames[page_no] : NULL;
+}
+
+void set_physical_page_owner(void *address, enum page_owner owner) {
+    page_frame_t *frame = get_page_frame(address);
+    if (frame != NULL)
+        frame->owner = owner;
+}
+
+void physical_page_add_ref(void *address) {
+    pushcli();
+    page_frame_t *frame = get_page_frame(address);
+    if (frame == NULL || frame->refcount == 0)
+        panic("Adding reference to a free page");
+    if (frame->refcount == 0xFFFF)
+        panic("Page reference count overflow");
+    frame->refcount++;
+    popcli();
+}
+
+int physical_page_release(void *address) {
+    pushcli();
+    page_frame_t *frame = get_page_frame(address);
+    if (frame == NULL || frame->refcount == 0)
+        panic("Releasing reference of a free page");
+    int remaining = --frame->refcount;
+    if (remaining == 0) {
+        frame->refcount = 1; // so that freeing finds a single owner
+        free_physical_page(address);
+    }
+    popcli();
+    return remaining;
+}
+
 void get_physical_memory_info(phys_mem_info_t *info) {
     info->pages_total = total_free_pages + total_used_pages;
     info->pages_free = total_free_pages;
@@ -277,6 +705,23 @@ void dump_physical_memory_map_overall() {
         total_used_pages,
         total_free_pages
     );
+    int shared_pages = 0;
+    int owned_pages[PAGE_OWNER_USER + 1] = { 0, };
+    for (uint32_t p = 0; p < total_pages; p++) {
+        if (page_frames[p].refcount > 1)
+            shared_pages++;
+        if (page_frames[p].refcount > 0 && page_frames[p].owner <= PAGE_OWNER_USER)
+            owned_pages[page_frames[p].owner]++;
+    }
+    printf("pages owned by kernel %u, page tables %u, user %u, shared %u\n",
+        owned_pages[PAGE_OWNER_KERNEL], owned_pages[PAGE_OWNER_PAGE_TABLE],
+        owned_pages[PAGE_OWNER_USER], shared_pages);
+    printf("zeroed pool %d pages, %u hits, %u misses\n",
+        zeroed_pool_count, zeroed_pool_hits, zeroed_pool_misses);
+    printf("free blocks per order:");
+    for (int order = 0; order <= MAX_ORDER; order++)
+        printf(" %u", buddy_free_blocks[order]);
+    printf("\n");
 }
 
 void dump_physical_memory_map_detail(uint32_t start_address) {
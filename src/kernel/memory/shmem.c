@@ -0,0 +1,60 @@
+#include <klog.h>
+#include <cpu.h>
+#include <bits.h>
+#include <klib/string.h>
+#include <memory/kheap.h>
+#include <memory/physmem.h>
+#include <memory/shmem.h>
+
+MODULE("SHMEM");
+
+
+shared_memory_t *shmem_create(uint32_t size) {
+    shared_memory_t *shmem = kmalloc(sizeof(shared_memory_t));
+    shmem->refcount = 1;
+    shmem->pages_count = ROUND_UP_4K(size) / 4096;
+    shmem->pages = kmalloc(shmem->pages_count * sizeof(void *));
+    memset(shmem->pages, 0, shmem->pages_count * sizeof(void *));
+    return shmem;
+}
+
+void shmem_add_ref(shared_memory_t *shmem) {
+    pushcli();
+    shmem->refcount++;
+    popcli();
+}
+
+void shmem_release(shared_memory_t *shmem) {
+    pushcli();
+    bool last = --shmem->refcount == 0;
+    popcli();
+    if (!last)
+        return;
+
+    klog_trace("shmem_release(0x%p), freeing %u pages", shmem, shmem->pages_count);
+    for (uint32_t i = 0; i < shmem->pages_count; i++) {
+        if (shmem->pages[i] != NULL)
+            physical_page_release(shmem->pages[i]);
+    }
+    kfree(shmem->pages);
+    kfree(shmem);
+}
+
+void *shmem_get_page(shared_memory_t *shmem, uint32_t offset) {
+    uint32_t index = offset / 4096;
+    if (index >= shmem->pages_count)
+        return NULL;
+
+    // two processes may touch the same page at the same time
+    pushcli();
+    void *physical_page = shmem->pages[index];
+    if (physical_page == NULL) {
+        physical_page = allocate_mapped_physical_page(true);
+        set_physical_page_owner(physical_page, PAGE_OWNER_USER);
+        shmem->pages[index] = physical_page;
+    }
+    physical_page_add_ref(physical_page);
+    popcli();
+
+    return physical_page;
+}
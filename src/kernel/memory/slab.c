@@ -0,0 +1,271 @@
+#include <drivers/screen.h>
+#include <klib/string.h>
+#include <cpu.h>
+#include <klog.h>
+#include <bits.h>
+#include <memory/physmem.h>
+#include <memory/kheap.h>
+#include <memory/slab.h>
+
+MODULE("SLAB");
+
+#define SLAB_SIZE          4096
+#define SLAB_MAGIC         0x51AB51AB
+#define NO_MORE_OBJECTS    0xFFFF
+
+
+// each slab is one physical page, this header sits at the start of it,
+// followed by the free index chain, followed by the objects.
+// the free chain is kept outside the objects, so constructed state is preserved.
+struct slab {
+    uint32_t magic;
+    kmem_cache_t *cache;
+    struct slab *next;
+    struct slab *prev;
+    uint16_t first_free;
+    uint16_t in_use;
+    uint8_t *objects;
+    uint16_t next_free[];
+};
+
+struct slab_list {
+    struct slab *head;
+    uint32_t count;
+};
+
+struct kmem_cache {
+    const char *name;
+    uint32_t object_size;
+    uint32_t objects_per_slab;
+    kmem_cache_ctor_t ctor;
+
+    // slabs move between these lists, as objects are allocated and freed
+    struct slab_list partial;
+    struct slab_list full;
+    struct slab_list empty;
+
+    uint32_t objects_in_use;
+    uint32_t allocations;
+    uint32_t frees;
+
+    struct kmem_cache *next;
+};
+
+static kmem_cache_t *caches_list = NULL;
+
+static struct slab *create_slab(kmem_cache_t *cache);
+static void destroy_slab(struct slab *slab);
+static void slab_list_add(struct slab_list *list, struct slab *slab);
+static void slab_list_remove(struct slab_list *list, struct slab *slab);
+
+
+kmem_cache_t *kmem_cache_create(const char *name, size_t object_size, kmem_cache_ctor_t ctor) {
+    // keep objects 4-byte aligned
+    object_size = (object_size + 3) & ~3;
+    uint32_t available = SLAB_SIZE - sizeof(struct slab) - 3; // allow for alignment
+    uint32_t per_slab = available / (object_size + sizeof(uint16_t));
+    if (per_slab == 0) {
+        klog_error("kmem_cache_create(\"%s\"): object size %u too large for a slab", name, object_size);
+        return NULL;
+    }
+
+    kmem_cache_t *cache = kmalloc(sizeof(kmem_cache_t));
+    memset(cache, 0, sizeof(kmem_cache_t));
+    cache->name = name;
+    cache->object_size = object_size;
+    cache->objects_per_slab = per_slab;
+    cache->ctor = ctor;
+
+    pushcli();
+    cache->next = caches_list;
+    caches_list = cache;
+    popcli();
+
+    klog_debug("Cache \"%s\" created, object size %u, %u objects per slab", name, object_size, per_slab);
+    return cache;
+}
+
+void *kmem_cache_alloc(kmem_cache_t *cache) {
+    struct slab *slab;
+    pushcli();
+
+    slab = cache->partial.head;
+    if (slab == NULL) {
+        slab = cache->empty.head;
+        if (slab != NULL) {
+            slab_list_remove(&cache->empty, slab);
+        } else {
+            slab = create_slab(cache);
+            if (slab == NULL) {
+                popcli();
+                return NULL;
+            }
+        }
+        slab_list_add(&cache->partial, slab);
+    }
+
+    uint16_t index = slab->first_free;
+    slab->first_free = slab->next_free[index];
+    slab->in_use++;
+    if (slab->in_use == cache->objects_per_slab) {
+        slab_list_remove(&cache->partial, slab);
+        slab_list_add(&cache->full, slab);
+    }
+
+    cache->objects_in_use++;
+    cache->allocations++;
+    popcli();
+
+    void *object = slab->objects + index * cache->object_size;
+    klog_trace("kmem_cache_alloc(\"%s\") -> 0x%p", cache->name, object);
+    return object;
+}
+
+void kmem_cache_free(kmem_cache_t *cache, void *object) {
+    klog_trace("kmem_cache_free(\"%s\", 0x%p)", cache->name, object);
+    if (object == NULL)
+        return;
+
+    struct slab *slab = (struct slab *)ROUND_DOWN_4K((uint32_t)object);
+    if (slab->magic != SLAB_MAGIC || slab->cache != cache) {
+        klog_crit("kmem_cache_free(\"%s\", 0x%p): object does not belong to cache", cache->name, object);
+        panic("Slab corruption detected!");
+    }
+    uint16_t index = ((uint8_t *)object - slab->objects) / cache->object_size;
+
+    pushcli();
+    bool was_full = (slab->in_use == cache->objects_per_slab);
+    slab->next_free[index] = slab->first_free;
+    slab->first_free = index;
+    slab->in_use--;
+
+    if (slab->in_use == 0) {
+        slab_list_remove(was_full ? &cache->full : &cache->partial, slab);
+        // keep one empty slab around, to avoid thrashing at the boundary
+        if (cache->empty.count > 0)
+            destroy_slab(slab);
+        else
+            slab_list_add(&cache->empty, slab);
+    } else if (was_full) {
+        slab_list_remove(&cache->full, slab);
+        slab_list_add(&cache->partial, slab);
+    }
+
+    cache->objects_in_use--;
+    cache->frees++;
+    popcli();
+}
+
+void kmem_cache_shrink(kmem_cache_t *cache) {
+    pushcli();
+    while (cache->empty.head != NULL) {
+        struct slab *slab = cache->empty.head;
+        slab_list_remove(&cache->empty, slab);
+        destroy_slab(slab);
+    }
+    popcli();
+}
+
+void kmem_cache_destroy(kmem_cache_t *cache) {
+    if (cache->objects_in_use > 0) {
+        klog_error("kmem_cache_destroy(\"%s\"): %u objects still in use", cache->name, cache->objects_in_use);
+        return;
+    }
+    kmem_cache_shrink(cache);
+
+    pushcli();
+    if (caches_list == cache) {
+        caches_list = cache->next;
+    } else {
+        kmem_cache_t *c = caches_list;
+        while (c != NULL && c->next != cache)
+            c = c->next;
+        if (c != NULL)
+            c->next = cache->next;
+    }
+    popcli();
+
+    kfree(cache);
+}
+
+void kmem_cache_get_stats(kmem_cache_t *cache, kmem_cache_stats_t *stats) {
+    pushcli();
+    stats->name = cache->name;
+    stats->object_size = cache->object_size;
+    stats->objects_per_slab = cache->objects_per_slab;
+    stats->slabs = cache->partial.count + cache->full.count + cache->empty.count;
+    stats->objects_total = stats->slabs * cache->objects_per_slab;
+    stats->objects_in_use = cache->objects_in_use;
+    stats->allocations = cache->allocations;
+    stats->frees = cache->frees;
+    popcli();
+}
+
+kmem_cache_t *kmem_cache_next(kmem_cache_t *cache) {
+    return cache == NULL ? caches_list : cache->next;
+}
+
+void kmem_caches_dump() {
+    kmem_cache_stats_t stats;
+    klog_debug("  Cache                Size Slabs  In use / Total      Allocs       Frees");
+    for (kmem_cache_t *c = caches_list; c != NULL; c = c->next) {
+        kmem_cache_get_stats(c, &stats);
+        klog_debug("  %-18s %6u %5u %7u / %-7u %9u %11u",
+            stats.name, stats.object_size, stats.slabs,
+            stats.objects_in_use, stats.objects_total,
+            stats.allocations, stats.frees
+        );
+    }
+}
+
+static struct slab *create_slab(kmem_cache_t *cache) {
+    // page is accessed through its physical address, as with other kernel buffers
+    struct slab *slab = allocate_physical_page(0);
+    if (slab == NULL) {
+        klog_error("Cannot allocate page for slab of cache \"%s\"", cache->name);
+        return NULL;
+    }
+
+    uint32_t header_size = sizeof(struct slab) + cache->objects_per_slab * sizeof(uint16_t);
+    slab->magic = SLAB_MAGIC;
+    slab->cache = cache;
+    slab->next = NULL;
+    slab->prev = NULL;
+    slab->in_use = 0;
+    slab->first_free = 0;
+    slab->objects = (uint8_t *)slab + ((header_size + 3) & ~3);
+
+    for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+        slab->next_free[i] = (i + 1 < cache->objects_per_slab) ? i + 1 : NO_MORE_OBJECTS;
+        if (cache->ctor != NULL)
+            cache->ctor(slab->objects + i * cache->object_size);
+    }
+
+    return slab;
+}
+
+static void destroy_slab(struct slab *slab) {
+    slab->magic = 0;
+    free_physical_page(slab);
+}
+
+static void slab_list_add(struct slab_list *list, struct slab *slab) {
+    slab->prev = NULL;
+    slab->next = list->head;
+    if (list->head != NULL)
+        list->head->prev = slab;
+    list->head = slab;
+    list->count++;
+}
+
+static void slab_list_remove(struct slab_list *list, struct slab *slab) {
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        list->head = slab->next;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+    slab->next = NULL;
+    slab->prev = NULL;
+    list->count--;
+}
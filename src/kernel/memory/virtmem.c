@@ -1,9 +1,11 @@
 #include <bits.h>
 #include <memory/physmem.h>
+#include <memory/virtmem.h>
 #include <drivers/screen.h>
 #include <klog.h>
 #include <klib/string.h>
 #include <cpu.h>
+#include <multitask/process.h>
 
 MODULE("VMEM");
 
@@ -124,6 +126,40 @@ static inline uint32_t create_table_entry_value(void *address, bool global, bool
         (((uint32_t)page_present    & 0x01));
 }
 
+// the kernel identity map uses 4 MB pages, if the cpu supports them (PSE),
+// marked global, so their TLB entries survive CR3 switches (PGE).
+#define LARGE_PAGE_SIZE         (4 * 1024 * 1024)
+#define PDE_LARGE_PAGE_FLAG     0x80
+#define PDE_GLOBAL_FLAG         0x100
+#define CR4_PSE_FLAG            0x10
+#define CR4_PGE_FLAG            0x80
+static bool large_pages_supported = false;
+static bool global_pages_supported = false;
+
+static inline uint32_t create_large_page_directory_entry_value(void *address, bool global) {
+    // 4 MB page, address must be 4 MB aligned, page size bit set
+    return
+        (((uint32_t)address) & 0xFFC00000) |
+        (global ? PDE_GLOBAL_FLAG : 0)      |
+        PDE_LARGE_PAGE_FLAG                 |
+        (1 << 2) | // user accessible
+        (1 << 1) | // write enabled
+        (1 << 0);  // page present
+}
+
+// bits of page table entries that are available to the OS.
+// owned pages belong to the address space, they are released with it, or shared when cloned.
+// copy on write pages are shared read only, they are copied on the first write.
+#define PTE_WRITABLE_FLAG       0x002
+#define PTE_OWNED_PAGE_FLAG     0x200
+#define PTE_COPY_ON_WRITE_FLAG  0x400
+#define PTE_SHARED_MEMORY_FLAG  0x800
+
+// for page directory entries only
+static inline bool is_large_page_entry(uint32_t entry_value) {
+    return (entry_value & PDE_LARGE_PAGE_FLAG);
+}
+
 // common to both page directory and page tables
 static inline bool is_entry_present(uint32_t entry_value) {
     return (entry_value & 0x01);
@@ -176,6 +212,8 @@ void *resolve_virtual_to_physical_address(void *virtual_addr, void *page_dir_add
     entry = get_table_entry(page_dir_addr, index);
     if (!is_entry_present(entry))
         return NULL;
+    if (is_large_page_entry(entry))
+        return (void *)((entry & 0xFFC00000) | ((uint32_t)virtual_addr & 0x003FFFFF));
     address = get_entry_address(entry);
     if (address == NULL)
         return NULL;
@@ -194,24 +232,25 @@ void *resolve_virtual_to_physical_address(void *virtual_addr, void *page_dir_add
     return (void *)(address + offset);
 }
 
-// map the virtual address to resolve to the physical one for the particular page directory.
-void map_virtual_address_to_physical(void *virtual_addr, void *physical_addr, void *page_dir_addr, bool skip_logging) {
-    if (!skip_logging) {
-        klog_trace("Mapping phys addr 0x%x to virt addr 0x%x, page dir 0x%x", physical_addr, virtual_addr, page_dir_addr);
-    }
-
+// finds the page table for the virtual address, possibly creating it.
+// returns NULL if there is none, or if the address is in a 4 MB page.
+static void *get_page_table(void *virtual_addr, void *page_dir_addr, bool create) {
     uint32_t page_dir_index = virt_addr_to_page_directory_index(virtual_addr);
     uint32_t page_dir_entry = get_table_entry(page_dir_addr, page_dir_index);
     void *page_table_address;
     // klog_debug("pd address = 0x%p, pd index = %d, pd entry = 0x%x", page_dir_addr, page_dir_index, page_dir_entry);
 
-    if (is_entry_present(page_dir_entry)) {
+    if (is_entry_present(page_dir_entry) && is_large_page_entry(page_dir_entry)) {
+        return NULL;
+    } else if (is_entry_present(page_dir_entry)) {
         page_table_address = get_entry_address(page_dir_entry);
+    } else if (!create) {
+        return NULL;
     } else {
         // we need to create one
-        page_table_address = allocate_physical_page((void *)0);
+        page_table_address = allocate_physical_page_zeroed((void *)0);
+        set_physical_page_owner(page_table_address, PAGE_OWNER_PAGE_TABLE);
         klog_debug("Allocated new physical page at 0x%p for new page table", page_table_address);
-        memset(page_table_address, 0, 4096);
         uint32_t page_dir_value = create_directory_entry_value(
             page_table_address,
             true, // cache disable
@@ -224,26 +263,130 @@ void map_virtual_address_to_physical(void *virtual_addr, void *physical_addr, vo
         set_table_entry(page_dir_addr, page_dir_index, page_dir_value);
     }
 
-    // now map the physical page in the page_table
-    uint32_t page_table_index = virt_addr_to_page_table_index(virtual_addr);
-    uint32_t page_table_entry = get_table_entry(page_table_address, page_table_index);
-    if (is_entry_present(page_table_entry))
-        return; // already mapped
-    
-    page_table_entry = create_table_entry_value(
+    return page_table_address;
+}
+
+// entry for a page mapped in a process address space
+static inline uint32_t create_page_entry_value(void *physical_addr, bool writable, uint32_t os_flags) {
+    return create_table_entry_value(
         physical_addr,
-        true, // global
+        false, // global, only the kernel mappings are the same in all address spaces
         true, // PAT
         true, // cache disable
         true, // write through
         true, // user accessible
-        true, // writable
+        writable,
         true  // page present
-    );
+    ) | os_flags;
+}
+
+// start of the next 4 MB range (covered by one page table), capped to the end address
+static inline void *next_page_table_boundary(void *virtual_addr, void *end_addr) {
+    uint32_t next = ((uint32_t)virtual_addr & ~(LARGE_PAGE_SIZE - 1)) + LARGE_PAGE_SIZE;
+    if (next == 0 || next > (uint32_t)end_addr)
+        return end_addr;
+    return (void *)next;
+}
+
+static bool is_page_table_empty(uint32_t *page_table_address) {
+    for (int i = 0; i < 1024; i++) {
+        if (page_table_address[i] != 0)
+            return false;
+    }
+    return true;
+}
+
+// flushing single entries is cheaper for a few pages, beyond that CR3 is reloaded once.
+// global entries survive the reload, so this is for process pages only.
+#define INVLPG_BATCH_LIMIT   32
+
+static void invalidate_paging_cached_range(void *start_addr, void *end_addr, void *page_dir_addr) {
+    if (get_page_directory_register() != page_dir_addr)
+        return;
+
+    if ((uint32_t)(end_addr - start_addr) / 4096 > INVLPG_BATCH_LIMIT) {
+        set_page_directory_register(page_dir_addr);
+    } else {
+        for (void *virt_addr = start_addr; virt_addr < end_addr; virt_addr += 4096)
+            invalidate_paging_cached_address(virt_addr);
+    }
+}
+
+static void map_page(void *virtual_addr, void *physical_addr, void *page_dir_addr, bool writable, uint32_t os_flags) {
+    void *page_table_address = get_page_table(virtual_addr, page_dir_addr, true);
+    if (page_table_address == NULL) {
+        // part of the kernel identity map, nothing more to map
+        if (virtual_addr != physical_addr)
+            klog_error("Cannot map 0x%p to 0x%p, address is in a 4 MB page", virtual_addr, physical_addr);
+        return;
+    }
+
+    // now map the physical page in the page_table
+    uint32_t page_table_index = virt_addr_to_page_table_index(virtual_addr);
+    uint32_t page_table_entry = get_table_entry(page_table_address, page_table_index);
+    if (is_entry_present(page_table_entry)) {
+        // already mapped, only fine if to the same page
+        if (get_entry_address(page_table_entry) != physical_addr)
+            klog_error("Cannot map 0x%p to 0x%p, already mapped to 0x%p", virtual_addr, physical_addr, get_entry_address(page_table_entry));
+        return;
+    }
+
+    page_table_entry = create_page_entry_value(physical_addr, writable, os_flags);
     // klog_debug("new page_table entry value = 0x%08x", page_table_entry);
     set_table_entry(page_table_address, page_table_index, page_table_entry);
 }
 
+// map the virtual address to resolve to the physical one for the particular page directory.
+void map_virtual_address_to_physical(void *virtual_addr, void *physical_addr, void *page_dir_addr, bool skip_logging) {
+    if (!skip_logging) {
+        klog_trace("Mapping phys addr 0x%x to virt addr 0x%x, page dir 0x%x", physical_addr, virtual_addr, page_dir_addr);
+    }
+    map_page(virtual_addr, physical_addr, page_dir_addr, true, 0);
+}
+
+void map_owned_page(void *virtual_addr, void *physical_addr, void *page_dir_addr) {
+    map_page(virtual_addr, physical_addr, page_dir_addr, true, PTE_OWNED_PAGE_FLAG);
+}
+
+void map_shared_page(void *virtual_addr, void *physical_addr, void *page_dir_addr) {
+    map_page(virtual_addr, physical_addr, page_dir_addr, false, PTE_OWNED_PAGE_FLAG);
+}
+
+void map_shared_memory_page(void *virtual_addr, void *physical_addr, void *page_dir_addr) {
+    map_page(virtual_addr, physical_addr, page_dir_addr, true, PTE_OWNED_PAGE_FLAG | PTE_SHARED_MEMORY_FLAG);
+}
+
+// gives the writer its own copy of a shared page, false if not a copy on write page
+static bool handle_copy_on_write_fault(void *virtual_addr, void *page_dir_addr) {
+    void *page_table_address = get_page_table(virtual_addr, page_dir_addr, false);
+    if (page_table_address == NULL)
+        return false;
+    uint32_t index = virt_addr_to_page_table_index(virtual_addr);
+    uint32_t entry = get_table_entry(page_table_address, index);
+    if (!is_entry_present(entry) || (entry & PTE_COPY_ON_WRITE_FLAG) == 0)
+        return false;
+
+    void *page = (void *)ROUND_DOWN_4K((uint32_t)virtual_addr);
+    void *shared_page = get_entry_address(entry);
+    page_frame_t *frame = get_page_frame(shared_page);
+    if (frame != NULL && frame->refcount > 1) {
+        // contents are readable through the current mapping
+        void *copy = allocate_mapped_physical_page(false);
+        set_physical_page_owner(copy, PAGE_OWNER_USER);
+        void *mapped_copy = map_temporary_page(copy);
+        memcpy(mapped_copy, page, 4096);
+        unmap_temporary_page(mapped_copy);
+        physical_page_release(shared_page);
+        entry = ((uint32_t)copy) | (entry & 0xFFF);
+    }
+
+    // the last one sharing the page, just gets it back
+    entry = (entry | PTE_WRITABLE_FLAG) & ~PTE_COPY_ON_WRITE_FLAG;
+    set_table_entry(page_table_address, index, entry);
+    invalidate_paging_cached_address(page);
+    return true;
+}
+
 // unmap the virtual address to resolve to the physical one for the particular page directory.
 void unmap_virtual_address(void *virtual_addr, void *page_dir_addr) {
     // clear the entry of the page table, if all the page table is clear, 
@@ -256,6 +399,8 @@ void unmap_virtual_address(void *virtual_addr, void *page_dir_addr) {
     uint32_t page_dir_entry = get_table_entry(page_dir_addr, page_dir_index);
     if (!is_entry_present(page_dir_entry))
         return; // no need, there's no page_table at all
+    if (is_large_page_entry(page_dir_entry))
+        return; // kernel identity map, never unmapped
     void *page_table_address = get_entry_address(page_dir_entry);
     
     // clear the page table entry
@@ -263,14 +408,7 @@ void unmap_virtual_address(void *virtual_addr, void *page_dir_addr) {
     set_table_entry(page_table_address, page_table_index, 0);
 
     // see if the whole page table is empty, to maybe free it.
-    bool page_table_completely_empty = true;
-    for (int i = 0; i < 1024; i++) {
-        if (((uint32_t *)page_table_address)[i] != 0) {
-            page_table_completely_empty = false;
-            break;
-        }
-    }
-    if (page_table_completely_empty) {
+    if (is_page_table_empty(page_table_address)) {
         klog_debug("Page table is clear, freeing physical page at 0x%x", page_table_address);
         free_physical_page(page_table_address);
         // remove entry from page directory
@@ -278,11 +416,24 @@ void unmap_virtual_address(void *virtual_addr, void *page_dir_addr) {
     }
 }
 
-// map a range to itself
+// map a range to itself (end_addr inclusive), filling each page table in one go
 void identity_map_range(void *start_addr, void *end_addr, void *page_dir_addr) {
     klog_trace("Identity mapping range 0x%p - 0x%p, page_dir=0x%p", start_addr, end_addr, page_dir_addr);
-    for (void *addr = start_addr; addr <= end_addr; addr += 4096) {
-        map_virtual_address_to_physical(addr, addr, page_dir_addr, true);
+    void *virt_addr = (void *)ROUND_DOWN_4K((uint32_t)start_addr);
+    void *range_end = (void *)ROUND_DOWN_4K((uint32_t)end_addr) + 4096;
+
+    while (virt_addr != range_end) {
+        void *table_end = next_page_table_boundary(virt_addr, range_end);
+        uint32_t *page_table_address = get_page_table(virt_addr, page_dir_addr, true);
+        if (page_table_address == NULL) {
+            // a 4 MB page covers it already
+            virt_addr = table_end;
+            continue;
+        }
+        for (uint32_t index = virt_addr_to_page_table_index(virt_addr); virt_addr != table_end; index++, virt_addr += 4096) {
+            if (!is_entry_present(page_table_address[index]))
+                page_table_address[index] = create_page_entry_value(virt_addr, true, 0);
+        }
     }
 }
 
@@ -308,7 +459,7 @@ void *get_page_directory_register() {
 
     __asm__ __volatile__(
         "movl %%cr3, %0\n\t"
-        : "=g"(value)  // output No 0
+        : "=r"(value)  // output No 0, control registers only move to registers
         :              // no input values
         :              // garbled registers
     );
@@ -326,7 +477,7 @@ static void enable_memory_paging_cpu_bit() {
 
     __asm__ __volatile__(
         "mov %%cr0, %%eax\n\t"
-        "or $0x80000000, %%eax\n\t"  // turn on bit 31
+        "or $0x80010000, %%eax\n\t"  // turn on bit 31, and bit 16 (WP), as we run in ring 0
         "mov %%eax, %%cr0"
         :       // no outputs
         :       // no inputs
@@ -334,6 +485,19 @@ static void enable_memory_paging_cpu_bit() {
     );
 }
 
+static void enable_cr4_bits(uint32_t bits) {
+    klog_trace("Setting CR4 bits 0x%x", bits);
+
+    __asm__ __volatile__(
+        "mov %%cr4, %%eax\n\t"
+        "or %0, %%eax\n\t"
+        "mov %%eax, %%cr4"
+        :       // no outputs
+        : "g"(bits)
+        : "eax" // garbled registers
+    );
+}
+
 static void disable_memory_paging_cpu_bit() {
     klog_trace("Disabling memory paging in CPU");
 
@@ -355,12 +519,109 @@ static struct {
     void *end_address;
 } kernel_info;
 
+// page tables of the kernel heap area are created once and shared
+// by all page directories, so that new heap pages are visible everywhere.
+#define HEAP_AREA_TABLES     ((int)(KERNEL_HEAP_AREA_SIZE / (1024 * 4096)))
+#define HEAP_AREA_PD_INDEX   ((int)(KERNEL_HEAP_AREA_START >> 22))
+static uint32_t *kernel_heap_area_tables[HEAP_AREA_TABLES];
+
+// so is the table of the temporary area, a slot is taken by whoever maps a page
+#define TEMP_AREA_PD_INDEX   ((int)(KERNEL_TEMP_AREA_START >> 22))
+#define TEMP_AREA_SLOTS      ((int)(KERNEL_TEMP_AREA_SIZE / 4096))
+static uint32_t *kernel_temp_area_table;
+static uint32_t temp_area_slots_used[TEMP_AREA_SLOTS / 32];
+static bool paging_enabled = false;
+
+// without 4 MB pages, the low memory identity map is made of shared tables as well
+#define LOW_MEMORY_TABLES    ((int)(LOW_MEMORY_IDENTITY_END / (1024 * 4096)))
+static uint32_t *low_memory_tables[LOW_MEMORY_TABLES];
+
+// entries that point to tables of all page directories, not ours to free or clone
+static inline bool is_shared_table_index(int pd_index) {
+    return pd_index < LOW_MEMORY_TABLES ||
+        pd_index == TEMP_AREA_PD_INDEX ||
+        (pd_index >= HEAP_AREA_PD_INDEX && pd_index < HEAP_AREA_PD_INDEX + HEAP_AREA_TABLES);
+}
+
+static uint32_t *create_shared_table() {
+    uint32_t *table = allocate_physical_page((void *)0);
+    set_physical_page_owner(table, PAGE_OWNER_PAGE_TABLE);
+    memset(table, 0, 4096);
+    return table;
+}
+
+static void create_shared_kernel_tables() {
+    for (int i = 0; i < HEAP_AREA_TABLES; i++)
+        kernel_heap_area_tables[i] = create_shared_table();
+    kernel_temp_area_table = create_shared_table();
+
+    if (!large_pages_supported) {
+        for (int i = 0; i < LOW_MEMORY_TABLES; i++) {
+            low_memory_tables[i] = create_shared_table();
+            for (int index = 0; index < 1024; index++) {
+                void *addr = (void *)((i * 1024 + index) * 4096);
+                low_memory_tables[i][index] = create_table_entry_value(
+                    addr, true, false, false, false, true, true, true);
+            }
+        }
+    }
+}
+
+void *map_temporary_page(void *physical_page) {
+    // before paging, physical addresses are all there is
+    if (!paging_enabled)
+        return physical_page;
+
+    pushcli();
+    int slot = -1;
+    for (int i = 0; i < TEMP_AREA_SLOTS / 32 && slot == -1; i++) {
+        if (temp_area_slots_used[i] != 0xFFFFFFFF)
+            slot = i * 32 + __builtin_ctz(~temp_area_slots_used[i]);
+    }
+    if (slot == -1)
+        panic("No free slot in the kernel temporary area");
+    temp_area_slots_used[slot / 32] |= (1 << (slot % 32));
+    kernel_temp_area_table[slot] = create_table_entry_value(
+        physical_page, false, false, false, false, false, true, true);
+    popcli();
+
+    // not global, a cpu that had the slot before us dropped it when it switched CR3
+    void *virtual_address = (void *)(KERNEL_TEMP_AREA_START + slot * 4096);
+    invalidate_paging_cached_address(virtual_address);
+    return virtual_address;
+}
+
+void unmap_temporary_page(void *virtual_address) {
+    if (!paging_enabled)
+        return;
+
+    int slot = ((uint32_t)virtual_address - KERNEL_TEMP_AREA_START) / 4096;
+    pushcli();
+    kernel_temp_area_table[slot] = 0;
+    temp_area_slots_used[slot / 32] &= ~(1 << (slot % 32));
+    popcli();
+    invalidate_paging_cached_address((void *)ROUND_DOWN_4K((uint32_t)virtual_address));
+}
+
 void init_virtual_memory_paging(void *kernel_start_address, void *kernel_end_address) {
     if (physical_page_size() != 4096)
         panic("Virtual memory supports 4KB pages only");
     
     kernel_info.start_address = kernel_start_address;
     kernel_info.end_address = kernel_end_address;
+    if ((uint32_t)kernel_end_address >= LOW_MEMORY_IDENTITY_END)
+        panic("Kernel does not fit in the identity mapped low memory");
+
+    large_pages_supported = cpu_has_features(CPU_FEATURE_PSE);
+    global_pages_supported = cpu_has_features(CPU_FEATURE_PGE);
+    klog_info("CPU support for 4 MB pages: %s, global pages: %s",
+        large_pages_supported ? "yes" : "no",
+        global_pages_supported ? "yes" : "no");
+    if (large_pages_supported)
+        enable_cr4_bits(CR4_PSE_FLAG);
+
+    // paging is not enabled yet, tables can be written directly
+    create_shared_kernel_tables();
 
     // create a page directory for kernel.
     kernel_info.page_directory = create_page_directory(true);
@@ -379,8 +640,11 @@ void init_virtual_memory_paging(void *kernel_start_address, void *kernel_end_add
     // now enable paging (fingers crossed!)
     set_page_directory_register(kernel_info.page_directory);
     enable_memory_paging_cpu_bit();
+    if (global_pages_supported)
+        enable_cr4_bits(CR4_PGE_FLAG);
+    paging_enabled = true;
 
-    klog_debug("Virtual memory paging initialized, range 0x%x - 0x%x will always be identity mapped");
+    klog_debug("Virtual memory paging initialized, range 0x%x - 0x%x will always be identity mapped", 0, LOW_MEMORY_IDENTITY_END - 1);
 }
 
 void *get_kernel_page_directory() {
@@ -401,7 +665,7 @@ void virtual_memory_page_fault_handler(uint32_t error_code) {
     void *page_dir_address = 0;
     __asm__ __volatile__("mov %%cr3, %0" : "=g"(page_dir_address));
 
-    klog_warn("Page fault, %s %s page by %s process, at 0x%x, page dir at 0x%p",
+    klog_debug("Page fault, %s %s page by %s process, at 0x%x, page dir at 0x%p",
         write_attempt ? "writing on" : "reading a",
         page_present ? "protected" : "missing",
         supervisor_code ? "supervisor" : "user",
@@ -409,7 +673,26 @@ void virtual_memory_page_fault_handler(uint32_t error_code) {
         page_dir_address
     );
 
-    // solution for now is to identity map this, just for fun
+    if (memory_address >= KERNEL_HEAP_AREA_START && memory_address < KERNEL_HEAP_AREA_START + KERNEL_HEAP_AREA_SIZE) {
+        klog_crit("Access of unmapped kernel heap area address 0x%x", memory_address);
+        panic("Kernel heap area access out of bounds");
+    }
+    if (memory_address >= KERNEL_TEMP_AREA_START && memory_address < KERNEL_TEMP_AREA_START + KERNEL_TEMP_AREA_SIZE) {
+        klog_crit("Access of unmapped kernel temporary area address 0x%x", memory_address);
+        panic("Kernel temporary area access out of bounds");
+    }
+
+    // pages shared after a fork are copied on the first write
+    if (page_present && write_attempt && handle_copy_on_write_fault((void *)memory_address, page_dir_address))
+        return;
+
+    // stack, heap and segments of processes are populated on first touch,
+    // writing on their read only pages ends the process.
+    // the kernel does not reach pages there by their physical address, the fault is theirs.
+    if (proc_handle_page_fault((void *)memory_address, page_dir_address, page_present))
+        return;
+
+    // device memory, identity mapped on first access
     memory_address = ROUND_DOWN_4K(memory_address);
     map_virtual_address_to_physical((void *)memory_address, (void *)memory_address, page_dir_address, false);
 }
@@ -419,14 +702,29 @@ void virtual_memory_page_fault_handler(uint32_t error_code) {
 
 // allocates and creates a new page directory
 void *create_page_directory(bool map_kernel_space) {
-    void *page_dir = allocate_physical_page((void *)0);
-    memset(page_dir, 0, physical_page_size());
+    void *page_dir = allocate_physical_page_zeroed((void *)0);
+    set_physical_page_owner(page_dir, PAGE_OWNER_PAGE_TABLE);
 
     if (map_kernel_space) {
         // the kernel (code, data, heap etc) must be mapped in the same address in all address spaces.
         // that way, we can switch CR3 and jump into an elf loading function without issues.
         // or execute kerel code, or keep variables and pointers sane when switching tasks
-        identity_map_range(kernel_info.start_address, kernel_info.end_address, page_dir);
+        // the whole low memory is mapped, it includes the kernel and what it reaches by physical address.
+        for (int i = 0; i < LOW_MEMORY_TABLES; i++) {
+            uint32_t value;
+            if (large_pages_supported) // a directory entry, instead of a page table per 4 MB
+                value = create_large_page_directory_entry_value((void *)(i * LARGE_PAGE_SIZE), true);
+            else
+                value = create_directory_entry_value(low_memory_tables[i], false, false, true, true, true);
+            set_table_entry(page_dir, i, value);
+        }
+
+        for (int i = 0; i < HEAP_AREA_TABLES; i++) {
+            uint32_t value = create_directory_entry_value(kernel_heap_area_tables[i], false, false, true, true, true);
+            set_table_entry(page_dir, HEAP_AREA_PD_INDEX + i, value);
+        }
+        set_table_entry(page_dir, TEMP_AREA_PD_INDEX,
+            create_directory_entry_value(kernel_temp_area_table, false, false, true, true, true));
     }
 
     klog_trace("create_page_directory() -> 0x%p", page_dir);
@@ -438,9 +736,83 @@ void *create_page_directory(bool map_kernel_space) {
 void allocate_virtual_memory_range(void *virt_addr_start, void *virt_addr_end, void *page_dir_addr) {
     klog_trace("allocate_virtual_memory_range(0x%p - 0x%p, PD=0x%p)", virt_addr_start, virt_addr_end, page_dir_addr);
 
-    for (void *virt_addr = virt_addr_start; virt_addr < virt_addr_end; virt_addr += 4096) {
-        void *phys_page_addr = allocate_physical_page((void *)0x100000);
-        map_virtual_address_to_physical(virt_addr, phys_page_addr, page_dir_addr, true);
+    // one page table lookup per 4 MB, entries are filled in a tight loop.
+    // pages become present, nothing is cached in the TLB for them to invalidate.
+    void *virt_addr = virt_addr_start;
+    while (virt_addr < virt_addr_end) {
+        void *table_end = next_page_table_boundary(virt_addr, virt_addr_end);
+        uint32_t *page_table_address = get_page_table(virt_addr, page_dir_addr, true);
+        if (page_table_address == NULL) {
+            klog_error("Cannot allocate 0x%p - 0x%p, range is in a 4 MB page", virt_addr, table_end);
+            virt_addr = table_end;
+            continue;
+        }
+        for (uint32_t index = virt_addr_to_page_table_index(virt_addr); virt_addr < table_end; index++, virt_addr += 4096) {
+            if (is_entry_present(page_table_address[index]))
+                continue;
+            // processes never see what a previous owner left in the page
+            void *phys_page_addr = allocate_mapped_physical_page(true);
+            set_physical_page_owner(phys_page_addr, PAGE_OWNER_USER);
+            page_table_address[index] = create_page_entry_value(phys_page_addr, true, PTE_OWNED_PAGE_FLAG);
+        }
+    }
+}
+
+// unmaps the pages of the range, releasing the owned ones
+// end address is non-inclusive
+void release_virtual_memory_range(void *virt_addr_start, void *virt_addr_end, void *page_dir_addr) {
+    klog_trace("release_virtual_memory_range(0x%p - 0x%p, PD=0x%p)", virt_addr_start, virt_addr_end, page_dir_addr);
+
+    void *virt_addr = virt_addr_start;
+    while (virt_addr < virt_addr_end) {
+        void *table_end = next_page_table_boundary(virt_addr, virt_addr_end);
+        uint32_t *page_table_address = get_page_table(virt_addr, page_dir_addr, false);
+        if (page_table_address == NULL) {
+            virt_addr = table_end;
+            continue;
+        }
+        for (uint32_t index = virt_addr_to_page_table_index(virt_addr); virt_addr < table_end; index++, virt_addr += 4096) {
+            uint32_t entry = page_table_address[index];
+            if (!is_entry_present(entry))
+                continue;
+            if (entry & PTE_OWNED_PAGE_FLAG)
+                physical_page_release(get_entry_address(entry));
+            page_table_address[index] = 0;
+        }
+
+        // checked once per table, not once per page
+        if (is_page_table_empty(page_table_address)) {
+            set_table_entry(page_dir_addr, virt_addr_to_page_directory_index(table_end - 4096), 0);
+            free_physical_page(page_table_address);
+        }
+    }
+
+    // a single flush for the whole range
+    invalidate_paging_cached_range(virt_addr_start, virt_addr_end, page_dir_addr);
+}
+
+void map_kernel_heap_area_pages(void *virt_addr, int pages) {
+    klog_trace("map_kernel_heap_area_pages(0x%p, %d)", virt_addr, pages);
+
+    for (int i = 0; i < pages; i++, virt_addr += 4096) {
+        uint32_t offset = (uint32_t)virt_addr - KERNEL_HEAP_AREA_START;
+        uint32_t *table = kernel_heap_area_tables[offset >> 22];
+        void *phys_page_addr = allocate_mapped_physical_page(false);
+        table[virt_addr_to_page_table_index(virt_addr)] = create_table_entry_value(
+            phys_page_addr, true, false, false, false, false, true, true);
+    }
+}
+
+void unmap_kernel_heap_area_pages(void *virt_addr, int pages) {
+    klog_trace("unmap_kernel_heap_area_pages(0x%p, %d)", virt_addr, pages);
+
+    for (int i = 0; i < pages; i++, virt_addr += 4096) {
+        uint32_t offset = (uint32_t)virt_addr - KERNEL_HEAP_AREA_START;
+        uint32_t *table = kernel_heap_area_tables[offset >> 22];
+        uint32_t index = virt_addr_to_page_table_index(virt_addr);
+        free_physical_page(get_entry_address(table[index]));
+        table[index] = 0;
+        invalidate_paging_cached_address(virt_addr);
     }
 }
 
@@ -456,6 +828,14 @@ void destroy_page_directory(void *page_dir_address) {
         if (!is_entry_present(entry))
             continue;
         
+        // shared with all page directories, not ours to free
+        if (is_shared_table_index(pd_index))
+            continue;
+
+        // kernel identity map, no table behind it
+        if (is_large_page_entry(entry))
+            continue;
+
         void *page_table_address = get_entry_address(entry);
         if (page_table_address == NULL)
             continue;
@@ -470,11 +850,12 @@ void destroy_page_directory(void *page_dir_address) {
             if (phys_page_address == 0)
                 continue;
 
-            // we only free our extra pages, not the kernel ones.
-            if (phys_page_address >= kernel_info.start_address && phys_page_address <= kernel_info.end_address)
+            // we only free our pages, not the kernel ones, or whatever was identity mapped
+            if ((entry & PTE_OWNED_PAGE_FLAG) == 0)
                 continue;
 
-            free_physical_page(phys_page_address);
+            // pages may be shared with other address spaces
+            physical_page_release(phys_page_address);
         }
 
         free_physical_page(page_table_address);
@@ -485,6 +866,51 @@ void destroy_page_directory(void *page_dir_address) {
     popcli();
 }
 
+void *clone_page_directory_copy_on_write(void *page_dir_address, void *skip_start, void *skip_end) {
+    klog_trace("clone_page_directory_copy_on_write(0x%p)", page_dir_address);
+    void *clone = create_page_directory(true);
+    pushcli();
+
+    for (int pd_index = 0; pd_index < 1024; pd_index++) {
+        uint32_t entry = get_table_entry(page_dir_address, pd_index);
+        if (!is_entry_present(entry) || is_large_page_entry(entry) || is_shared_table_index(pd_index))
+            continue;
+
+        void *page_table_address = get_entry_address(entry);
+        for (int pt_index = 0; pt_index < 1024; pt_index++) {
+            entry = get_table_entry(page_table_address, pt_index);
+            if (!is_entry_present(entry))
+                continue;
+            void *virt_addr = (void *)(uint32_t)(SET_BIT_RANGE(pd_index, 31, 22) | SET_BIT_RANGE(pt_index, 21, 12));
+            if (virt_addr >= skip_start && virt_addr < skip_end)
+                continue;
+
+            // identity mappings of kernel and device memory are just repeated
+            if ((entry & PTE_OWNED_PAGE_FLAG) == 0) {
+                map_virtual_address_to_physical(virt_addr, get_entry_address(entry), clone, true);
+                continue;
+            }
+
+            // both sides read the same page, until one of them writes to it.
+            // shared memory pages stay writable, writes are meant to be seen by both.
+            if ((entry & PTE_WRITABLE_FLAG) && (entry & PTE_SHARED_MEMORY_FLAG) == 0) {
+                entry = (entry & ~PTE_WRITABLE_FLAG) | PTE_COPY_ON_WRITE_FLAG;
+                set_table_entry(page_table_address, pt_index, entry);
+            }
+            physical_page_add_ref(get_entry_address(entry));
+            void *clone_table = get_page_table(virt_addr, clone, true);
+            set_table_entry(clone_table, pt_index, entry);
+        }
+    }
+
+    // entries were made read only, drop what the TLB remembers (global kernel pages survive)
+    if (get_page_directory_register() == page_dir_address)
+        set_page_directory_register(page_dir_address);
+
+    popcli();
+    return clone;
+}
+
 static void _dump_page_directory_print(uint32_t virt_mem_group_start, uint32_t virt_mem_group_end, uint32_t phys_mem_group_start, uint32_t phys_mem_group_end) {
 
     if (virt_mem_group_start == virt_mem_group_end) {
@@ -567,6 +993,14 @@ void dump_page_directory(void *page_dir_address) {
         entry = get_table_entry(page_dir_address, pd_index);
         if (!is_entry_present(entry))
             continue;
+
+        if (is_large_page_entry(entry)) {
+            uint32_t virtual_address = SET_BIT_RANGE(pd_index, 31, 22);
+            uint32_t physical_address = entry & 0xFFC00000;
+            for (uint32_t offset = 0; offset < LARGE_PAGE_SIZE; offset += 4096)
+                _dump_page_directory_aggregate(2, virtual_address + offset, physical_address + offset);
+            continue;
+        }
         
         void *page_table_address = get_entry_address(entry);
         if (page_table_address == NULL)
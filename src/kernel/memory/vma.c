@@ -0,0 +1,240 @@
+#include <errors.h>
+#include <klog.h>
+#include <bits.h>
+#include <klib/string.h>
+#include <filesys/vfs.h>
+#include <memory/kheap.h>
+#include <memory/physmem.h>
+#include <memory/virtmem.h>
+#include <memory/vma.h>
+#include <memory/imgcache.h>
+
+MODULE("VMA");
+
+#define max(a, b)   ((a) > (b) ? (a) : (b))
+#define min(a, b)   ((a) < (b) ? (a) : (b))
+
+
+vma_t *vma_add(vma_t **list, enum vma_type type, uint8_t flags, void *start, void *end) {
+    vma_t *vma = kmalloc(sizeof(vma_t));
+    memset(vma, 0, sizeof(vma_t));
+    vma->type = type;
+    vma->flags = flags;
+    vma->start = (void *)ROUND_DOWN_4K((uint32_t)start);
+    vma->end = (void *)ROUND_UP_4K((uint32_t)end);
+
+    // keep the list sorted by address, for dumping
+    vma_t **pp = list;
+    while (*pp != NULL && (*pp)->start < vma->start)
+        pp = &(*pp)->next;
+    vma->next = *pp;
+    *pp = vma;
+
+    klog_trace("vma_add(type=%d, 0x%p - 0x%p)", type, vma->start, vma->end);
+    return vma;
+}
+
+vma_t *vma_find(vma_t *list, void *address) {
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        if (address >= vma->start && address < vma->end)
+            return vma;
+    }
+    return NULL;
+}
+
+vma_t *vma_find_type(vma_t *list, enum vma_type type) {
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        if (vma->type == type)
+            return vma;
+    }
+    return NULL;
+}
+
+// a page can be shared among processes, if it only holds read only parts of the executable.
+// it is writable if any of the areas it holds is writable.
+static void get_page_access(vma_t *list, void *page_address, bool *shareable, bool *writable) {
+    bool executable_only = true;
+    *writable = false;
+
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        if (vma->start >= page_address + 4096 || vma->end <= page_address)
+            continue;
+        if (vma->flags & VMA_WRITABLE)
+            *writable = true;
+        if (vma->type != VMA_ELF_SEGMENT)
+            executable_only = false;
+    }
+    *shareable = executable_only && !*writable;
+}
+
+// reads into the physical page the parts of the file backed areas that overlap the virtual one
+static int load_file_parts(vma_t *list, file_t *file, void *page_address, void *contents) {
+    int err;
+
+    // segments are not always page aligned, a page may hold the end of one and the start of another
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        if (vma->file_size == 0)
+            continue;
+        file_t *source = vma->file != NULL ? vma->file : file;
+        void *from = max(page_address, vma->file_vaddr);
+        void *to = min(page_address + 4096, vma->file_vaddr + vma->file_size);
+        if (from >= to)
+            continue;
+        if (source == NULL)
+            return ERR_BAD_ARGUMENT;
+
+        err = vfs_seek(source, vma->file_offset + (from - vma->file_vaddr), SEEK_START);
+        if (err < 0)
+            return err;
+        err = vfs_read(source, contents + (from - page_address), to - from);
+        if (err < 0)
+            return err;
+        if (err != to - from)
+            return ERR_READING_FILE;
+    }
+
+    return SUCCESS;
+}
+
+void *vma_find_free_range(vma_t *list, uint32_t size, void *low, void *high) {
+    void *candidate = low;
+    size = ROUND_UP_4K(size);
+
+    // the list is sorted, try the gap before each area
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        if (vma->end <= candidate)
+            continue;
+        if (vma->start >= candidate + size)
+            break;
+        candidate = vma->end;
+    }
+
+    if (candidate + size > high || candidate + size < candidate)
+        return NULL;
+    return candidate;
+}
+
+static void release_vma_backing(vma_t *vma) {
+    if (vma->shared != NULL) {
+        shmem_release(vma->shared);
+        vma->shared = NULL;
+    }
+    if (vma->file == NULL)
+        return;
+    vfs_close(vma->file);
+    destroy_file_t(vma->file);
+    vma->file = NULL;
+}
+
+void vma_remove(vma_t **list, vma_t *vma) {
+    vma_t **pp = list;
+    while (*pp != NULL && *pp != vma)
+        pp = &(*pp)->next;
+    if (*pp == NULL)
+        return;
+
+    *pp = vma->next;
+    release_vma_backing(vma);
+    kfree(vma);
+}
+
+int vma_populate_page(vma_t *list, file_t *file, void *page_address) {
+    page_address = (void *)ROUND_DOWN_4K((uint32_t)page_address);
+    void *page_dir = get_page_directory_register();
+    bool shareable;
+    bool writable;
+    int err;
+
+    // every process mapping the shared memory gets the same page
+    vma_t *vma = vma_find(list, page_address);
+    if (vma != NULL && vma->shared != NULL) {
+        void *shared_page = shmem_get_page(vma->shared, page_address - vma->start);
+        if (shared_page == NULL)
+            return ERR_BAD_ARGUMENT;
+        if (vma->flags & VMA_WRITABLE)
+            map_shared_memory_page(page_address, shared_page, page_dir);
+        else
+            map_shared_page(page_address, shared_page, page_dir);
+        return SUCCESS;
+    }
+
+    get_page_access(list, page_address, &shareable, &writable);
+    shareable = shareable && file != NULL;
+
+    // another process running the same executable may have loaded it already
+    if (shareable) {
+        void *cached_page = imgcache_get_page(file, page_address);
+        if (cached_page != NULL) {
+            map_shared_page(page_address, cached_page, page_dir);
+            return SUCCESS;
+        }
+    }
+
+    // filled before it is mapped, as it may end up read only. not through its physical address,
+    // that may be in an area of this very process, the read would fault and land elsewhere.
+    void *phys_page = allocate_mapped_physical_page(true);
+    set_physical_page_owner(phys_page, PAGE_OWNER_USER);
+    void *contents = map_temporary_page(phys_page);
+    err = load_file_parts(list, file, page_address, contents);
+    unmap_temporary_page(contents);
+    if (err) {
+        physical_page_release(phys_page);
+        return err;
+    }
+
+    if (shareable) {
+        imgcache_put_page(file, page_address, phys_page);
+        map_shared_page(page_address, phys_page, page_dir);
+    } else if (writable) {
+        map_owned_page(page_address, phys_page, page_dir);
+    } else {
+        map_shared_page(page_address, phys_page, page_dir);
+    }
+    return SUCCESS;
+}
+
+vma_t *vma_clone_all(vma_t *list) {
+    vma_t *clone = NULL;
+    vma_t **tail = &clone;
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        vma_t *copy = kmalloc(sizeof(vma_t));
+        *copy = *vma;
+        copy->next = NULL;
+
+        // each side reads through its own file position
+        if (vma->file != NULL && vfs_reopen(vma->file, &copy->file) != SUCCESS) {
+            klog_error("Cannot reopen mapped file, area 0x%p - 0x%p will be zero filled", vma->start, vma->end);
+            copy->file = NULL;
+            copy->file_size = 0;
+        }
+        if (vma->shared != NULL)
+            shmem_add_ref(vma->shared);
+        *tail = copy;
+        tail = &copy->next;
+    }
+    return clone;
+}
+
+void vma_free_all(vma_t **list) {
+    while (*list != NULL) {
+        vma_t *vma = *list;
+        *list = vma->next;
+        release_vma_backing(vma);
+        kfree(vma);
+    }
+}
+
+void vma_dump(vma_t *list) {
+    char *types[] = { "stack", "heap", "segment", "mmap" };
+    for (vma_t *vma = list; vma != NULL; vma = vma->next) {
+        klog_debug("  0x%08x - 0x%08x %c%c%c %-7s file ofs 0x%x, %u bytes",
+            vma->start, vma->end,
+            vma->flags & VMA_WRITABLE ? 'W' : '-',
+            vma->flags & VMA_EXECUTABLE ? 'X' : '-',
+            vma->shared != NULL ? 'S' : '-',
+            types[vma->type],
+            vma->file_offset,
+            vma->file_size
+        );
+    }
+}
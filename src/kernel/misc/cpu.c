@@ -1,6 +1,8 @@
 #include <ctypes.h>
 #include <drivers/screen.h>
 #include <cpu.h>
+#include <lock.h>
+#include <smp.h>
 
 #define INTERRUPT_ENABLE_FLAG 0x00000200 // Interrupt Enable
 
@@ -88,8 +90,38 @@ inline bool interrupts_enabled(void) {
 }
 
 
-static int cli_depth = 0;
-static uint8_t zero_depth_enabled = 0;
+void cpuid(uint32_t leaf, uint32_t *eax, uint32_t *ebx, uint32_t *ecx, uint32_t *edx) {
+    __asm__ __volatile__("cpuid"
+        : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+        : "a"(leaf), "c"(0)
+    );
+}
+
+bool cpu_has_features(uint32_t features) {
+    static bool detected = false;
+    static uint32_t features_edx = 0;
+
+    if (!detected) {
+        uint32_t eax, ebx, ecx, edx;
+        if (get_cpuid_availability()) {
+            cpuid(0, &eax, &ebx, &ecx, &edx);
+            if (eax >= 1) {
+                cpuid(1, &eax, &ebx, &ecx, &edx);
+                features_edx = edx;
+            }
+        }
+        detected = true;
+    }
+
+    return (features_edx & features) == features;
+}
+
+
+// the outermost pushcli() on a cpu also takes the kernel lock. code that keeps
+// interrupts out with pushcli() keeps the other cpus out as well, that is how
+// the heap, the page frames and the scheduler stay consistent on SMP.
+// the depth is per cpu, a context switch keeps the lock held, see schedule().
+static lock_t kernel_lock = 0;
 
 
 // Pushcli/popcli are like cli/sti except that they are matched:
@@ -97,26 +129,36 @@ static uint8_t zero_depth_enabled = 0;
 // are off, then pushcli, popcli leaves them off.
 
 void pushcli(void) {
-    if (cli_depth == 0)
-        zero_depth_enabled = interrupts_enabled();
+    bool enabled = interrupts_enabled();
 
     // we must cli() unconditionally, if we checked 
     // and then cleared, then we'd have a race condition!
+    // it also keeps us on this cpu, until the matching popcli()
     cli(); 
-    cli_depth++;
+
+    cpu_t *cpu = smp_this_cpu();
+    if (cpu->cli_depth == 0) {
+        acquire(&kernel_lock);
+        cpu->zero_depth_enabled = enabled;
+    }
+    cpu->cli_depth++;
 }
 
 
 void popcli(void) {
-    if (cli_depth <= 0)
+    cpu_t *cpu = smp_this_cpu();
+    if (cpu->cli_depth <= 0)
         panic("popcli() without pushcli()");
 
     if (interrupts_enabled())
         panic("Interrupts enabled when popcli() called");
 
-    cli_depth--;
-    if (cli_depth == 0 && zero_depth_enabled)
-        sti();
+    cpu->cli_depth--;
+    if (cpu->cli_depth == 0) {
+        release(&kernel_lock);
+        if (cpu->zero_depth_enabled)
+            sti();
+    }
 }
 
 
@@ -153,3 +195,26 @@ void enable_nmi() {
     inb(0x71);
 
 }
+
+uint64_t rdtsc() {
+    uint32_t low, high;
+    __asm__ __volatile__("rdtsc" : "=a"(low), "=d"(high));
+    return ((uint64_t)high << 32) | low;
+}
+
+void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
+}
+
+bool cpu_has_sysenter() {
+    if (!cpu_has_features(CPU_FEATURE_SEP | CPU_FEATURE_MSR))
+        return false;
+
+    // family 6, model < 3, stepping < 3
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
@@ -7,6 +7,7 @@
 #include <klib/string.h>
 #include <multitask/process.h>
 #include <devices/tty.h>
+#include <elf.h>
 
 MODULE("ELF");
 
@@ -312,6 +313,69 @@ exit:
     return err;
 }
 
+// fills up to max_segments loadable segments, returns their count or a negative error
+int get_elf_loadable_segments(file_t *file, elf_segment_t *segments, int max_segments) {
+    klog_trace("get_elf_loadable_segments(\"%s\")", file->descriptor->name);
+
+    elf32_header_t *elf_header = NULL;
+    char *prg_headers = NULL;
+    int err;
+
+    elf_header = kmalloc(sizeof(elf32_header_t));
+
+    err = vfs_seek(file, 0, SEEK_START);
+    if (err < 0) goto exit;
+
+    err = vfs_read(file, (char *)elf_header, sizeof(elf32_header_t));
+    if (err != sizeof(elf32_header_t)) {
+        err = ERR_READING_FILE;
+        goto exit;
+    }
+
+    // we don't support dynamically linked executables for now.
+    if (elf_header->type != ELF_TYPE_EXECUTABLE) {
+        err = ERR_NOT_SUPPORTED;
+        goto exit;
+    }
+
+    int prg_hdr_bytes = elf_header->phnum * elf_header->phentsize;
+    prg_headers = kmalloc(prg_hdr_bytes);
+
+    err = vfs_seek(file, elf_header->phoff, SEEK_START);
+    if (err < 0) goto exit;
+
+    err = vfs_read(file, prg_headers, prg_hdr_bytes);
+    if (err < 0) goto exit;
+
+    int count = 0;
+    for (int i = 0; i < elf_header->phnum; i++) {
+        elf32_program_header_t *program = (elf32_program_header_t *)(prg_headers + (i * elf_header->phentsize));
+        if (program->p_type != PT_LOAD || program->p_memsz == 0)
+            continue;
+        if (count == max_segments) {
+            err = ERR_NOT_SUPPORTED;
+            goto exit;
+        }
+
+        segments[count].vaddr = (void *)program->p_vaddr;
+        segments[count].memory_size = program->p_memsz;
+        segments[count].file_offset = program->p_offset;
+        segments[count].file_size = min(program->p_filesz, program->p_memsz);
+        segments[count].writable = (program->p_flags & PF_WRITE) != 0;
+        segments[count].executable = (program->p_flags & PF_EXEC) != 0;
+        count++;
+    }
+
+    err = count;
+
+exit:
+    if (elf_header != NULL)
+        kfree(elf_header);
+    if (prg_headers != NULL)
+        kfree(prg_headers);
+    return err;
+}
+
 
 static void dump_elf_header(elf32_header_t *header);
 static void dump_elf_section_header(bool title_line, int num, elf32_section_header_t *section, char *names_data);
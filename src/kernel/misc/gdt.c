@@ -1,5 +1,7 @@
 #include <klib/string.h>
 #include <klog.h>
+#include <gdt.h>
+#include <smp.h>
 
 // Each define here is for a specific flag in the descriptor.
 // Refer to the intel documentation for a description of what each one does.
@@ -31,7 +33,7 @@ struct gdt_segment_descriptor32 {
     uint8_t  access;
     uint8_t  limit_high_4bits: 4;
     uint8_t  flags: 4;
-    uint8_t  base_4th_byte: 1;
+    uint8_t  base_4th_byte;
 } __attribute__((packed));
 
 struct gdt_descriptor32 {
@@ -44,8 +46,9 @@ struct gdt_descriptor64 {
     uint64_t offset;
 } __attribute__((packed));
 
-struct gdt_segment_descriptor32 descriptors[5];
-struct gdt_descriptor32 gdt;
+// the ones all cpus share, copied into each cpu's own table
+#define COMMON_ENTRIES   5
+struct gdt_segment_descriptor32 descriptors[COMMON_ENTRIES];
 
 
 // this method defined in assembly
@@ -62,19 +65,23 @@ extern void load_gdt_descriptor(uint32_t);
 // | 4th byte | 4 bits   | hi 4 bits | 8 bits   | 3rd byte | 2nd byte | low byte | 2nd byte | low byte |
 // +----------+----------+-----------+----------+----------+----------+----------+----------+----------+
 // see also https://github.com/programmingmind/OS/blob/master/tables.c
-void set_descriptor(uint8_t entry, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+static void set_table_descriptor(struct gdt_segment_descriptor32 *table, uint8_t entry, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
     if (limit > 65536) {
         limit = limit >> 12; // now measuring in 4kb chunks instead of bytes
         flags |= FLAGS_GRANULARITY(1);
     }
 
-    descriptors[entry].limit_low16 = limit & 0xFFFF;
-    descriptors[entry].base_low16 = base & 0xFFFF;
-    descriptors[entry].base_3rd_byte = (base >> 16) & 0xFF;
-    descriptors[entry].access = access;
-    descriptors[entry].limit_high_4bits = (limit >> 16) & 0x0F;
-    descriptors[entry].flags = flags;
-    descriptors[entry].base_4th_byte = (base >> 24) & 0xFF;
+    table[entry].limit_low16 = limit & 0xFFFF;
+    table[entry].base_low16 = base & 0xFFFF;
+    table[entry].base_3rd_byte = (base >> 16) & 0xFF;
+    table[entry].access = access;
+    table[entry].limit_high_4bits = (limit >> 16) & 0x0F;
+    table[entry].flags = flags;
+    table[entry].base_4th_byte = (base >> 24) & 0xFF;
+}
+
+void set_descriptor(uint8_t entry, uint32_t base, uint32_t limit, uint8_t access, uint8_t flags) {
+    set_table_descriptor(descriptors, entry, base, limit, access, flags);
 }
 
 
@@ -120,10 +127,43 @@ void init_gdt() {
         FLAGS_SIZE(1));
 
     klog_debug("Size of GDT segment descriptor: %d", sizeof(struct gdt_segment_descriptor32));  // 8
-    klog_debug("Size of all descriptors: %d", sizeof(descriptors));                             // 24
+    klog_debug("Size of all descriptors: %d", sizeof(descriptors));                             // 40
     klog_debug("Size of GDT descriptor: %d", sizeof(struct gdt_descriptor32));                  // 6
 
-    gdt.size = sizeof(descriptors);
-    gdt.offset = (uint32_t)descriptors;
+    load_cpu_gdt(smp_bootstrap_cpu());
+}
+
+// the common segments, then this cpu's TSS (0x28) and its data segment (0x30).
+// GS keeps the data segment from now on, that is how smp_this_cpu() finds its cpu_t.
+void load_cpu_gdt(cpu_t *cpu) {
+    struct gdt_segment_descriptor32 *table = (struct gdt_segment_descriptor32 *)cpu->gdt;
+    memcpy(table, descriptors, sizeof(descriptors));
+    cpu->self = cpu;
+
+    memset(&cpu->tss, 0, sizeof(tss_t));
+    cpu->tss.ss0 = KERNEL_DATA_SELECTOR;
+    cpu->tss.iomap_base = sizeof(tss_t);  // no I/O permission bitmap
+
+    // a 32 bits available TSS is a system descriptor of type 0x9
+    set_table_descriptor(table, TSS_SELECTOR / 8,
+        (uint32_t)&cpu->tss,
+        sizeof(tss_t) - 1,
+        ACCESS_PRESENT(1) | ACCESS_DESCRIPTOR_TYPE(0) | ACCESS_EXECUTABLE(1) | ACCESS_ACCESSED(1),
+        0);
+
+    set_table_descriptor(table, PER_CPU_DATA_SELECTOR / 8,
+        (uint32_t)cpu,
+        sizeof(cpu_t) - 1,
+        ACCESS_PRESENT(1) | ACCESS_DESCRIPTOR_TYPE(1) | ACCESS_EXECUTABLE(0) | 
+        ACCESS_DATA_WRITABLE(1) | ACCESS_PRIVILEGE(0),
+        FLAGS_SIZE(1));
+
+    // the cpu reads it only while loading, it can live on the stack
+    struct gdt_descriptor32 gdt;
+    gdt.size = sizeof(cpu->gdt) - 1;
+    gdt.offset = (uint32_t)table;
     load_gdt_descriptor((uint32_t)&gdt);
+
+    __asm__ __volatile__("ltr %w0" : : "r"(TSS_SELECTOR));
+    __asm__ __volatile__("mov %w0, %%gs" : : "r"(PER_CPU_DATA_SELECTOR));
 }
@@ -1,5 +1,8 @@
 #include <klib/string.h>
 #include <klog.h>
+#include <cpu.h>
+#include <idt.h>
+#include <smp.h>
 
 
 // for documentation, see https://wiki.osdev.org/IDT
@@ -113,7 +116,10 @@ extern void irq44();
 extern void irq45();
 extern void irq46();
 extern void irq47();
+extern void irq64();
+extern void irq65();
 extern void isr0x80();
+extern void sysenter_entry();
 
 // defined in assembly
 extern void load_idt_descriptor(uint32_t);
@@ -131,6 +137,24 @@ void set_gate(uint8_t entry, uint32_t offset, uint16_t selector, uint8_t gate_ty
 }
 
 
+// sysenter_entry leaves this stack right away, only an NMI could land here
+#define SYSENTER_STACK_SIZE   512
+static uint8_t sysenter_stacks[MAX_CPUS][SYSENTER_STACK_SIZE] __attribute__((aligned(16)));
+
+// the fast syscall path, libc uses it when the cpu supports it.
+// the MSRs are per cpu, application processors call this for themselves.
+void init_sysenter(uint16_t code_segment_selector) {
+    if (!cpu_has_sysenter()) {
+        klog_info("No SYSENTER support, syscalls will use INT 0x80");
+        return;
+    }
+    uint8_t *stack = sysenter_stacks[smp_this_cpu_index()];
+    wrmsr(MSR_SYSENTER_CS, code_segment_selector);
+    wrmsr(MSR_SYSENTER_ESP, (uint32_t)(stack + SYSENTER_STACK_SIZE));
+    wrmsr(MSR_SYSENTER_EIP, (uint32_t)sysenter_entry);
+    klog_info("SYSENTER configured for syscalls on cpu %d", smp_this_cpu_index());
+}
+
 // prepares and loads the Interrupt Descriptor Table
 void init_idt(uint16_t code_segment_selector) {
 
@@ -186,7 +210,11 @@ void init_idt(uint16_t code_segment_selector) {
     set_gate(46, (uint32_t)irq46, code_segment_selector, GATE_TYPE_32BIT_INTERRUPT, 0);
     set_gate(47, (uint32_t)irq47, code_segment_selector, GATE_TYPE_32BIT_INTERRUPT, 0);
 
+    set_gate(LAPIC_TIMER_VECTOR, (uint32_t)irq64, code_segment_selector, GATE_TYPE_32BIT_INTERRUPT, 0);
+    set_gate(RESCHEDULE_VECTOR,  (uint32_t)irq65, code_segment_selector, GATE_TYPE_32BIT_INTERRUPT, 0);
+
     set_gate(0x80, (uint32_t)isr0x80, code_segment_selector, GATE_TYPE_32BIT_INTERRUPT, 0);
+    init_sysenter(code_segment_selector);
 
     idt_descriptor.size = sizeof(gates) - 1;
     idt_descriptor.offset = (uint32_t)gates;
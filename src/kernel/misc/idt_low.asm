@@ -20,7 +20,7 @@ isr_common_stub:
    mov ds, ax
    mov es, ax
    mov fs, ax
-   mov gs, ax
+   ; gs is left alone, it points to the per cpu data, see gdt.c
 
    ; as a debugging aid, try to print something at top of screen, then halt
    ; mov byte [gs:0xb8000], '['
@@ -34,7 +34,6 @@ isr_common_stub:
    mov ds, ax
    mov es, ax
    mov fs, ax
-   mov gs, ax
 
    popa                     ; Pops edi,esi,ebp...
    add esp, 8     ; Cleans up the pushed error code and pushed ISR number
@@ -124,6 +123,10 @@ IRQ 45
 IRQ 46
 IRQ 47
 
+; local APIC interrupts, see smp.h
+IRQ 64
+IRQ 65
+
 
 
 
@@ -136,6 +139,10 @@ IRQ 47
 isr0x80:
   cli
 
+  ; C code preserves EBP anyway, but forked children return
+  ; through a copy of this frame, see isr0x80_forked_child below
+  push ebp
+
   ; in our libc, the syscall() method puts the arguments in:
   ; eax=sysno, ebx, ecx, edx, esi, edi = args 1-5
   ; pushing them so that our C isr handler can find them as arguments
@@ -155,7 +162,7 @@ isr0x80:
   mov ds, dx
   mov es, dx
   mov fs, dx
-  mov gs, dx
+  ; gs is left alone, it points to the per cpu data, see gdt.c
 
   ; as a debugging aid, try to print something at top of screen, then halt
   ; mov byte [gs:0xb8000], '['
@@ -165,17 +172,48 @@ isr0x80:
 
   call isr_syscall
 
+isr0x80_return:
   ; restore the original segment descriptors, without affecting eax (return value)
   pop edx
   mov ds, dx
   mov es, dx
   mov fs, dx
-  mov gs, dx
 
   ; we have to clean up the values we pushed,
   ; but without affecting eax, which contains the return value
   ; we pushed 6 variables of 4 bytes each, so add 24 to esp
   add esp, 24
+  pop ebp
 
   sti
   iret           ; pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP
+
+
+[GLOBAL sysenter_entry]
+
+; SYSENTER arrives here, with interrupts disabled and ESP loaded from the MSR.
+; programs run in ring 0 too, so there is no SYSEXIT (it only returns to ring 3).
+; instead, libc pushes EFLAGS, CS and the return address, the same frame
+; an INT 0x80 would push, and passes that ESP in EBP. we go back to that stack,
+; and continue as isr0x80, whose IRET returns to libc.
+sysenter_entry:
+  mov esp, ebp
+  jmp isr0x80
+
+
+[GLOBAL isr0x80_forked_child]
+[EXTERN unlock_scheduler_in_new_process]
+
+; A forked child is first switched in here, with the stack pointing
+; to its copy of the parent's syscall frame (the pushed DS value first).
+; Like any newly started process, it has to unlock the scheduler.
+; It then returns from the syscall, with the registers the parent had
+; when it called fork(), except EAX, which is zero for the child.
+isr0x80_forked_child:
+  call unlock_scheduler_in_new_process
+
+  mov edi, [esp + 4]
+  mov esi, [esp + 8]
+  mov ebx, [esp + 20]
+  xor eax, eax
+  jmp isr0x80_return
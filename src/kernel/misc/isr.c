@@ -8,12 +8,38 @@
 #include <klog.h>
 #include <bits.h>
 #include <multitask/multitask.h>
+#include <cpu.h>
+#include <smp.h>
 
 
 MODULE("ISR");
 
 
 void isr_handler(registers_t regs) {
+    // the local APIC ones do not go through the PIC. acknowledge them first,
+    // the handlers may switch to another process, that returns here much later
+    if (regs.int_no == LAPIC_TIMER_VECTOR || regs.int_no == RESCHEDULE_VECTOR) {
+        smp_lapic_eoi();
+        if (regs.int_no == LAPIC_TIMER_VECTOR) {
+            multitasking_timer_ticked();
+        } else {
+            if (smp_this_cpu()->bootstrap)
+                timer_leave_tickless();
+            multitasking_reschedule_requested();
+        }
+        return;
+    }
+
+    // device handlers assume nobody else touches their data,
+    // pushcli() keeps the other cpus out too, see cpu.c
+    bool device_irq = (regs.int_no >= 0x20 && regs.int_no < 0x30);
+    if (device_irq)
+        pushcli();
+
+    // device interrupts end the tickless idle, their handlers need the current time
+    if (regs.int_no > 0x20 && regs.int_no < 0x30)
+        timer_leave_tickless();
+
     // don't forget we have mapped IRQs 0+ to 0x20+
     // to avoid the first 0x1F interrupts that are CPU faults in protected mode
     switch (regs.int_no) {
@@ -29,7 +55,6 @@ void isr_handler(registers_t regs) {
             break;
         case 0x0E:
             // Page Fault: https://wiki.osdev.org/Exceptions#Page_Fault
-            klog_warn("Page fault detected");
             virtual_memory_page_fault_handler(regs.err_code);
             break;
         case 0x0D:
@@ -86,6 +111,9 @@ void isr_handler(registers_t regs) {
             );
     }
 
+    if (device_irq)
+        popcli();
+
     // we need to send end-of-interrupt acknowledgement 
     // to the PIC, to enable subsequent interrupts
     pic_send_eoi(regs.int_no);
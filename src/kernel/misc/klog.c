@@ -47,6 +47,12 @@ static log_level_t default_module_level;
 
 
 static void memlog_write(char *str);
+// timestamp in usecs, to see where the time goes
+static void format_preamble(char *buff, int size, const char *module_name, log_level_t level) {
+    uint64_t usecs = clock_monotonic_ns() / 1000;
+    sprintfn(buff, size, "[%u.%06u] %s %s: ", (uint32_t)(usecs / 1000000), (uint32_t)(usecs % 1000000), module_name, level_captions[level]);
+}
+
 static void memory_log_append(const char *module_name, log_level_t level, char *str);
 static void screen_log_append(const char *module_name, log_level_t level, char *str, bool decorated);
 static void serial_log_append(const char *module_name, log_level_t level, char *str, bool decorated);
@@ -216,8 +222,7 @@ static void memory_log_append(const char *module_name, log_level_t level, char *
 
     // first write preamble
     char buff[128];
-    uint32_t msecs = (uint32_t)timer_get_uptime_msecs();
-    sprintfn(buff, sizeof(buff), "[%u.%03u] %s %s: ", msecs / 1000, msecs % 1000, module_name, level_captions[level]);
+    format_preamble(buff, sizeof(buff), module_name, level);
 
     memlog_write(buff);
     memlog_write(str);
@@ -249,8 +254,7 @@ static void serial_log_append(const char *module_name, log_level_t level, char *
 
     if (decorated) {
         char buff[128];
-        uint32_t msecs = (uint32_t)timer_get_uptime_msecs();
-        sprintfn(buff, sizeof(buff), "[%u.%03u] %s %s: ", msecs / 1000, msecs % 1000, module_name, level_captions[level]);
+        format_preamble(buff, sizeof(buff), module_name, level);
         serial_write(buff);
     }
     serial_write(str);
@@ -271,8 +275,7 @@ static void tty_log_append(const char *module_name, log_level_t level, char *str
 
     if (decorated) {
         char buff[128];
-        uint32_t msecs = (uint32_t)timer_get_uptime_msecs();
-        sprintfn(buff, sizeof(buff), "[%u.%03u] %s %s: ", msecs / 1000, msecs % 1000, module_name, level_captions[level]);
+        format_preamble(buff, sizeof(buff), module_name, level);
         tty_write_specific_tty(tty_appender, buff);
     }
     tty_write_specific_tty(tty_appender, str);
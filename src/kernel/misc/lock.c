@@ -1,15 +1,153 @@
+#include <ctypes.h>
 #include <lock.h>
+#include <cpu.h>
+#include <klib/string.h>
+#include <drivers/timer.h>
 
 
+// the two halves of a ticket lock, x86 is little endian
+#define NEXT_TICKET(lock)      ((volatile uint16_t *)(lock))
+#define NOW_SERVING(lock)      ((volatile uint16_t *)(lock) + 1)
+
+// spin a little longer for each waiter ahead of us, not to hammer the cache line
+#define BACKOFF_PAUSES_PER_WAITER   16
+
+#define compiler_barrier()     __asm__ __volatile__("" ::: "memory")
+
+
+#ifdef LOCK_STATS
+static lock_stats_t stats_table[LOCK_STATS_MAX_LOCKS];
+static int stats_count = 0;
+
+static lock_stats_t *find_stats(void *lock) {
+    for (int i = 0; i < stats_count; i++) {
+        if (stats_table[i].lock == lock)
+            return &stats_table[i];
+    }
+    return NULL;
+}
+
+// called while holding the lock, so the entry is ours to update
+void lock_stats_acquired(void *lock, uint32_t spins) {
+    lock_stats_t *stats = find_stats(lock);
+    if (stats == NULL)
+        return;
+    stats->acquisitions++;
+    if (spins > 0)
+        stats->contended++;
+    stats->spins += spins;
+    stats->acquired_at = clock_monotonic_ns();
+}
+
+void lock_stats_releasing(void *lock) {
+    lock_stats_t *stats = find_stats(lock);
+    if (stats == NULL)
+        return;
+    uint64_t held = clock_monotonic_ns() - stats->acquired_at;
+    stats->hold_nsecs += held;
+    if (held > stats->max_hold_nsecs)
+        stats->max_hold_nsecs = held;
+}
+
+void lock_stats_register(void *lock, const char *name) {
+    pushcli();
+    if (find_stats(lock) == NULL && stats_count < LOCK_STATS_MAX_LOCKS) {
+        memset(&stats_table[stats_count], 0, sizeof(lock_stats_t));
+        stats_table[stats_count].lock = lock;
+        stats_table[stats_count].name = name;
+        stats_count++;
+    }
+    popcli();
+}
+
+void lock_stats_unregister(void *lock) {
+    pushcli();
+    lock_stats_t *stats = find_stats(lock);
+    if (stats != NULL)
+        *stats = stats_table[--stats_count];
+    popcli();
+}
+
+int lock_stats_snapshot(lock_stats_t *stats, int max_entries) {
+    pushcli();
+    int count = stats_count < max_entries ? stats_count : max_entries;
+    memcpy(stats, stats_table, count * sizeof(lock_stats_t));
+    popcli();
+    return count;
+}
+#else
+int lock_stats_snapshot(lock_stats_t *stats, int max_entries) {
+    return 0;
+}
+#endif
+
 
 void acquire(lock_t* lock) {
-    // this has to be atomic
-    while (!__sync_bool_compare_and_swap(lock, 0, 1)) {
-        asm("pause");
+    // taking a ticket has to be atomic, a 16 bits xadd does not carry into the other half
+    uint16_t ticket = __sync_fetch_and_add(NEXT_TICKET(lock), 1);
+    uint32_t spins = 0;
+
+    while (true) {
+        uint16_t ahead = ticket - *NOW_SERVING(lock);
+        if (ahead == 0)
+            break;
+        for (int i = ahead * BACKOFF_PAUSES_PER_WAITER; i > 0; i--)
+            asm("pause");
+        spins++;
     }
+    compiler_barrier();
+
+#ifdef LOCK_STATS
+    lock_stats_acquired((void *)lock, spins);
+#endif
 }
 
 void release(lock_t *lock) {
-    *lock = 0;
+#ifdef LOCK_STATS
+    lock_stats_releasing((void *)lock);
+#endif
+
+    // only the holder writes this half, a plain store is enough on x86
+    compiler_barrier();
+    *NOW_SERVING(lock) = *NOW_SERVING(lock) + 1;
+}
+
+
+// see "Algorithms for scalable synchronization on shared-memory multiprocessors",
+// Mellor-Crummey and Scott, 1991
+void mcs_acquire(mcs_lock_t *lock, mcs_node_t *node) {
+    uint32_t spins = 0;
+    node->next = NULL;
+    node->locked = true;
+
+    // atomically become the tail, the previous tail links to us
+    mcs_node_t *predecessor = __atomic_exchange_n(&lock->tail, node, __ATOMIC_ACQ_REL);
+    if (predecessor != NULL) {
+        predecessor->next = node;
+        while (node->locked) {
+            asm("pause");
+            spins++;
+        }
+    }
+    compiler_barrier();
+
+#ifdef LOCK_STATS
+    lock_stats_acquired(lock, spins);
+#endif
 }
 
+void mcs_release(mcs_lock_t *lock, mcs_node_t *node) {
+#ifdef LOCK_STATS
+    lock_stats_releasing(lock);
+#endif
+
+    if (node->next == NULL) {
+        // no one in line, unless someone is just joining
+        if (__sync_bool_compare_and_swap(&lock->tail, node, NULL))
+            return;
+        while (node->next == NULL)
+            asm("pause");
+    }
+    compiler_barrier();
+    node->next->locked = false;
+}
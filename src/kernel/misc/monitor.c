@@ -11,13 +11,15 @@
 #include <filesys/partition.h>
 #include <filesys/mount.h>
 #include <filesys/drivers.h>
+#include <smp.h>
+#include <lock.h>
 
 
 static void show_process(bool title, process_t *p, int *row) {
     tty_set_cursor(*row, 0);
     if (title) {
-        printf("  PID  PPID Pr Status     Block Rsn  TTY  PgDir Heap Stack Name");
-        //      12345 12345 12 1234567890 1234567890 123 123456 1234  1234 12345678901234567890
+        printf("  PID  PPID Pr Cpu Status     Block Rsn  TTY  PgDir Heap Stack VRun ms Name");
+        //      12345 12345 12 123 1234567890 1234567890 123 123456 1234  1234 1234567 12345678901234567890
         (*row)++;
     } else if (p != NULL) {
         char tty_dev[3+1];
@@ -26,22 +28,28 @@ static void show_process(bool title, process_t *p, int *row) {
         else
             strcpy(tty_dev, "-");
         
-        printf("%5d %5d %2d %-10s %-10s %3s %6x %4d  %4d %s",
+        printf("%5d %5d %2d %3d %-10s %-10s %3s %6x %4d  %4d %7u %s",
             p->pid,
             p->parent == NULL ? 0 : p->parent->pid,
             p->priority,
+            p->cpu,
             proc_get_status_name(p->state),
             p->state == BLOCKED ? proc_get_block_reason_name(p->block_reason) : "",
             tty_dev,
             p->page_directory,
             p->user_proc.heap_size / 1024,
             p->user_proc.stack_size / 1024,
+            (uint32_t)(p->vruntime / 1000),
             p->name
         );
         (*row)++;
     }
 }
 
+static void show_walked_process(process_t *p, void *row) {
+    show_process(false, p, (int *)row);
+}
+
 void show_process_list(proc_list_t *list, int *row) {
     for (process_t *p = list->head; p != NULL; p = p->next)
         show_process(false, p, row);
@@ -120,13 +128,18 @@ void process_monitor_main() {
         tty_set_cursor(1, 50);
         printf("Uptime %2dd %02dh %02dm %02ds", up_days, up_hours, up_mins, up_secs);
 
+        tty_set_cursor(2, 50);
+        printf("CPUs   %d found, %d online", smp_cpus_count(), smp_cpus_online());
+
         // we shouldn't dive into multitasking internals, but how? 
         int row = 5;
         show_process(true, NULL, &row);
-        show_process(false, running_process(), &row);
-        for (int i = 0; i < PROCESS_PRIORITY_LEVELS; i++)
-            show_process_list(&ready_lists[i], &row);
-        show_process_list(&blocked_list, &row);
+        running_processes_walk(show_walked_process, &row);
+        ready_processes_walk(show_walked_process, &row);
+        for (int i = 0; i < BLOCKED_LIST_BUCKETS; i++)
+            show_process_list(&blocked_lists[i], &row);
+        for (int i = 0; i < sleeping_queue.count; i++)
+            show_process(false, sleeping_queue.heap[i], &row);
         show_process_list(&terminated_list, &row);
  
         proc_sleep(1500);
@@ -182,6 +195,7 @@ void vfs_monitor_main() {
         tty_set_cursor(row++, 0);
         printf("Dev Part Driver     Mount point");
         //     | n    n  1234567890 123456789012345678901234567890
+        vfs_mounts_read_lock();
         struct mount_info *mnt = vfs_get_mounts_list();
         while (mnt != NULL) {
             tty_set_cursor(row++, 0);
@@ -193,8 +207,34 @@ void vfs_monitor_main() {
             );
             mnt = mnt->next;
         }
+        vfs_mounts_read_unlock();
         row++;
 
+        // only with LOCK_STATS defined in lock.h
+        lock_stats_t locks[LOCK_STATS_MAX_LOCKS];
+        int locks_count = lock_stats_snapshot(locks, LOCK_STATS_MAX_LOCKS);
+        if (locks_count > 0) {
+            tty_set_cursor(row++, 0);
+            printf("---------- Lock Contention ----------");
+            tty_set_cursor(row++, 0);
+            printf("Lock                 Acquired Contended      Spins Avg hold us Max hold us");
+            //     12345678901234567890 12345678 123456789 1234567890 12345678901 12345678901
+            for (int i = 0; i < locks_count; i++) {
+                lock_stats_t *l = &locks[i];
+                uint32_t avg_hold_usecs = l->acquisitions == 0 ? 0 :
+                    (uint32_t)(l->hold_nsecs / l->acquisitions / 1000);
+                tty_set_cursor(row++, 0);
+                printf("%-20s %8u %9u %10u %11u %11u",
+                    l->name,
+                    l->acquisitions,
+                    l->contended,
+                    (uint32_t)l->spins,
+                    avg_hold_usecs,
+                    (uint32_t)(l->max_hold_nsecs / 1000)
+                );
+            }
+        }
+
         proc_sleep(2000);
     }
 }
@@ -0,0 +1,344 @@
+#include <ctypes.h>
+#include <smp.h>
+#include <cpu.h>
+#include <klog.h>
+#include <klib/string.h>
+#include <memory/kheap.h>
+#include <memory/virtmem.h>
+#include <drivers/timer.h>
+#include <drivers/screen.h>
+#include <gdt.h>
+#include <idt.h>
+#include <multitask/multitask.h>
+
+MODULE("SMP");
+
+// see https://wiki.osdev.org/Symmetric_Multiprocessing
+// and https://wiki.osdev.org/MADT
+
+#define AP_STACK_SIZE            8192
+#define AP_STARTUP_WAIT_MSECS    100
+
+// local APIC registers, offsets from its base address
+#define LAPIC_ID                 0x020
+#define LAPIC_TASK_PRIORITY      0x080
+#define LAPIC_EOI                0x0B0
+#define LAPIC_SPURIOUS_VECTOR    0x0F0
+#define LAPIC_ERROR_STATUS       0x280
+#define LAPIC_ICR_LOW            0x300
+#define LAPIC_ICR_HIGH           0x310
+#define LAPIC_LVT_TIMER          0x320
+#define LAPIC_TIMER_INITIAL      0x380
+#define LAPIC_TIMER_CURRENT      0x390
+#define LAPIC_TIMER_DIVIDE       0x3E0
+
+#define LAPIC_TIMER_PERIODIC     (1 << 17)
+#define LAPIC_TIMER_DIVIDE_BY_16 0x3
+#define LAPIC_CALIBRATION_MSECS  10
+
+#define LAPIC_SOFTWARE_ENABLE    0x100
+#define SPURIOUS_INTERRUPT_VEC   0xFF
+
+// interrupt command register bits
+#define ICR_INIT                 (0x5 << 8)
+#define ICR_STARTUP              (0x6 << 8)
+#define ICR_DELIVERY_PENDING     (1 << 12)
+#define ICR_LEVEL_ASSERT         (1 << 14)
+
+#define DEFAULT_LAPIC_ADDRESS    0xFEE00000
+
+// ACPI tables we look at
+#define RSDP_SIGNATURE           "RSD PTR "
+#define MADT_SIGNATURE           "APIC"
+#define MADT_PROCESSOR_LAPIC     0
+#define MADT_LAPIC_ENABLED       0x01
+#define BIOS_AREA_START          0xE0000
+#define BIOS_AREA_END            0x100000
+#define EBDA_SEGMENT_POINTER     0x40E
+
+struct rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_address;
+} __attribute__((packed));
+
+struct acpi_table_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+struct madt {
+    struct acpi_table_header header;
+    uint32_t lapic_address;
+    uint32_t flags;
+    uint8_t entries[];
+} __attribute__((packed));
+
+struct madt_processor_lapic {
+    uint8_t type;
+    uint8_t length;
+    uint8_t acpi_processor_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+// must match the end of smp_low.asm
+struct trampoline_params {
+    uint16_t gdt_size;
+    uint32_t gdt_base;
+    uint16_t idt_size;
+    uint32_t idt_base;
+    uint32_t cr3;
+    uint32_t cr4;
+    uint32_t stack;
+    uint32_t entry;
+} __attribute__((packed));
+
+extern uint8_t smp_trampoline_start[];
+extern uint8_t smp_trampoline_params[];
+extern uint8_t smp_trampoline_end[];
+
+// the bootstrap cpu is always the first, it needs its cpu_t before we look for the others
+static cpu_t cpus[MAX_CPUS] = { [0] = { .index = 0, .bootstrap = true, .online = true } };
+static int cpus_count = 1;
+static volatile uint32_t *lapic = NULL;
+static cpu_t *volatile starting_cpu = NULL;
+
+
+static inline uint32_t lapic_read(uint32_t reg) {
+    return lapic[reg / 4];
+}
+
+static inline void lapic_write(uint32_t reg, uint32_t value) {
+    lapic[reg / 4] = value;
+}
+
+static uint8_t cpuid_apic_id() {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (uint8_t)(ebx >> 24);
+}
+
+static bool checksum_ok(void *address, int length) {
+    uint8_t sum = 0;
+    for (int i = 0; i < length; i++)
+        sum += ((uint8_t *)address)[i];
+    return sum == 0;
+}
+
+static struct rsdp *scan_for_rsdp(uint32_t start, uint32_t end) {
+    // always on a 16 bytes boundary
+    for (uint32_t addr = start; addr + sizeof(struct rsdp) <= end; addr += 16) {
+        struct rsdp *rsdp = (struct rsdp *)addr;
+        if (memcmp(rsdp->signature, (void *)RSDP_SIGNATURE, 8) == 0 && checksum_ok(rsdp, sizeof(struct rsdp)))
+            return rsdp;
+    }
+    return NULL;
+}
+
+static struct madt *find_madt() {
+    // first KB of the extended bios data area, then the bios read only area
+    uint32_t ebda = (uint32_t)(*(uint16_t *)EBDA_SEGMENT_POINTER) << 4;
+    struct rsdp *rsdp = NULL;
+    if (ebda != 0)
+        rsdp = scan_for_rsdp(ebda, ebda + 1024);
+    if (rsdp == NULL)
+        rsdp = scan_for_rsdp(BIOS_AREA_START, BIOS_AREA_END);
+    if (rsdp == NULL)
+        return NULL;
+
+    // tables are usually at the top of the memory, the page fault handler maps them
+    struct acpi_table_header *rsdt = (struct acpi_table_header *)rsdp->rsdt_address;
+    if (memcmp(rsdt->signature, (void *)"RSDT", 4) != 0 || !checksum_ok(rsdt, rsdt->length))
+        return NULL;
+
+    int entries = (rsdt->length - sizeof(struct acpi_table_header)) / sizeof(uint32_t);
+    uint32_t *tables = (uint32_t *)(rsdt + 1);
+    for (int i = 0; i < entries; i++) {
+        struct acpi_table_header *table = (struct acpi_table_header *)tables[i];
+        if (memcmp(table->signature, (void *)MADT_SIGNATURE, 4) == 0 && checksum_ok(table, table->length))
+            return (struct madt *)table;
+    }
+    return NULL;
+}
+
+static void parse_madt(struct madt *madt) {
+    lapic = (volatile uint32_t *)(madt->lapic_address != 0 ? madt->lapic_address : DEFAULT_LAPIC_ADDRESS);
+    uint8_t bootstrap_id = cpuid_apic_id();
+
+    cpus[0].apic_id = bootstrap_id;
+
+    uint8_t *entry = madt->entries;
+    uint8_t *end = (uint8_t *)madt + madt->header.length;
+    while (entry < end && entry[1] > 0) {
+        struct madt_processor_lapic *proc = (struct madt_processor_lapic *)entry;
+        if (proc->type == MADT_PROCESSOR_LAPIC && (proc->flags & MADT_LAPIC_ENABLED) && proc->apic_id != bootstrap_id) {
+            if (cpus_count < MAX_CPUS) {
+                cpus[cpus_count].index = cpus_count;
+                cpus[cpus_count].apic_id = proc->apic_id;
+                cpus_count++;
+            } else {
+                klog_warn("Ignoring cpu with APIC id %d, up to %d are supported", proc->apic_id, MAX_CPUS);
+            }
+        }
+        entry += entry[1];
+    }
+}
+
+static void lapic_send_ipi(uint8_t apic_id, uint32_t command) {
+    lapic_write(LAPIC_ERROR_STATUS, 0);
+    lapic_write(LAPIC_ICR_HIGH, (uint32_t)apic_id << 24);
+    lapic_write(LAPIC_ICR_LOW, command);
+    while (lapic_read(LAPIC_ICR_LOW) & ICR_DELIVERY_PENDING)
+        asm("pause");
+}
+
+static void pause_usecs(uint32_t usecs) {
+    uint64_t target = clock_monotonic_ns() + (uint64_t)usecs * 1000;
+    while (clock_monotonic_ns() < target)
+        asm("pause");
+}
+
+// counts the local APIC timer down for a while, against the TSC clock,
+// then makes it tick every msec, like the PIT does for the bootstrap cpu
+static void start_lapic_timer() {
+    lapic_write(LAPIC_TIMER_DIVIDE, LAPIC_TIMER_DIVIDE_BY_16);
+    lapic_write(LAPIC_TIMER_INITIAL, 0xFFFFFFFF);
+    pause_usecs(LAPIC_CALIBRATION_MSECS * 1000);
+    uint32_t counted = 0xFFFFFFFF - lapic_read(LAPIC_TIMER_CURRENT);
+
+    lapic_write(LAPIC_LVT_TIMER, LAPIC_TIMER_VECTOR | LAPIC_TIMER_PERIODIC);
+    lapic_write(LAPIC_TIMER_INITIAL, counted / LAPIC_CALIBRATION_MSECS);
+}
+
+// application processors arrive here from the trampoline, with paging on
+static void ap_main() {
+    // claim our cpu_t. if it is gone, we woke up after the bootstrap cpu gave
+    // up on us, and we must stay out of the way for good.
+    cpu_t *cpu = __sync_lock_test_and_set(&starting_cpu, NULL);
+    if (cpu == NULL) {
+        while (true)
+            asm volatile("cli; hlt");
+    }
+
+    // our own descriptors and GS, before anything uses smp_this_cpu()
+    load_cpu_gdt(cpu);
+    init_sysenter(KERNEL_CODE_SELECTOR);
+
+    // accept all interrupts, the timer and the reschedule IPIs are all we get
+    lapic_write(LAPIC_SPURIOUS_VECTOR, LAPIC_SOFTWARE_ENABLE | SPURIOUS_INTERRUPT_VEC);
+    lapic_write(LAPIC_TASK_PRIORITY, 0);
+    start_lapic_timer();
+    cpu->online = true;
+
+    // interrupts stay disabled, until the idle loop halts for the first time
+    multitasking_start_on_application_processor();
+    panic("multitasking returned on an application processor");
+}
+
+static void prepare_trampoline() {
+    size_t size = smp_trampoline_end - smp_trampoline_start;
+    memcpy((void *)SMP_TRAMPOLINE_ADDRESS, smp_trampoline_start, size);
+
+    struct trampoline_params *params = (struct trampoline_params *)
+        (SMP_TRAMPOLINE_ADDRESS + (smp_trampoline_params - smp_trampoline_start));
+    uint32_t cr4;
+    __asm__ __volatile__("sgdt %0" : "=m"(params->gdt_size));
+    __asm__ __volatile__("sidt %0" : "=m"(params->idt_size));
+    __asm__ __volatile__("mov %%cr4, %0" : "=r"(cr4));
+    params->cr3 = (uint32_t)get_page_directory_register();
+    params->cr4 = cr4;
+    params->entry = (uint32_t)ap_main;
+}
+
+// INIT, wait, then up to two STARTUP IPIs, as the MP specification suggests
+static bool start_application_processor(cpu_t *cpu) {
+    cpu->kernel_stack = kmalloc(AP_STACK_SIZE);
+    struct trampoline_params *params = (struct trampoline_params *)
+        (SMP_TRAMPOLINE_ADDRESS + (smp_trampoline_params - smp_trampoline_start));
+    params->stack = (uint32_t)cpu->kernel_stack + AP_STACK_SIZE;
+    starting_cpu = cpu;
+
+    lapic_send_ipi(cpu->apic_id, ICR_INIT | ICR_LEVEL_ASSERT);
+    timer_pause_blocking(10);
+    for (int i = 0; i < 2 && starting_cpu == cpu; i++) {
+        lapic_send_ipi(cpu->apic_id, ICR_STARTUP | (SMP_TRAMPOLINE_ADDRESS >> 12));
+        pause_usecs(200);
+    }
+
+    uint64_t give_up = timer_get_uptime_msecs() + AP_STARTUP_WAIT_MSECS;
+    while (starting_cpu != NULL && timer_get_uptime_msecs() < give_up)
+        asm("pause");
+
+    // if it did not claim its cpu_t by now, take it back, it will halt if it wakes up.
+    // it would still use this stack, so it stays, and no other cpu can use the trampoline.
+    if (__sync_lock_test_and_set(&starting_cpu, NULL) == cpu) {
+        klog_warn("CPU with APIC id %d did not start", cpu->apic_id);
+        return false;
+    }
+
+    // it is ours, it only needs to calibrate its timer
+    while (!cpu->online)
+        asm("pause");
+    return true;
+}
+
+void init_smp() {
+    struct madt *madt = NULL;
+    if (cpu_has_features(CPU_FEATURE_APIC))
+        madt = find_madt();
+    if (madt == NULL) {
+        klog_info("No local APIC or ACPI MADT table, running on one cpu");
+        return;
+    }
+
+    parse_madt(madt);
+    klog_info("Found %d cpu(s), local APIC at 0x%p", cpus_count, lapic);
+
+    prepare_trampoline();
+    for (int i = 1; i < cpus_count; i++) {
+        if (!start_application_processor(&cpus[i])) {
+            klog_warn("Not starting the remaining %d cpu(s)", cpus_count - i - 1);
+            break;
+        }
+        klog_info("CPU with APIC id %d started", cpus[i].apic_id);
+    }
+}
+
+int smp_cpus_count() {
+    return cpus_count;
+}
+
+int smp_cpus_online() {
+    int online = 0;
+    for (int i = 0; i < cpus_count; i++)
+        online += cpus[i].online ? 1 : 0;
+    return online;
+}
+
+cpu_t *smp_bootstrap_cpu() {
+    return &cpus[0];
+}
+
+cpu_t *smp_get_cpu(int index) {
+    return (index >= 0 && index < cpus_count) ? &cpus[index] : NULL;
+}
+
+void smp_send_reschedule(cpu_t *cpu) {
+    if (lapic == NULL)
+        return;
+    lapic_send_ipi(cpu->apic_id, RESCHEDULE_VECTOR);
+}
+
+void smp_lapic_eoi() {
+    lapic_write(LAPIC_EOI, 0);
+}
@@ -0,0 +1,65 @@
+; application processors start here, in real mode, after the startup IPI.
+; the code is copied to SMP_TRAMPOLINE_ADDRESS, below 1 MB, so all addresses
+; are computed relative to that, not to where the kernel image has it.
+; the parameters at the end are filled in by smp.c before each startup.
+
+SMP_TRAMPOLINE_ADDRESS  equ 0x8000     ; must match smp.h
+%define TRAMPOLINE(label)  (SMP_TRAMPOLINE_ADDRESS + (label - smp_trampoline_start))
+
+[GLOBAL smp_trampoline_start]
+[GLOBAL smp_trampoline_params]
+[GLOBAL smp_trampoline_end]
+
+[BITS 16]
+smp_trampoline_start:
+    cli
+    cld
+    xor ax, ax
+    mov ds, ax
+    o32 lgdt [TRAMPOLINE(params_gdt)]   ; the kernel's GDT, full 32 bits base
+
+    mov eax, cr0
+    or eax, 1                           ; protected mode
+    mov cr0, eax
+    jmp dword 0x08:TRAMPOLINE(protected_mode)
+
+[BITS 32]
+protected_mode:
+    mov ax, 0x10
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+    lidt [TRAMPOLINE(params_idt)]
+
+    ; same paging as the bootstrap cpu, 4 MB pages must be enabled before CR3
+    mov eax, [TRAMPOLINE(params_cr4)]
+    mov cr4, eax
+    mov eax, [TRAMPOLINE(params_cr3)]
+    mov cr3, eax
+    mov eax, cr0
+    or eax, 0x80000000                  ; paging
+    mov cr0, eax
+
+    mov esp, [TRAMPOLINE(params_stack)]
+    mov eax, [TRAMPOLINE(params_entry)]
+    call eax
+
+.halt:                                  ; the entry point should never return
+    cli
+    hlt
+    jmp .halt
+
+; must match struct trampoline_params in smp.c
+align 4
+smp_trampoline_params:
+params_gdt:     dw 0
+                dd 0
+params_idt:     dw 0
+                dd 0
+params_cr3:     dd 0
+params_cr4:     dd 0
+params_stack:   dd 0
+params_entry:   dd 0
+smp_trampoline_end:
@@ -6,6 +6,7 @@
 #include <drivers/timer.h>
 #include <multitask/process.h>
 #include <multitask/exec.h>
+#include <multitask/futex.h>
 #include <devices/tty.h>
 #include <filesys/vfs.h>
 #include <memory/virtmem.h>
@@ -102,11 +103,24 @@ static void *sys_sbrk(int diff_size) {
     if (diff_size > 0) {
         diff_size = (diff_size + 0xFFF) & 0xFFFFF000; // round up to next page / 4K
         void *heap_end = p->user_proc.heap + p->user_proc.heap_size;
-        allocate_virtual_memory_range(heap_end, heap_end + diff_size, p->page_directory);
+        if (heap_end + diff_size > MMAP_AREA_START)
+            return NULL;
+        // pages of the heap area are backed on first touch
+        vma_t *heap_vma = vma_find_type(p->user_proc.vmas, VMA_HEAP);
+        if (heap_vma != NULL)
+            heap_vma->end = heap_end + diff_size;
+        else
+            allocate_virtual_memory_range(heap_end, heap_end + diff_size, p->page_directory);
         p->user_proc.heap_size += diff_size;
     }
     return initial_break;
 }
+static int sys_mmap(uint32_t length, int prot, int flags, int handle, uint32_t offset) {
+    return proc_mmap(running_process(), length, prot, flags, handle, offset);
+}
+static int sys_munmap(void *address, uint32_t length) {
+    return proc_munmap(running_process(), address, length);
+}
 static int sys_exit(int exit_code) {
     // current process exiting, preserve exit code, wake up waiting parents
     proc_exit(exit_code);
@@ -120,6 +134,16 @@ static int sys_yield() {
     proc_yield();
     return 0;
 }
+static int sys_futex(uint32_t *address, int op, uint32_t value) {
+    switch (op) {
+        case FUTEX_WAIT:
+            return futex_wait(address, value);
+        case FUTEX_WAKE:
+            return futex_wake(address, (int)value);
+        default:
+            return ERR_NOT_SUPPORTED;
+    }
+}
 static int sys_get_cwd(char *buffer, int length) {
     return proc_getcwd(running_process(), buffer, length);
 }
@@ -179,6 +203,10 @@ int sys_uptime(uint64_t *msecs) {
     *msecs = timer_get_uptime_msecs();
     return SUCCESS;
 }
+int sys_uptime_ns(uint64_t *nsecs) {
+    *nsecs = clock_monotonic_ns();
+    return SUCCESS;
+}
 
 int isr_syscall(struct syscall_stack stack) {
     /* before getting to this function, the assembly isr handler
@@ -286,7 +314,7 @@ int isr_syscall(struct syscall_stack stack) {
             return_value = proc_getppid();
             break;
         case SYS_FORK:   // returns 0 in child, child PID in parent, neg error in parent
-            return_value = proc_fork();
+            return_value = proc_fork(&stack);
             break;
         case SYS_EXEC:   // arg1 = path, arg2 = argv, arg3 = envp, returns... maybe?
             return_value = sys_exec((char *)stack.passed.arg1, (char **)stack.passed.arg2, (char **)stack.passed.arg3);
@@ -306,12 +334,24 @@ int isr_syscall(struct syscall_stack stack) {
         case SYS_SBRK:   // arg1 = signed desired diff, returns pointer to new area
             return_value = (int)sys_sbrk(stack.passed.arg1);
             break;
+        case SYS_MMAP:   // arg1 = length, arg2 = prot, arg3 = flags, arg4 = handle, arg5 = offset, returns address
+            return_value = sys_mmap(stack.passed.arg1, stack.passed.arg2, stack.passed.arg3, stack.passed.arg4, stack.passed.arg5);
+            break;
+        case SYS_MUNMAP:   // arg1 = address, arg2 = length
+            return_value = sys_munmap((void *)stack.passed.arg1, stack.passed.arg2);
+            break;
         case SYS_GET_UPTIME:   // returns msecs since boot (32 bits = 49 days)
             sys_uptime((uint64_t *)stack.passed.arg1);
             break;
         case SYS_GET_CLOCK:   // arg1 = clocktime pointer
             sys_get_clocktime((clocktime_t *)stack.passed.arg1);
             break;
+        case SYS_GET_UPTIME_NS:   // arg1 = pointer to nsecs since boot
+            sys_uptime_ns((uint64_t *)stack.passed.arg1);
+            break;
+        case SYS_FUTEX:   // arg1 = address, arg2 = op, arg3 = value
+            return_value = sys_futex((uint32_t *)stack.passed.arg1, stack.passed.arg2, stack.passed.arg3);
+            break;
         default:
             klog_warn("Received syscall interrupt!");
             klog_debug("  sysno = %d (eax)", stack.passed.sysno);
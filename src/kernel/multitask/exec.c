@@ -8,6 +8,7 @@
 #include <elf.h>
 #include <memory/virtmem.h>
 #include <memory/kheap.h>
+#include <memory/vma.h>
 
 MODULE("EXEC");
 
@@ -38,6 +39,9 @@ MODULE("EXEC");
 
 static void load_and_run_executable();
 
+// more than enough for text, rodata, data and bss
+#define MAX_ELF_SEGMENTS   8
+
 
 
 // return pid for success, negative value for errors
@@ -63,7 +67,7 @@ int execve(char *path, char *argv[], char *envp[]) {
     process_t *new_proc = create_process(
         path,
         load_and_run_executable,
-        parent == NULL ? PRIORITY_USER_PROGRAM : parent->priority,
+        parent == NULL ? PRIORITY_USER_PROGRAM : parent->base_priority,
         parent,
         parent == NULL ? NULL : parent->tty
     );
@@ -142,10 +146,14 @@ static void load_and_run_executable() {
         proc_exit(-1);
     }
 
+    // the file stays open, segments are loaded on demand from it
+    proc->user_proc.executable = file;
+
     // gather information from the elf file
     void *virt_addr_start = NULL;
     void *virt_addr_end = NULL;
     void *elf_entry_point = NULL;
+    elf_segment_t segments[MAX_ELF_SEGMENTS];
 
     err = get_elf_load_information(file, &virt_addr_start, &virt_addr_end, &elf_entry_point);
     klog_debug("ELF to be loaded at virtual addresses 0x%p - 0x%x, entry point 0x%p", virt_addr_start, virt_addr_end, elf_entry_point);
@@ -153,6 +161,11 @@ static void load_and_run_executable() {
         klog_error("Failed getting info from executable");
         proc_exit(-2);
     }
+    int segments_count = get_elf_loadable_segments(file, segments, MAX_ELF_SEGMENTS);
+    if (segments_count < 0) {
+        klog_error("Failed getting segments of executable");
+        proc_exit(-2);
+    }
 
     // memory map of a process:
     // 1-4 MB: kernel
@@ -170,27 +183,28 @@ static void load_and_run_executable() {
 
     // create something to load the segments (kernel mapped included)
     void *page_directory = create_page_directory(true);
-    allocate_virtual_memory_range(stack_bottom, heap + heap_size, page_directory);
-    klog_debug("Allocated new page directory 0x%x for execve()", page_directory);
-    dump_page_directory(page_directory);
-    // dump_page_directory(get_kernel_page_directory());
-
-    // we are not waiting for a switch, we have to set CR3 now, to load the file.
-    proc->page_directory = page_directory;
-    set_page_directory_register(page_directory);
 
-    // we should be safe to do it now
-    err = load_elf_into_memory(file);
-    if (err) {
-        klog_error("Failed loading executable \"%s\"", proc->user_proc.executable_path);
-        proc_exit(-3);
+    // we run in ring 0, the cpu pushes the page fault frame on this very stack,
+    // so it cannot be populated on demand, it has to be present from the start.
+    allocate_virtual_memory_range(stack_bottom, stack_bottom + stack_size, page_directory);
+    vma_add(&proc->user_proc.vmas, VMA_STACK, VMA_WRITABLE, stack_bottom, stack_bottom + stack_size);
+
+    // segments and heap are populated on first touch
+    for (int i = 0; i < segments_count; i++) {
+        vma_t *vma = vma_add(&proc->user_proc.vmas, VMA_ELF_SEGMENT,
+            (segments[i].writable ? VMA_WRITABLE : 0) | (segments[i].executable ? VMA_EXECUTABLE : 0),
+            segments[i].vaddr, segments[i].vaddr + segments[i].memory_size);
+        vma->file_vaddr = segments[i].vaddr;
+        vma->file_offset = segments[i].file_offset;
+        vma->file_size = segments[i].file_size;
     }
+    vma_add(&proc->user_proc.vmas, VMA_HEAP, VMA_WRITABLE, heap, heap + heap_size);
+    klog_debug("Allocated new page directory 0x%x for execve(), memory areas:", page_directory);
+    vma_dump(proc->user_proc.vmas);
 
-    err = vfs_close(file);
-    if (err) {
-        klog_error("Failed closing executable \"%s\"", proc->user_proc.executable_path);
-        proc_exit(-4);
-    }
+    // we are not waiting for a switch, we have to set CR3 now, to start using it.
+    proc->page_directory = page_directory;
+    set_page_directory_register(page_directory);
 
     // allow libc to use the heap.
     proc->user_proc.heap = heap;
@@ -0,0 +1,151 @@
+#include <multitask/process.h>
+#include <multitask/fairq.h>
+
+#define max(a, b)   ((a) > (b) ? (a) : (b))
+
+
+static inline int height(process_t *node) {
+    return node == NULL ? 0 : node->fair_node.height;
+}
+
+static inline void update_height(process_t *node) {
+    node->fair_node.height = 1 + max(height(node->fair_node.left), height(node->fair_node.right));
+}
+
+// ties are broken by pid, so that every process has a distinct key
+static inline bool runs_before(process_t *a, process_t *b) {
+    if (a->vruntime != b->vruntime)
+        return a->vruntime < b->vruntime;
+    return a->pid < b->pid;
+}
+
+static process_t *rotate_right(process_t *node) {
+    process_t *pivot = node->fair_node.left;
+    node->fair_node.left = pivot->fair_node.right;
+    pivot->fair_node.right = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+static process_t *rotate_left(process_t *node) {
+    process_t *pivot = node->fair_node.right;
+    node->fair_node.right = pivot->fair_node.left;
+    pivot->fair_node.left = node;
+    update_height(node);
+    update_height(pivot);
+    return pivot;
+}
+
+// restores the AVL property of the subtree, returns its new root
+static process_t *rebalance(process_t *node) {
+    update_height(node);
+    int balance = height(node->fair_node.left) - height(node->fair_node.right);
+
+    if (balance > 1) {
+        process_t *left = node->fair_node.left;
+        if (height(left->fair_node.left) < height(left->fair_node.right))
+            node->fair_node.left = rotate_left(left);
+        return rotate_right(node);
+    }
+    if (balance < -1) {
+        process_t *right = node->fair_node.right;
+        if (height(right->fair_node.right) < height(right->fair_node.left))
+            node->fair_node.right = rotate_right(right);
+        return rotate_left(node);
+    }
+    return node;
+}
+
+static process_t *insert(process_t *node, process_t *proc) {
+    if (node == NULL) {
+        proc->fair_node.left = NULL;
+        proc->fair_node.right = NULL;
+        proc->fair_node.height = 1;
+        return proc;
+    }
+    if (runs_before(proc, node))
+        node->fair_node.left = insert(node->fair_node.left, proc);
+    else
+        node->fair_node.right = insert(node->fair_node.right, proc);
+    return rebalance(node);
+}
+
+static process_t *remove_first(process_t *node, process_t **first) {
+    if (node->fair_node.left == NULL) {
+        *first = node;
+        return node->fair_node.right;
+    }
+    node->fair_node.left = remove_first(node->fair_node.left, first);
+    return rebalance(node);
+}
+
+static process_t *remove_node(process_t *node, process_t *proc) {
+    if (node == NULL)
+        return NULL;
+    if (node != proc) {
+        if (runs_before(proc, node))
+            node->fair_node.left = remove_node(node->fair_node.left, proc);
+        else
+            node->fair_node.right = remove_node(node->fair_node.right, proc);
+        return rebalance(node);
+    }
+
+    // the smallest of the right subtree takes the place of the node
+    process_t *left = node->fair_node.left;
+    process_t *right = node->fair_node.right;
+    if (right == NULL)
+        return left;
+    process_t *successor = NULL;
+    right = remove_first(right, &successor);
+    successor->fair_node.left = left;
+    successor->fair_node.right = right;
+    return rebalance(successor);
+}
+
+static void walk(process_t *node, void (*func)(process_t *proc, void *data), void *data) {
+    if (node == NULL)
+        return;
+    walk(node->fair_node.left, func, data);
+    func(node, data);
+    walk(node->fair_node.right, func, data);
+}
+
+// add a ready process, by its vruntime. O(log n)
+void fairq_insert(fair_queue_t *queue, process_t *proc) {
+    queue->root = insert(queue->root, proc);
+    queue->count++;
+}
+
+// the process with the smallest vruntime, or NULL. O(log n)
+process_t *fairq_first(fair_queue_t *queue) {
+    process_t *node = queue->root;
+    while (node != NULL && node->fair_node.left != NULL)
+        node = node->fair_node.left;
+    return node;
+}
+
+// extract the process with the smallest vruntime, or NULL. O(log n)
+process_t *fairq_pop_first(fair_queue_t *queue) {
+    if (queue->root == NULL)
+        return NULL;
+    process_t *first = NULL;
+    queue->root = remove_first(queue->root, &first);
+    queue->count--;
+    first->fair_node.left = NULL;
+    first->fair_node.right = NULL;
+    return first;
+}
+
+// remove a process from anywhere in the tree, e.g. to change its priority. O(log n)
+void fairq_remove(fair_queue_t *queue, process_t *proc) {
+    queue->root = remove_node(queue->root, proc);
+    queue->count--;
+    proc->fair_node.left = NULL;
+    proc->fair_node.right = NULL;
+}
+
+// calls the function for each process, in vruntime order
+void fairq_walk(fair_queue_t *queue, void (*func)(process_t *proc, void *data), void *data) {
+    walk(queue->root, func, data);
+}
@@ -0,0 +1,126 @@
+#include <multitask/process.h>
+#include <multitask/scheduler.h>
+#include <multitask/futex.h>
+#include <memory/vma.h>
+#include <memory/virtmem.h>
+#include <klog.h>
+#include <errors.h>
+
+MODULE("FUTEX");
+
+
+// page directory and address for private words, NULL and physical address for shared ones
+typedef struct futex_key {
+    void *page_directory;
+    uint32_t address;
+} futex_key_t;
+
+// lives in the stack of the waiting process, for as long as it is blocked
+typedef struct futex_waiter {
+    futex_key_t key;
+    process_t *process;
+    struct futex_waiter *next;
+} futex_waiter_t;
+
+// waiters in the order they came, per bucket
+static futex_waiter_t *buckets[FUTEX_HASH_BUCKETS];
+
+
+static inline int bucket_for(futex_key_t *key) {
+    uint32_t hash = (((uint32_t)key->page_directory >> 12) ^ (key->address >> 2)) * 2654435761u;
+    return hash >> 26;
+}
+
+static inline bool same_key(futex_key_t *a, futex_key_t *b) {
+    return a->page_directory == b->page_directory && a->address == b->address;
+}
+
+// the word must have been touched, for a shared page to be mapped
+static void get_key(process_t *proc, uint32_t *address, futex_key_t *key) {
+    vma_t *vma = vma_find(proc->user_proc.vmas, address);
+    if (vma != NULL && vma->shared != NULL) {
+        key->page_directory = NULL;
+        key->address = (uint32_t)resolve_virtual_to_physical_address(address, proc->page_directory);
+    } else {
+        key->page_directory = proc->page_directory;
+        key->address = (uint32_t)address;
+    }
+}
+
+// only words in areas of the process, the page fault handler can back them
+static bool is_user_word(process_t *proc, uint32_t *address) {
+    if (((uint32_t)address & 0x3) != 0)
+        return false;
+    if (vma_find(proc->user_proc.vmas, address) != NULL)
+        return true;
+    void *heap_end = proc->user_proc.heap + proc->user_proc.heap_size;
+    return (void *)address >= proc->user_proc.heap && (void *)(address + 1) <= heap_end;
+}
+
+int futex_wait(uint32_t *address, uint32_t expected) {
+    process_t *proc = running_process();
+    if (proc == NULL || proc->user_proc.vmas == NULL)
+        return ERR_NO_RUNNING_PROCESS;
+    if (!is_user_word(proc, address))
+        return ERR_BAD_ARGUMENT;
+
+    // touch it first, page faults are better served with interrupts enabled
+    if (*(volatile uint32_t *)address != expected)
+        return ERR_TRY_AGAIN;
+
+    futex_waiter_t waiter = {
+        .process = proc,
+        .next = NULL
+    };
+    get_key(proc, address, &waiter.key);
+
+    lock_scheduler();
+
+    // a wake up between the user space check and here must not be lost.
+    // nobody else runs while we hold the scheduler lock.
+    if (*(volatile uint32_t *)address != expected) {
+        unlock_scheduler();
+        return ERR_TRY_AGAIN;
+    }
+
+    futex_waiter_t **link = &buckets[bucket_for(&waiter.key)];
+    while (*link != NULL)
+        link = &(*link)->next;
+    *link = &waiter;
+
+    // the waker takes us off the bucket
+    proc_block(FUTEX, &waiter);
+    unlock_scheduler();
+    return SUCCESS;
+}
+
+int futex_wake(uint32_t *address, int count) {
+    process_t *proc = running_process();
+    if (proc == NULL || proc->user_proc.vmas == NULL)
+        return ERR_NO_RUNNING_PROCESS;
+    if (!is_user_word(proc, address))
+        return ERR_BAD_ARGUMENT;
+
+    // touch it, a shared page may not be mapped in our address space yet
+    (void)*(volatile uint32_t *)address;
+    futex_key_t key;
+    get_key(proc, address, &key);
+
+    int woken = 0;
+    lock_scheduler();
+
+    futex_waiter_t **link = &buckets[bucket_for(&key)];
+    while (*link != NULL && woken < count) {
+        futex_waiter_t *waiter = *link;
+        if (!same_key(&waiter->key, &key)) {
+            link = &waiter->next;
+            continue;
+        }
+        *link = waiter->next;
+        unblock_process(waiter->process);
+        woken++;
+    }
+
+    unlock_scheduler();
+    return woken;
+}
@@ -4,15 +4,16 @@
 #include <drivers/timer.h>
 #include <drivers/clock.h>
 #include <klog.h>
+#include <cpu.h>
 #include <memory/kheap.h>
 #include <memory/virtmem.h>
+#include <memory/physmem.h>
 #include <klib/string.h>
+#include <smp.h>
 
 MODULE("MTASK");
 
 
-#define min(a, b)   ((a) < (b) ? (a) : (b))
-
 static volatile bool process_switching_enabled = false;
 
 
@@ -20,23 +21,32 @@ void init_multitasking() {
     // we should not neglect the original task that has been running since boot
     // this is what we will switch "from" into whatever other task we want to spawn.
     // this way we always have a "from" to switch from...
-    memset((char *)&ready_lists, 0, sizeof(ready_lists));
-    memset((char *)&blocked_list, 0, sizeof(blocked_list));
+    memset((char *)&ready_queues, 0, sizeof(ready_queues));
+    memset((char *)&blocked_lists, 0, sizeof(blocked_lists));
+    memset((char *)&sleeping_queue, 0, sizeof(sleeping_queue));
     memset((char *)&terminated_list, 0, sizeof(terminated_list));
 
-    // our task that will be running has to be marked as RUNNING, to be swapped out
-    process_t *idle = create_process(
-        "Idle", 
-        NULL, 
-        PROCESS_PRIORITY_LEVELS - 1,  // lowest priority by definition
-        0,
-        NULL
-    );
-    running_proc = idle;
-    running_proc->state = RUNNING; // set to running in order to swap it
-
-    // idle task is by definition the lowest priority
-    append(&ready_lists[idle->priority], idle);
+    // each cpu gets its own idle task, what runs there when nothing else is ready.
+    // the application processors already wait for us, on their boot stacks.
+    for (int i = 0; i < smp_cpus_count(); i++) {
+        cpu_t *cpu = smp_get_cpu(i);
+        if (!cpu->online)
+            continue;
+
+        process_t *idle = create_process(
+            "Idle", 
+            NULL, 
+            PRIORITY_IDLE_TASK,  // lowest priority by definition
+            0,
+            NULL
+        );
+        idle->state = RUNNING; // set to running in order to swap it
+        idle->cpu = cpu->index;
+
+        // idle tasks are never queued, the scheduler falls back to them
+        cpu->idle_proc = idle;
+        cpu->current_proc = idle;
+    }
 }
 
 // reports whether multitasking has started
@@ -44,68 +54,105 @@ bool multitasking_enabled() {
     return process_switching_enabled;
 }
 
-// this will never return
-void start_multitasking() {
-    klog_debug("Starting multitasking");
-
-    // flag to our interrupt handler that we can start scheduling
-    // after a while, the timer will switch us out and will switch something else in.
-    process_switching_enabled = true;
-
-    // this to enable the scheduled to switch tasks in a while
-    next_switching_time = timer_get_uptime_msecs() + DEFAULT_TASK_TIMESLICE_MSECS;
+// how long the idle task can sleep, before anything needs the cpu
+static uint32_t idle_msecs_available() {
+    uint64_t now = timer_get_uptime_msecs();
+    uint64_t until = next_wake_up_time;
+
+    // with no ready processes, the switching time only matters when one wakes up
+    if (until == 0)
+        return TICKLESS_MAX_MSECS;
+    if (until <= now)
+        return 0;
+    return until - now > TICKLESS_MAX_MSECS ? TICKLESS_MAX_MSECS : (uint32_t)(until - now);
+}
 
-    // we shall become the idle task.
-    // this task must not sleep or block
+// what every cpu does when nothing else is ready.
+// this task must not sleep or block
+static void idle_loop() {
     while (true) {
         
         // maybe not ideal for an idle task, 
         // but maybe we can use it for some housekeeping
-        while (terminated_list.head != NULL) {
+        while (true) {
+            lock_scheduler();
             process_t *proc = dequeue(&terminated_list);
+            unlock_scheduler();
+            if (proc == NULL)
+                break;
             klog_trace("idle task cleaning up terminated process %s", proc->name);
             cleanup_process(proc);
         }
-        
-        asm("hlt");
+
+        // clear pages for future page tables and process memory,
+        // higher priority tasks will preempt us while we are at it
+        refill_zeroed_pages_pool();
+
+        // other cpus may have queued work for us, or have more than they can run
+        lock_scheduler();
+        if (ready_process_available())
+            schedule();
+        unlock_scheduler();
+
+        // if nobody else can run, no need for ticks until the next sleeper wakes up.
+        // only the bootstrap cpu gets the PIT interrupts, and it keeps the uptime,
+        // so it only goes tickless when the other cpus are idle too.
+        // interrupts are enabled by the instruction before hlt, no wake up can be missed
+        cli();
+        if (smp_this_cpu()->bootstrap && all_cpus_idle())
+            timer_enter_tickless(idle_msecs_available());
+        asm volatile("sti; hlt");
     }
 }
 
+// this will never return
+void start_multitasking() {
+    klog_debug("Starting multitasking");
+
+    // this to enable the scheduled to switch tasks in a while
+    smp_this_cpu()->next_switching_time = timer_get_uptime_msecs() + DEFAULT_TASK_TIMESLICE_MSECS;
+
+    // we are never switched in, so start counting our cpu time here, not since boot
+    running_proc->cpu_ticks_last = clock_monotonic_ns();
 
-// called by the timer handler
+    // flag to our interrupt handler that we can start scheduling
+    // after a while, the timer will switch us out and will switch something else in.
+    // the application processors were waiting for this too.
+    process_switching_enabled = true;
+
+    // we shall become the idle task.
+    idle_loop();
+}
+
+// this will never return either
+void multitasking_start_on_application_processor() {
+    while (!process_switching_enabled)
+        asm volatile("pause");
+
+    running_proc->cpu_ticks_last = clock_monotonic_ns();
+    klog_debug("Cpu %d starts taking processes", smp_this_cpu_index());
+    idle_loop();
+}
+
+
+// called by the timer handler, wakes up only the expired ones at the top of the heap
 static void wake_sleeping_tasks() {
-    if (blocked_list.head == NULL)
-        return;
     lock_scheduler();
-
-    // move everything to a temp list, then deal with one task at a time
-    // tasks are either put back into the sleeping list, or in the ready list.
-    proc_list_t temp_list;
-    temp_list.head = blocked_list.head;
-    temp_list.tail = blocked_list.tail;
-    blocked_list.head = NULL;
-    blocked_list.tail = NULL;
     uint64_t now = timer_get_uptime_msecs();
 
-    // update the next wake_up_time
-    next_wake_up_time = 0;
-    process_t *proc = dequeue(&temp_list);
-    while (proc != NULL) {
-        if (proc->block_reason == SLEEPING && proc->wake_up_time > 0 && now >= proc->wake_up_time) {
-            // klog_trace("process %s ready to run, sleep time expired", proc->name);
-            proc->state = READY;
-            proc->block_reason = 0;
-            proc->block_channel = NULL;
-            prepend(&ready_lists[proc->priority], proc);
-        } else {
-            append(&blocked_list, proc);
-            next_wake_up_time = (next_wake_up_time == 0)
-                ? proc->wake_up_time
-                : min(next_wake_up_time, proc->wake_up_time);
-        }
-        proc = dequeue(&temp_list);
+    process_t *proc = sleepq_peek(&sleeping_queue);
+    while (proc != NULL && now >= proc->wake_up_time) {
+        sleepq_pop(&sleeping_queue);
+        // klog_trace("process %s ready to run, sleep time expired", proc->name);
+        proc->state = READY;
+        proc->block_reason = 0;
+        proc->block_channel = NULL;
+        ready_list_prepend(proc);
+        proc = sleepq_peek(&sleeping_queue);
     }
-    
+
+    // update the next wake_up_time
+    next_wake_up_time = (proc == NULL) ? 0 : proc->wake_up_time;
     unlock_scheduler();
 }
 
@@ -116,14 +163,28 @@ void multitasking_timer_ticked() {
         return;
     
     lock_scheduler();
+    cpu_t *cpu = smp_this_cpu();
     uint64_t uptime_msecs = timer_get_uptime_msecs();
-    if (next_wake_up_time > 0 && uptime_msecs >= next_wake_up_time) {
+
+    // sleepers are woken up by the cpu that keeps the uptime
+    if (cpu->bootstrap && next_wake_up_time > 0 && uptime_msecs >= next_wake_up_time) {
         wake_sleeping_tasks();
     }
-    if (next_switching_time > 0 && uptime_msecs >= next_switching_time) {
+    if (cpu->next_switching_time > 0 && uptime_msecs >= cpu->next_switching_time) {
         // i think that to be able to switch during IRQ, our first switching must be 
         // done through IRQ, meaning, all the new task stacks should return to the IRQ handler.
         schedule();
     }
     unlock_scheduler();
 }
+
+// another cpu queued a process here that should preempt ours
+void multitasking_reschedule_requested() {
+    if (!process_switching_enabled)
+        return;
+
+    lock_scheduler();
+    if (ready_queues[smp_this_cpu_index()].total > 0)
+        schedule();
+    unlock_scheduler();
+}
@@ -0,0 +1,151 @@
+#include <multitask/process.h>
+#include <multitask/scheduler.h>
+#include <multitask/mutex.h>
+#include <memory/kheap.h>
+#include <klog.h>
+#include <klib/string.h>
+
+MODULE("MUTEX");
+
+
+mutex_t *create_mutex() {
+    mutex_t *mutex = kmalloc(sizeof(mutex_t));
+    memset(mutex, 0, sizeof(mutex_t));
+    return mutex;
+}
+
+static void add_to_held(process_t *proc, mutex_t *mutex) {
+    mutex->next_held = proc->held_mutexes;
+    proc->held_mutexes = mutex;
+}
+
+static void remove_from_held(process_t *proc, mutex_t *mutex) {
+    mutex_t **link = &proc->held_mutexes;
+    while (*link != NULL && *link != mutex)
+        link = &(*link)->next_held;
+    if (*link == mutex)
+        *link = mutex->next_held;
+    mutex->next_held = NULL;
+}
+
+// waiters sit in the blocked list of the mutex channel, caller locks the scheduler
+static process_t *highest_priority_waiter(mutex_t *mutex) {
+    process_t *best = NULL;
+    for (process_t *p = blocked_list_for(mutex)->head; p != NULL; p = p->next) {
+        if (p->block_reason != MUTEX || p->block_channel != mutex)
+            continue;
+        if (best == NULL || p->priority < best->priority)
+            best = p;
+    }
+    return best;
+}
+
+// the owner, and the owners of what it waits for, run at least at this priority
+static void lend_priority(process_t *owner, uint8_t priority) {
+    for (int depth = 0; owner != NULL && depth < MUTEX_INHERITANCE_DEPTH; depth++) {
+        if (owner->priority <= priority)
+            break;
+        klog_trace("process %s[%d] inherits priority %d", owner->name, owner->pid, priority);
+        scheduler_set_priority(owner, priority);
+        if (owner->state != BLOCKED || owner->block_reason != MUTEX)
+            break;
+        owner = ((mutex_t *)owner->block_channel)->owner;
+    }
+}
+
+// back to the base priority, or what waiters of still held mutexes lend us
+static void restore_priority(process_t *proc) {
+    uint8_t priority = proc->base_priority;
+    for (mutex_t *m = proc->held_mutexes; m != NULL; m = m->next_held) {
+        process_t *waiter = highest_priority_waiter(m);
+        if (waiter != NULL && waiter->priority < priority)
+            priority = waiter->priority;
+    }
+    scheduler_set_priority(proc, priority);
+}
+
+static inline bool try_acquire(mutex_t *mutex, process_t *proc) {
+    return __sync_bool_compare_and_swap(&mutex->owner, NULL, proc);
+}
+
+void acquire_mutex(mutex_t *mutex) {
+    process_t *proc = running_process();
+    uint32_t spins = 0;
+    if (proc == NULL)
+        return;
+
+    // uncontended, no need to lock the scheduler
+    if (try_acquire(mutex, proc)) {
+        add_to_held(proc, mutex);
+        goto acquired;
+    }
+
+    // an owner running on another cpu may release soon, cheaper than sleeping.
+    // on a single cpu, the owner cannot be running while we are.
+    for (; spins < MUTEX_SPIN_LIMIT; spins++) {
+        process_t *owner = mutex->owner;
+        if (owner != NULL && owner->state != RUNNING)
+            break;
+        if (owner == NULL && try_acquire(mutex, proc)) {
+            add_to_held(proc, mutex);
+            goto acquired;
+        }
+        asm("pause");
+    }
+
+    lock_scheduler();
+    if (try_acquire(mutex, proc)) {
+        add_to_held(proc, mutex);
+    } else {
+        // the releasing process hands the mutex over to us
+        klog_trace("process %s getting blocked on mutex", proc->name);
+        mutex->waiting_processes++;
+        lend_priority(mutex->owner, proc->priority);
+        proc_block(MUTEX, mutex);
+    }
+    unlock_scheduler();
+    spins++; // count it as contended, even if we did not spin
+
+acquired:
+#ifdef LOCK_STATS
+    lock_stats_acquired(mutex, spins);
+#endif
+    return;
+}
+
+void release_mutex(mutex_t *mutex) {
+    process_t *proc = running_process();
+    if (proc == NULL)
+        return;
+    if (mutex->owner != proc) {
+        klog_error("process %s[%d] releasing mutex it does not own", proc->name, proc->pid);
+        return;
+    }
+#ifdef LOCK_STATS
+    lock_stats_releasing(mutex);
+#endif
+
+    lock_scheduler();
+    remove_from_held(proc, mutex);
+
+    process_t *next = highest_priority_waiter(mutex);
+    if (next == NULL) {
+        mutex->owner = NULL;
+    } else {
+        klog_trace("mutex handed over to process %s", next->name);
+        mutex->owner = next;
+        mutex->waiting_processes--;
+        add_to_held(next, mutex);
+        unblock_process(next);
+        // the ones still waiting lend their priority to the new owner
+        process_t *waiter = highest_priority_waiter(mutex);
+        if (waiter != NULL)
+            lend_priority(next, waiter->priority);
+    }
+
+    // we may have been running with a borrowed priority
+    restore_priority(proc);
+    if (next != NULL && ready_process_should_preempt(next))
+        schedule();
+    unlock_scheduler();
+}
@@ -10,12 +10,16 @@
 #include <multitask/multitask.h>
 #include <memory/kheap.h>
 #include <memory/virtmem.h>
+#include <memory/physmem.h>
+#include <bits.h>
+#include <memory/slab.h>
 #include <klog.h>
 #include <errors.h>
 #include <multitask/process.h>
 #include <multitask/strvec.h>
 #include <filesys/mount.h>
 #include <filesys/vfs.h>
+#include <mman.h>
 
 MODULE("PROC");
 
@@ -73,12 +77,19 @@ MODULE("PROC");
  */
 
 
+// forked children start by returning from the syscall, see idt_low.asm
+extern void isr0x80_forked_child();
+
+static bool is_valid_handle(process_t *proc, int handle);
+
+
 pid_t last_pid = 0;
 lock_t pid_lock = 0;
+static kmem_cache_t *process_cache = NULL;
 
 
 char *process_state_names[] = { "READY", "RUNNING", "BLOCKED", "TERMINATED" };
-char *process_block_reason_names[] = { "", "SLEEPING", "SEMAPHORE", "WAIT USER INPUT", "WAIT CHILD EXIT" };
+char *process_block_reason_names[] = { "", "SLEEPING", "SEMAPHORE", "WAIT USER INPUT", "WAIT CHILD EXIT", "MUTEX", "RWLOCK READ", "RWLOCK WRITE", "FUTEX" };
 
 
 // starts a process, by putting it on the ready list.
@@ -86,15 +97,15 @@ void start_process(process_t *process) {
 
     // if we have not started multitasking yet... not much
     if (!multitasking_enabled()) {
-        append(&ready_lists[process->priority], process);
+        ready_list_append(process);
         return;
     }
 
     lock_scheduler();
-    append(&ready_lists[process->priority], process);
+    ready_list_append(process);
 
     // if running task is lower priority (e.g. idle task), preempt it
-    if (running_proc != NULL && process->priority < running_proc->priority)
+    if (ready_process_should_preempt(process))
         schedule();
     
     unlock_scheduler();
@@ -116,7 +127,7 @@ void proc_block(int reason, void *channel) {
     p->state = BLOCKED;
     p->block_reason = reason;
     p->block_channel = channel;
-    append(&blocked_list, p);
+    append(blocked_list_for(channel), p);
     klog_trace("process %s got blocked, reason %d, channel %p", p->name, reason, channel);
     schedule(); // allow someone else to run
     unlock_scheduler();
@@ -128,58 +139,190 @@ void unblock_process(process_t *proc) {
     if (proc->state != BLOCKED)
         return;
     lock_scheduler();
-    unlist(&blocked_list, proc);
+    if (proc->block_reason == SLEEPING)
+        sleepq_remove(&sleeping_queue, proc);
+    else
+        unlist(blocked_list_for(proc->block_channel), proc);
     proc->state = READY;
     proc->block_reason = 0;
     proc->block_channel = NULL;
-    prepend(&ready_lists[proc->priority], proc);
+    ready_list_prepend(proc);
     klog_trace("process %s unblocked and added to ready list", proc->name);
 
     // if the running process has a lower priority than the new task,
-    // let's preempt it, as we are higher priority, 
+    // (or has run a lot longer, in the fair class) let's preempt it,
     // otherwise, wait till timeshare expiration
-    if (running_proc->priority > proc->priority)
+    if (ready_process_should_preempt(proc))
         schedule();
     unlock_scheduler();
 }
 
-// this is how someone can unblock a process by reason
-void unblock_process_that(enum block_reasons block_reason, void *block_channel) {
-    if (blocked_list.head == NULL)
-        return;
+// this is how someone can unblock a process by reason, the one blocked first
+bool unblock_process_that(enum block_reasons block_reason, void *block_channel) {
+    proc_list_t *list = blocked_list_for(block_channel);
+    if (list->head == NULL)
+        return false;
     lock_scheduler();
 
-    process_t *proc = blocked_list.head;
+    // only processes of channels with the same hash are here
+    process_t *proc = list->head;
     while (proc != NULL) {
         if (proc->block_reason == block_reason && proc->block_channel == block_channel) {
             klog_trace("process %s getting unblocked", proc->name);
-            unlist(&blocked_list, proc);
+            unlist(list, proc);
             proc->state = READY;
             proc->block_reason = 0;
             proc->block_channel = NULL;
-            prepend(&ready_lists[proc->priority], proc);
+            ready_list_prepend(proc);
             break;
         }
         proc = proc->next;
     }
 
     // if the running process has a lower priority than the new task,
-    // let's preempt it, as we are higher priority, 
+    // (or has run a lot longer, in the fair class) let's preempt it,
     // otherwise, wait till timeshare expiration
-    if (proc != NULL && running_proc->priority > proc->priority)
+    if (proc != NULL && ready_process_should_preempt(proc))
         schedule();
     unlock_scheduler();
+    return proc != NULL;
+}
+
+
+// the child gets its own copy of the stack, the cpu writes on it when delivering faults,
+// so it cannot be shared copy on write. only the part above the syscall frame is live.
+static void populate_forked_stack(process_t *child, void *live_start) {
+    void *stack_bottom = child->user_proc.stack_bottom;
+    void *stack_top = stack_bottom + child->user_proc.stack_size;
+    live_start = (void *)ROUND_DOWN_4K((uint32_t)live_start);
+
+    for (void *page = stack_bottom; page < stack_top; page += 4096) {
+        void *phys_page = allocate_mapped_physical_page(true);
+        set_physical_page_owner(phys_page, PAGE_OWNER_USER);
+        void *contents = map_temporary_page(phys_page);
+        if (page >= live_start)
+            memcpy(contents, page, 4096);
+        else if (page == stack_bottom)
+            *(uint32_t *)contents = STACK_BOTTOM_MAGIC_VALUE;
+        unmap_temporary_page(contents);
+        map_owned_page(page, phys_page, child->page_directory);
+    }
 }
 
+// writes into an address space other than the current one
+static void copy_to_address_space(void *page_dir, void *virt_addr, void *source, int length) {
+    while (length > 0) {
+        int chunk = min(length, 4096 - (int)((uint32_t)virt_addr & 0xFFF));
+        void *phys_addr = resolve_virtual_to_physical_address(virt_addr, page_dir);
+        void *mapped_page = map_temporary_page((void *)ROUND_DOWN_4K((uint32_t)phys_addr));
+        memcpy(mapped_page + ((uint32_t)phys_addr & 0xFFF), source, chunk);
+        unmap_temporary_page(mapped_page);
+        virt_addr += chunk;
+        source += chunk;
+        length -= chunk;
+    }
+}
 
 // clone, return child's PID on parent, zero on child.
-int proc_fork() {
-    // similar to create process, 
-    // we could create_process(), copy things over,
-    // but this is not enough, 
-    // we need to bring info from the exec() loader.
-    // e.g. copy segments (stack, data, heap) etc. 
-    return ERR_NOT_IMPLEMENTED;
+// the child resumes by returning from its copy of the syscall frame.
+int proc_fork(void *syscall_frame) {
+    process_t *parent = running_process();
+    if (parent == NULL)
+        return ERR_NO_RUNNING_PROCESS;
+    if (parent->user_proc.vmas == NULL)
+        return ERR_NOT_SUPPORTED; // kernel tasks share the kernel address space
+    int err;
+
+    process_t *child = create_process(parent->name, NULL, parent->base_priority, parent, parent->tty);
+    if (child == NULL)
+        return ERR_NOT_SUPPORTED;
+    proc_chdir(child, parent->curr_dir_path);
+
+    child->user_proc.executable_path = kmalloc(strlen(parent->user_proc.executable_path) + 1);
+    strcpy(child->user_proc.executable_path, parent->user_proc.executable_path);
+    child->user_proc.argv = clone_strvec(parent->user_proc.argv);
+    child->user_proc.envp = clone_strvec(parent->user_proc.envp);
+    child->user_proc.heap = parent->user_proc.heap;
+    child->user_proc.heap_size = parent->user_proc.heap_size;
+    child->user_proc.stack_bottom = parent->user_proc.stack_bottom;
+    child->user_proc.stack_size = parent->user_proc.stack_size;
+    child->user_proc.vmas = vma_clone_all(parent->user_proc.vmas);
+
+    // pages not yet populated are still loaded on demand, by each process
+    err = vfs_reopen(parent->user_proc.executable, &child->user_proc.executable);
+    if (err) {
+        child->user_proc.executable = NULL;
+        cleanup_process(child);
+        return err;
+    }
+
+    // handles are duplicated, each side has its own file position from now on
+    for (int i = 0; i < MAX_FILE_HANDLES; i++) {
+        if (!is_valid_handle(parent, i))
+            continue;
+        file_t *file;
+        if (vfs_reopen(&parent->file_handles[i], &file) == SUCCESS) {
+            child->file_handles[i] = *file;
+            destroy_file_t(file);
+        }
+    }
+
+    // everything but the stack is shared, until written
+    void *stack_bottom = parent->user_proc.stack_bottom;
+    void *stack_top = stack_bottom + parent->user_proc.stack_size;
+    child->page_directory = clone_page_directory_copy_on_write(parent->page_directory, stack_bottom, stack_top);
+
+    // the child is switched in right under the syscall frame,
+    // as if it had been switched out there, but returning to a different place.
+    switched_stack_snapshot_t snapshot;
+    memset(&snapshot, 0, sizeof(snapshot));
+    snapshot.return_address = (uint32_t)isr0x80_forked_child;
+    child->esp = (uint32_t)syscall_frame - sizeof(switched_stack_snapshot_t);
+    populate_forked_stack(child, (void *)child->esp);
+    copy_to_address_space(child->page_directory, (void *)child->esp, &snapshot, sizeof(snapshot));
+
+    klog_debug("Process %s[%d] forked into pid %d", parent->name, parent->pid, child->pid);
+    start_process(child);
+    return child->pid;
+}
+
+bool proc_handle_page_fault(void *address, void *page_dir, bool page_present) {
+    process_t *proc = running_process();
+    if (proc == NULL || proc->page_directory != page_dir)
+        return false;
+    if (vma_find(proc->user_proc.vmas, address) == NULL) {
+        // nothing of the kernel is there, the process touched memory it does not have
+        if (proc->user_proc.vmas != NULL && address >= (void *)LOW_MEMORY_IDENTITY_END && address < MMAP_AREA_END) {
+            klog_error("Process %s[%d] accessed unmapped address 0x%p", proc->name, proc->pid, address);
+            proc_exit(-6);
+        }
+        return false;
+    }
+
+    if (page_present) {
+        klog_error("Process %s[%d] attempted writing on read only page at 0x%p", proc->name, proc->pid, address);
+        proc_exit(-6);
+    }
+
+    int err = vma_populate_page(proc->user_proc.vmas, proc->user_proc.executable, address);
+    if (err) {
+        klog_error("Failed populating page at 0x%p for process %s[%d], err %d", address, proc->name, proc->pid, err);
+        proc_exit(-6);
+    }
+    return true;
+}
+
+struct child_search {
+    process_t *parent;
+    bool found;
+};
+
+static void check_if_child(process_t *p, void *data) {
+    struct child_search *search = data;
+    if (p->parent == search->parent) {
+        klog_debug("Found pid %d as a child of pid %d", p->pid, search->parent->pid);
+        search->found = true;
+    }
 }
 
 bool proc_has_children(process_t *parent) {
@@ -187,18 +330,26 @@ bool proc_has_children(process_t *parent) {
     bool has_children = false;
     lock_scheduler();
 
-    // first check the running process
-    if (running_proc->parent == parent) {
-        klog_debug("The running process (%d) is a parent of %d", running_proc->pid, parent->pid);
+    // first check the running processes, one per cpu
+    struct child_search search = { .parent = parent, .found = false };
+    running_processes_walk(check_if_child, &search);
+    if (search.found) {
+        has_children = true;
+        goto exit;
+    }
+
+    // look at the ready queues and the fair trees
+    ready_processes_walk(check_if_child, &search);
+    if (search.found) {
         has_children = true;
         goto exit;
     }
 
-    // look at the ready queues
-    for (int priority = 0; priority < PROCESS_PRIORITY_LEVELS; priority++) {
-        process_t *p = ready_lists[priority].head;
+    // look at block queues
+    for (int i = 0; i < BLOCKED_LIST_BUCKETS; i++) {
+        process_t *p = blocked_lists[i].head;
         while (p != NULL) {
-            klog_debug("Checking priority %d, proc %s[%d]", priority, p->name, p->pid);
+            klog_debug("Checking proc %s[%d]", p->name, p->pid);
             if (p->parent == parent) {
                 klog_debug("Found pid %d as a child of pid %d", p->pid, parent->pid);
                 has_children = true;
@@ -208,16 +359,12 @@ bool proc_has_children(process_t *parent) {
         }
     }
 
-    // look at block queue
-    process_t *p = blocked_list.head;
-    while (p != NULL) {
-        klog_debug("Checking proc %s[%d]", p->name, p->pid);
-        if (p->parent == parent) {
-            klog_debug("Found pid %d as a child of pid %d", p->pid, parent->pid);
+    // and the sleeping ones
+    for (int i = 0; i < sleeping_queue.count; i++) {
+        if (sleeping_queue.heap[i]->parent == parent) {
             has_children = true;
             goto exit;
         }
-        p = p->next;
     }
 
 exit:
@@ -243,8 +390,8 @@ int proc_wait_child(int *exit_code) {
     // then block us, let the exit() call wake us up.
     p->state = BLOCKED;
     p->block_reason = WAIT_CHILD_EXIT;
-    p->block_channel = NULL;
-    append(&blocked_list, p);
+    p->block_channel = p; // spreads waiting parents over the blocked lists
+    append(blocked_list_for(p), p);
 
     schedule(); // allow someone else to run
     unlock_scheduler();
@@ -279,11 +426,9 @@ void proc_sleep(int milliseconds) {
     p->block_channel = NULL;
 
     // keep the earliest wake up time, useful for fast comparison
-    next_wake_up_time = (next_wake_up_time == 0)
-        ? p->wake_up_time
-        : min(next_wake_up_time, p->wake_up_time);
+    sleepq_insert(&sleeping_queue, p);
+    next_wake_up_time = sleepq_peek(&sleeping_queue)->wake_up_time;
     
-    append(&blocked_list, p);
     schedule(); // allow someone else to run
     unlock_scheduler();
 }
@@ -335,12 +480,16 @@ int proc_getcwd(process_t *proc, char *buffer, int size) {
 // in unices, this would be called chdir(), especially in libc
 int proc_chdir(process_t *proc, const char *path) {
 
-    if (vfs_get_root_mount() == NULL)
+    vfs_mounts_read_lock();
+    if (vfs_get_root_mount() == NULL) {
+        vfs_mounts_read_unlock();
         return ERR_NO_FS_MOUNTED;
+    }
     
     file_descriptor_t *root = vfs_get_root_mount()->mounted_fs_root;
     file_descriptor_t *target = NULL;
     int err = vfs_resolve(path, root, proc->curr_dir, false, &target);
+    vfs_mounts_read_unlock();
     if (err)
         return err;
 
@@ -357,7 +506,7 @@ int proc_chdir(process_t *proc, const char *path) {
 
 static void scheduler_unlocking_entry_point() {
     // unlock the scheduler in our first execution
-    unlock_scheduler(); 
+    unlock_scheduler_in_new_process(); 
 
     // we can now call the entry point.
     // for kernel tasks, this is a method in kernel space.
@@ -377,7 +526,9 @@ process_t *create_process(char *name, func_ptr entry_point, uint8_t priority, pr
         return NULL;
     }
 
-    process_t *p = (process_t *)kmalloc(sizeof(process_t));
+    if (process_cache == NULL)
+        process_cache = kmem_cache_create("process_t", sizeof(process_t), NULL);
+    process_t *p = (process_t *)kmem_cache_alloc(process_cache);
     memset(p, 0, sizeof(process_t));
     
     acquire(&pid_lock);
@@ -386,6 +537,7 @@ process_t *create_process(char *name, func_ptr entry_point, uint8_t priority, pr
 
     p->parent = parent;
     p->priority = priority;
+    p->base_priority = priority;
     p->tty = tty;
     p->name = kmalloc(strlen(name) + 1);
     strcpy(p->name, name);
@@ -426,6 +578,11 @@ void cleanup_process(process_t *proc) {
     if (proc->page_directory != NULL && proc->page_directory != get_kernel_page_directory())
         destroy_page_directory(proc->page_directory);
 
+    vma_free_all(&proc->user_proc.vmas);
+    if (proc->user_proc.executable != NULL) {
+        vfs_close(proc->user_proc.executable);
+        destroy_file_t(proc->user_proc.executable);
+    }
     if (proc->user_proc.executable_path != NULL)
         kfree(proc->user_proc.executable_path);
     if (proc->user_proc.argv != NULL)
@@ -439,7 +596,7 @@ void cleanup_process(process_t *proc) {
         kfree(proc->curr_dir_path);
     
     // can't think of anything else to free
-    kfree(proc);
+    kmem_cache_free(process_cache, proc);
 }
 
 static int allocate_file_handle(process_t *proc, file_t *file) {
@@ -488,7 +645,11 @@ int proc_open(process_t *proc, char *name) {
     int err = vfs_open(name, &file);
     if (err) return err;
 
+    // the handle keeps a copy of the file structure
     int handle = allocate_file_handle(proc, file);
+    if (handle < 0)
+        vfs_close(file);
+    destroy_file_t(file);
     return handle;
 }
 
@@ -520,6 +681,72 @@ int proc_close(process_t *proc, int handle) {
     return SUCCESS;
 }
 
+int proc_mmap(process_t *proc, uint32_t length, int prot, int flags, int handle, uint32_t offset) {
+    if (proc->user_proc.vmas == NULL)
+        return ERR_NOT_SUPPORTED; // kernel tasks use the kernel heap
+    if (length == 0 || (offset & 0xFFF) != 0)
+        return ERR_BAD_ARGUMENT;
+    // larger would wrap around when rounded up to pages
+    if (length > (uint32_t)(MMAP_AREA_END - MMAP_AREA_START))
+        return ERR_BAD_ARGUMENT;
+
+    // private anonymous pages are copied on write after fork(), shared ones are seen by both.
+    // file pages are never written back, so files are mapped read only.
+    bool anonymous = (flags & MAP_ANONYMOUS);
+    if (!anonymous && (prot & PROT_WRITE))
+        return ERR_NOT_SUPPORTED;
+
+    // the mapping keeps its own file, it outlives the handle
+    file_t *file = NULL;
+    if (!anonymous) {
+        if (!is_valid_handle(proc, handle))
+            return ERR_BAD_ARGUMENT;
+        if ((proc->file_handles[handle].descriptor->flags & FD_FILE) == 0)
+            return ERR_NOT_A_FILE;
+        int err = vfs_reopen(&proc->file_handles[handle], &file);
+        if (err)
+            return err;
+    }
+
+    void *start = vma_find_free_range(proc->user_proc.vmas, length, MMAP_AREA_START, MMAP_AREA_END);
+    if (start == NULL) {
+        if (file != NULL) {
+            vfs_close(file);
+            destroy_file_t(file);
+        }
+        return ERR_NO_ADDRESS_SPACE;
+    }
+
+    // pages are populated on first touch, as with the heap
+    vma_t *vma = vma_add(&proc->user_proc.vmas, VMA_MMAP,
+        ((prot & PROT_WRITE) ? VMA_WRITABLE : 0) | ((prot & PROT_EXEC) ? VMA_EXECUTABLE : 0),
+        start, start + length);
+    if (file != NULL) {
+        uint32_t file_size = file->descriptor->size;
+        vma->file = file;
+        vma->file_vaddr = start;
+        vma->file_offset = offset;
+        vma->file_size = offset >= file_size ? 0 : min(length, file_size - offset);
+    }
+    if (anonymous && (flags & MAP_SHARED))
+        vma->shared = shmem_create(length);
+
+    klog_debug("Process %s[%d] mapped %u bytes at 0x%p", proc->name, proc->pid, length, start);
+    return (int)start;
+}
+
+int proc_munmap(process_t *proc, void *address, uint32_t length) {
+    vma_t *vma = vma_find(proc->user_proc.vmas, address);
+    if (vma == NULL || vma->type != VMA_MMAP)
+        return ERR_BAD_ARGUMENT;
+    if (vma->start != address || vma->end != (void *)ROUND_UP_4K((uint32_t)address + length))
+        return ERR_NOT_SUPPORTED; // partial unmapping would need splitting areas
+
+    release_virtual_memory_range(vma->start, vma->end, proc->page_directory);
+    vma_remove(&proc->user_proc.vmas, vma);
+    return SUCCESS;
+}
+
 int proc_opendir(process_t *proc, char *name) {
     file_t *file;
     // fast resolve relative to cwd
@@ -527,6 +754,9 @@ int proc_opendir(process_t *proc, char *name) {
     if (err) return err;
 
     int handle = allocate_file_handle(proc, file);
+    if (handle < 0)
+        vfs_closedir(file);
+    destroy_file_t(file);
     klog_trace("proc_opendir() -> %d", handle);
     klog_debug("Process handles table follows");
     klog_debug_hex((void *)proc->file_handles, sizeof(file_t) * MAX_FILE_HANDLES, 0);
@@ -571,10 +801,14 @@ static void dump_process(process_t *proc) {
         proc->entry_point,
         (char *)process_state_names[(int)proc->state],
         (char *)process_block_reason_names[proc->block_reason],
-        (proc->cpu_ticks_total / 1000)
+        (uint32_t)(proc->cpu_ticks_total / 1000000000)
     );
 }
 
+static void dump_walked_process(process_t *proc, void *data) {
+    dump_process(proc);
+}
+
 static void dump_process_list(proc_list_t *list) {
     process_t *proc = list->head;
     while (proc != NULL) {
@@ -586,12 +820,23 @@ static void dump_process_list(proc_list_t *list) {
 void dump_process_table() {
     klog_info("Process list:");
     klog_info("PID  PPID Name                 ESP      EIP      State      Blck Reasn    CPU");
-    dump_process((process_t *)running_proc);
-    for (int pri = 0; pri < PROCESS_PRIORITY_LEVELS; pri++) {
-        dump_process_list(&ready_lists[pri]);
-    }
-    dump_process_list(&blocked_list);
+    running_processes_walk(dump_walked_process, NULL);
+    ready_processes_walk(dump_walked_process, NULL);
+    for (int i = 0; i < BLOCKED_LIST_BUCKETS; i++)
+        dump_process_list(&blocked_lists[i]);
+    for (int i = 0; i < sleeping_queue.count; i++)
+        dump_process(sleeping_queue.heap[i]);
     dump_process_list(&terminated_list);
+    for (int i = 0; i < smp_cpus_count(); i++) {
+        cpu_t *cpu = smp_get_cpu(i);
+        klog_info("Cpu %d running %s[%d], %d ready, priorities bitmap 0x%02x, fair min vruntime %u ms", 
+            i,
+            cpu->current_proc == NULL ? "-" : cpu->current_proc->name,
+            cpu->current_proc == NULL ? 0 : cpu->current_proc->pid,
+            ready_queues[i].total,
+            ready_queues[i].priorities_bitmap,
+            (uint32_t)(ready_queues[i].fair_queue.min_vruntime / 1000));
+    }
 }
 
 const char *proc_get_status_name(enum process_state state) {
@@ -619,6 +864,14 @@ const char *proc_get_block_reason_name(enum block_reasons reason) {
             return "WAIT_KBD";
         case WAIT_CHILD_EXIT:
             return "WAIT CHILD";
+        case MUTEX:
+            return "MUTEX";
+        case RWLOCK_READ:
+            return "RWLOCK RD";
+        case RWLOCK_WRITE:
+            return "RWLOCK WR";
+        case FUTEX:
+            return "FUTEX";
         default:
             return "?";
     }
@@ -0,0 +1,74 @@
+#include <multitask/process.h>
+#include <multitask/scheduler.h>
+#include <multitask/rwlock.h>
+#include <klog.h>
+
+MODULE("RWLOCK");
+
+
+// the lock just got free, caller locks the scheduler
+static void hand_over(rwlock_t *rw) {
+    // writers first, they have kept new readers waiting.
+    // a waiter may be missing, if it was killed.
+    while (rw->waiting_writers > 0 && !rw->writer) {
+        rw->waiting_writers--;
+        if (unblock_process_that(RWLOCK_WRITE, rw))
+            rw->writer = true;
+    }
+    if (rw->writer)
+        return;
+
+    // all the readers in one go
+    while (rw->waiting_readers > 0) {
+        rw->waiting_readers--;
+        if (unblock_process_that(RWLOCK_READ, rw))
+            rw->readers++;
+    }
+}
+
+void acquire_rwlock_read(rwlock_t *rw) {
+    lock_scheduler();
+
+    if (!rw->writer && rw->waiting_writers == 0) {
+        rw->readers++;
+    } else {
+        klog_trace("process %s waiting to read", running_process()->name);
+        rw->waiting_readers++;
+        proc_block(RWLOCK_READ, rw);
+    }
+
+    unlock_scheduler();
+}
+
+void release_rwlock_read(rwlock_t *rw) {
+    lock_scheduler();
+
+    rw->readers--;
+    if (rw->readers == 0)
+        hand_over(rw);
+
+    unlock_scheduler();
+}
+
+void acquire_rwlock_write(rwlock_t *rw) {
+    lock_scheduler();
+
+    if (!rw->writer && rw->readers == 0) {
+        rw->writer = true;
+    } else {
+        klog_trace("process %s waiting to write", running_process()->name);
+        rw->waiting_writers++;
+        proc_block(RWLOCK_WRITE, rw);
+    }
+
+    unlock_scheduler();
+}
+
+void release_rwlock_write(rwlock_t *rw) {
+    lock_scheduler();
+
+    rw->writer = false;
+    hand_over(rw);
+
+    unlock_scheduler();
+}
@@ -6,17 +6,16 @@
 #include <klog.h>
 #include <memory/virtmem.h>
 #include <bits.h>
+#include <smp.h>
+#include <multitask/multitask.h>
 
 MODULE("SCHED");
 
 
-volatile int switching_postpone_depth = 0;
-volatile bool task_switching_pending = false;
-volatile process_t *running_proc = NULL;
-proc_list_t ready_lists[PROCESS_PRIORITY_LEVELS];
-proc_list_t blocked_list;
+ready_queue_t ready_queues[MAX_CPUS];
+proc_list_t blocked_lists[BLOCKED_LIST_BUCKETS];
+sleep_queue_t sleeping_queue;
 proc_list_t terminated_list;
-uint64_t next_switching_time = 0;
 uint64_t next_wake_up_time = 0;
 
 
@@ -42,57 +41,365 @@ extern void low_level_context_switch(uint32_t *old_esp_ptr, uint32_t *new_esp_pt
 
 void lock_scheduler() {
     pushcli();
-    switching_postpone_depth++;
+    smp_this_cpu()->switching_postpone_depth++;
 }
 
 void unlock_scheduler() {
-    switching_postpone_depth--;
-    if (switching_postpone_depth == 0) {
+    cpu_t *cpu = smp_this_cpu();
+    cpu->switching_postpone_depth--;
+    if (cpu->switching_postpone_depth == 0) {
         // if there was a need to switch, while postponed,
         // do it before we enable interrupts again
-        if (task_switching_pending) {
-            task_switching_pending = false;
+        if (cpu->task_switching_pending) {
+            cpu->task_switching_pending = false;
             schedule();
         }
     }
     popcli();
 }
 
+void unlock_scheduler_in_new_process() {
+    // whoever switched to us left its own nesting on this cpu
+    cpu_t *cpu = smp_this_cpu();
+    cpu->cli_depth = 1;
+    cpu->zero_depth_enabled = true;
+    cpu->switching_postpone_depth = 1;
+    unlock_scheduler();
+}
+
+#if PROCESS_PRIORITY_LEVELS > 32
+    #error "ready priorities bitmap holds up to 32 priority levels"
+#endif
+
+bool is_fair_priority(uint8_t priority) {
+#ifdef FAIR_SCHEDULING
+    return priority >= FAIR_PRIORITY_FIRST && priority <= FAIR_PRIORITY_LAST;
+#else
+    return false;
+#endif
+}
+
+// the bit / ready list a priority is served from
+static inline uint8_t class_priority(uint8_t priority) {
+    return is_fair_priority(priority) ? FAIR_PRIORITY_FIRST : priority;
+}
+
+// about twice the cpu time per priority level up
+static inline uint32_t fair_weight(uint8_t priority) {
+    return (FAIR_NICE_0_WEIGHT << PRIORITY_USER_PROGRAM) >> priority;
+}
+
+static void update_min_vruntime(ready_queue_t *queue, process_t *running) {
+    fair_queue_t *fair_queue = &queue->fair_queue;
+    uint64_t candidate = fair_queue->min_vruntime;
+    process_t *first = fairq_first(fair_queue);
+    bool running_fair = (running != NULL && running->state == RUNNING && is_fair_priority(running->priority));
+
+    if (first != NULL && running_fair)
+        candidate = first->vruntime < running->vruntime ? first->vruntime : running->vruntime;
+    else if (first != NULL)
+        candidate = first->vruntime;
+    else if (running_fair)
+        candidate = running->vruntime;
+
+    if (candidate > fair_queue->min_vruntime)
+        fair_queue->min_vruntime = candidate;
+}
+
+// new and preempted processes keep up with the others, waking ones get a head start.
+// no process can bank time while blocked, to take over the cpu later.
+static void fair_enqueue(ready_queue_t *queue, process_t *proc, bool waking) {
+    uint64_t floor = queue->fair_queue.min_vruntime;
+    uint64_t bonus = FAIR_SCHED_LATENCY_MSECS * 1000 / 2;
+    if (waking)
+        floor = floor > bonus ? floor - bonus : 0;
+    if (proc->vruntime < floor)
+        proc->vruntime = floor;
+
+    fairq_insert(&queue->fair_queue, proc);
+}
+
+// vruntimes only compare within a queue, moving keeps the distance from the minimum
+static void migrate_vruntime(process_t *proc, ready_queue_t *from, ready_queue_t *to) {
+    uint64_t from_min = from->fair_queue.min_vruntime;
+    uint64_t lag = proc->vruntime > from_min ? proc->vruntime - from_min : 0;
+    proc->vruntime = to->fair_queue.min_vruntime + lag;
+}
+
+// timeslice for the process, fair class ones share the latency period
+static uint32_t timeslice_msecs(ready_queue_t *queue, process_t *proc) {
+    if (!is_fair_priority(proc->priority))
+        return DEFAULT_TASK_TIMESLICE_MSECS;
+    uint32_t slice = FAIR_SCHED_LATENCY_MSECS / (queue->fair_queue.count + 1);
+    return slice < FAIR_MIN_TIMESLICE_MSECS ? FAIR_MIN_TIMESLICE_MSECS : slice;
+}
+
+// charges the time since the process was last accounted
+static void account_running_time(ready_queue_t *queue, process_t *proc) {
+    uint64_t now = clock_monotonic_ns();
+    uint64_t elapsed = now - proc->cpu_ticks_last;
+    proc->cpu_ticks_total += elapsed;
+    proc->cpu_ticks_last = now;
+
+    if (is_fair_priority(proc->priority)) {
+        proc->vruntime += elapsed / 1000 * FAIR_NICE_0_WEIGHT / fair_weight(proc->priority);
+        update_min_vruntime(queue, proc);
+    }
+}
+
+// application processors take processes once multitasking starts on them
+static inline bool cpu_schedulable(cpu_t *cpu) {
+    return cpu->online && cpu->idle_proc != NULL;
+}
+
+// the ready processes, and the running one unless it is the idle process
+static int cpu_load(cpu_t *cpu) {
+    int load = ready_queues[cpu->index].total;
+    if (cpu->current_proc != cpu->idle_proc)
+        load++;
+    return load;
+}
+
+// stay where the caches are warm, unless another cpu has less to do
+static cpu_t *select_cpu(process_t *proc) {
+    cpu_t *best = smp_get_cpu(proc->cpu);
+    if (best == NULL || !cpu_schedulable(best))
+        best = smp_bootstrap_cpu();
+    int best_load = cpu_load(best);
+
+    for (int i = 0; i < smp_cpus_count() && best_load > 0; i++) {
+        cpu_t *cpu = smp_get_cpu(i);
+        if (!cpu_schedulable(cpu))
+            continue;
+        int load = cpu_load(cpu);
+        if (load < best_load) {
+            best = cpu;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+static void queue_on(cpu_t *cpu, process_t *proc, bool at_front) {
+    ready_queue_t *queue = &ready_queues[cpu->index];
+    uint8_t priority = class_priority(proc->priority);
+    if (is_fair_priority(proc->priority))
+        fair_enqueue(queue, proc, at_front);
+    else if (at_front)
+        prepend(&queue->lists[priority], proc);
+    else
+        append(&queue->lists[priority], proc);
+
+    queue->counts[priority]++;
+    queue->total++;
+    queue->priorities_bitmap |= (1 << priority);
+    proc->cpu = cpu->index;
+}
+
+static bool should_preempt_on(cpu_t *cpu, process_t *proc) {
+    process_t *running = cpu->current_proc;
+    if (running == NULL)
+        return false;
+    if (running == cpu->idle_proc)
+        return true;
+
+    uint8_t proc_class = class_priority(proc->priority);
+    uint8_t running_class = class_priority(running->priority);
+    if (proc_class != running_class)
+        return proc_class < running_class;
+
+    // within the fair class, only if it has run clearly less
+    if (is_fair_priority(proc->priority))
+        return proc->vruntime + FAIR_WAKEUP_GRANULARITY_USECS < running->vruntime;
+    return false;
+}
+
+static void ready_list_add(process_t *proc, bool at_front) {
+    cpu_t *cpu = select_cpu(proc);
+    if (is_fair_priority(proc->priority) && cpu->index != proc->cpu)
+        migrate_vruntime(proc, &ready_queues[proc->cpu], &ready_queues[cpu->index]);
+    queue_on(cpu, proc, at_front);
+
+    // the other cpu may be halted, or would only notice on its next timer tick
+    if (cpu != smp_this_cpu() && multitasking_enabled() && should_preempt_on(cpu, proc))
+        smp_send_reschedule(cpu);
+}
+
+void ready_list_append(process_t *proc) {
+    ready_list_add(proc, false);
+}
+
+void ready_list_prepend(process_t *proc) {
+    ready_list_add(proc, true);
+}
+
+void ready_list_remove(process_t *proc) {
+    ready_queue_t *queue = &ready_queues[proc->cpu];
+    uint8_t priority = class_priority(proc->priority);
+    if (is_fair_priority(proc->priority))
+        fairq_remove(&queue->fair_queue, proc);
+    else
+        unlist(&queue->lists[priority], proc);
+
+    queue->total--;
+    if (--queue->counts[priority] == 0)
+        queue->priorities_bitmap &= ~(1 << priority);
+}
+
+void scheduler_set_priority(process_t *proc, uint8_t priority) {
+    if (proc->priority == priority)
+        return;
+
+    // ready ones are kept by priority, move them, on the same cpu
+    if (proc->state == READY) {
+        ready_list_remove(proc);
+        proc->priority = priority;
+        queue_on(smp_get_cpu(proc->cpu), proc, false);
+    } else {
+        proc->priority = priority;
+    }
+}
+
+// lowest set bit is the highest priority with ready processes, one bsf instruction
+static process_t *ready_list_dequeue_highest(ready_queue_t *queue) {
+    if (queue->priorities_bitmap == 0)
+        return NULL;
+
+    int priority = __builtin_ctz(queue->priorities_bitmap);
+    process_t *proc = is_fair_priority(priority)
+        ? fairq_pop_first(&queue->fair_queue)
+        : dequeue(&queue->lists[priority]);
+    queue->total--;
+    if (--queue->counts[priority] == 0)
+        queue->priorities_bitmap &= ~(1 << priority);
+    return proc;
+}
+
+// the cpu with the most ready processes, among the ones busy running something else
+static cpu_t *busiest_cpu(cpu_t *thief) {
+    cpu_t *busiest = NULL;
+    int most = 0;
+    for (int i = 0; i < smp_cpus_count(); i++) {
+        cpu_t *cpu = smp_get_cpu(i);
+        if (cpu == thief || !cpu_schedulable(cpu) || cpu->current_proc == cpu->idle_proc)
+            continue;
+        if (ready_queues[i].total > most) {
+            busiest = cpu;
+            most = ready_queues[i].total;
+        }
+    }
+    return busiest;
+}
+
+// an empty queue takes the highest priority process that waits on a busy cpu
+static process_t *steal_ready_process(cpu_t *thief) {
+    cpu_t *victim = busiest_cpu(thief);
+    if (victim == NULL)
+        return NULL;
+
+    process_t *proc = ready_list_dequeue_highest(&ready_queues[victim->index]);
+    if (is_fair_priority(proc->priority))
+        migrate_vruntime(proc, &ready_queues[victim->index], &ready_queues[thief->index]);
+    proc->cpu = thief->index;
+    klog_trace("cpu %d stole \"%s\" from cpu %d", thief->index, proc->name, victim->index);
+    return proc;
+}
+
+bool ready_process_should_preempt(process_t *proc) {
+    cpu_t *cpu = smp_this_cpu();
+    if (proc->cpu != cpu->index)
+        return false;
+    return should_preempt_on(cpu, proc);
+}
+
+bool ready_process_available() {
+    cpu_t *cpu = smp_this_cpu();
+    return ready_queues[cpu->index].total > 0 || busiest_cpu(cpu) != NULL;
+}
+
+bool all_cpus_idle() {
+    for (int i = 0; i < smp_cpus_count(); i++) {
+        cpu_t *cpu = smp_get_cpu(i);
+        if (ready_queues[i].total > 0 || cpu->current_proc != cpu->idle_proc)
+            return false;
+    }
+    return true;
+}
+
+void ready_processes_walk(void (*func)(process_t *proc, void *data), void *data) {
+    for (int i = 0; i < smp_cpus_count(); i++) {
+        ready_queue_t *queue = &ready_queues[i];
+        for (int priority = 0; priority < PROCESS_PRIORITY_LEVELS; priority++) {
+            for (process_t *p = queue->lists[priority].head; p != NULL; p = p->next)
+                func(p, data);
+        }
+        fairq_walk(&queue->fair_queue, func, data);
+    }
+}
+
+void running_processes_walk(void (*func)(process_t *proc, void *data), void *data) {
+    for (int i = 0; i < smp_cpus_count(); i++) {
+        cpu_t *cpu = smp_get_cpu(i);
+        if (cpu->current_proc != NULL)
+            func(cpu->current_proc, data);
+    }
+}
+
+proc_list_t *blocked_list_for(void *channel) {
+    // channels are addresses of structures, the low bits say little
+    uint32_t hash = ((uint32_t)channel >> 4) * 2654435761u;
+    return &blocked_lists[hash >> 27];
+}
+
 // caller is responsible for locking interrupts before calling us
 void schedule() { 
+    cpu_t *cpu = smp_this_cpu();
+
     // allow locking of switching, to allow multiple tasks to be unlbocked
-    if (switching_postpone_depth > 0) {
-        task_switching_pending = true;
+    if (cpu->switching_postpone_depth > 0) {
+        cpu->task_switching_pending = true;
         return;
     }
 
-    // extract high priority tasks first
-    process_t *next = NULL;
-    for (int priority = 0; priority < PROCESS_PRIORITY_LEVELS; priority++) {
-        next = dequeue(&ready_lists[priority]);
-        if (next != NULL)
-            break;
+    // if current task is running (as opposed to be blocked or sleeping), it competes too.
+    // the idle process is never queued, it runs when there is nothing else.
+    ready_queue_t *queue = &ready_queues[cpu->index];
+    process_t *previous = cpu->current_proc;
+    account_running_time(queue, previous);
+    bool was_running = (previous->state == RUNNING);
+    if (was_running && previous != cpu->idle_proc) {
+        previous->state = READY;
+        queue_on(cpu, previous, false);
     }
 
+    // extract high priority tasks first, then help the busy cpus
+    process_t *next = ready_list_dequeue_highest(queue);
     if (next == NULL)
-        return; // nothing to switch to
-    
-    // if current task is running (as opposed to be blocked or sleeping), put back to the ready list
-    process_t *previous = (process_t *)running_proc;
-    if (previous->state == RUNNING) {
-        previous->state = READY;
-        append(&ready_lists[previous->priority], previous);
+        next = steal_ready_process(cpu);
+    if (next == NULL)
+        next = cpu->idle_proc;
+    if (next == previous) {
+        // nothing better to switch to
+        if (was_running)
+            previous->state = RUNNING;
+        cpu->next_switching_time = timer_get_uptime_msecs() + timeslice_msecs(queue, previous);
+        return;
     }
 
-    // before switching, some house keeping
-    previous->cpu_ticks_total += (timer_get_uptime_msecs() - previous->cpu_ticks_last);
-
     // mark the new running proc, "next" variable will have a different value afterwards
-    running_proc = next;
-    running_proc->state = RUNNING;
-    next_switching_time = timer_get_uptime_msecs() + DEFAULT_TASK_TIMESLICE_MSECS;
+    cpu->current_proc = next;
+    next->state = RUNNING;
+    next->cpu = cpu->index;
+    cpu->next_switching_time = timer_get_uptime_msecs() + timeslice_msecs(queue, next);
+    // new processes do not return below, start counting here
+    next->cpu_ticks_last = clock_monotonic_ns();
 
-    klog_trace("scheduler(): switching \"%s\" --> \"%s\", page dir 0x%p", previous->name, next->name, next->page_directory);
+    klog_trace("scheduler(): cpu %d switching \"%s\" --> \"%s\", page dir 0x%p", cpu->index, previous->name, next->name, next->page_directory);
+
+    // the pushcli() nesting belongs to the context, not to the cpu. the kernel lock
+    // stays held across the switch, whoever we switch to releases it.
+    int cli_depth = cpu->cli_depth;
+    bool zero_depth_enabled = cpu->zero_depth_enabled;
     
     /**
      * -------------------------------------------------------------------
@@ -110,11 +417,14 @@ void schedule() {
      */
     low_level_context_switch(
         &previous->esp,
-        (uint32_t *)&running_proc->esp,
-        (uint32_t)running_proc->page_directory
+        (uint32_t *)&next->esp,
+        (uint32_t)next->page_directory
     );
 
-    running_proc->cpu_ticks_last = timer_get_uptime_msecs();
+    // we may have been switched back in by another cpu
+    cpu = smp_this_cpu();
+    cpu->cli_depth = cli_depth;
+    cpu->zero_depth_enabled = zero_depth_enabled;
 
     // check stack underflow
     if (running_proc->allocated_kernel_stack != NULL) {
@@ -126,4 +436,3 @@ void schedule() {
             klog_crit("Process %s[%d] user stack bottom magic number mismatch (expected 0x%x, got 0x%x)", running_proc->name, running_proc->pid, STACK_BOTTOM_MAGIC_VALUE, *(uint32_t *)running_proc->user_proc.stack_bottom);
     }
 }
-
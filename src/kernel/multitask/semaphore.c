@@ -36,28 +36,16 @@ void release_semaphore(semaphore_t *semaphore) {
     lock_scheduler();
 
 
+    // the process waiting the longest is found in the blocked list of the semaphore
     bool unblocked_a_process = false;
-    process_t *target_proc = NULL;
     if (semaphore->waiting_processes > 0) {
         klog_trace("semaphore releasing, there are waiting processes");
-        // if there are processes waiting, let's unblock them now
-        target_proc = blocked_list.head;
-        while (target_proc != NULL) {
-            if (target_proc->state == BLOCKED 
-                && target_proc->block_reason == SEMAPHORE 
-                && target_proc->block_channel == semaphore
-            ) {
-                unblock_process(target_proc);
-                unblocked_a_process = true;
-                break;
-            }
-            target_proc = target_proc->next;
-        }
+        unblocked_a_process = unblock_process_that(SEMAPHORE, semaphore);
     }
     if (unblocked_a_process) {
         // somebody was waiting and we liberated them
         // we don't lower the count, they now hold the semaphore
-        klog_trace("waiting process %s now unblocked to own the semaphore", target_proc->name);
+        klog_trace("waiting process now unblocked to own the semaphore");
         semaphore->waiting_processes--;
     } else {
         // either nobody was waiting, or we did not find them (they may have been killed)
@@ -68,17 +56,3 @@ void release_semaphore(semaphore_t *semaphore) {
 
     unlock_scheduler();
 }
-
-mutex_t *create_mutex() {
-    return (mutex_t *)create_semaphore(1);
-}
-
-void acquire_mutex(mutex_t *mutex) {
-    acquire_semaphore((semaphore_t *)mutex);
-}
-
-void release_mutex(mutex_t *mutex) {
-    release_semaphore((semaphore_t *)mutex);
-}
-
-
@@ -0,0 +1,89 @@
+#include <multitask/process.h>
+#include <multitask/sleepq.h>
+#include <memory/kheap.h>
+#include <klib/string.h>
+
+#define INITIAL_CAPACITY   32
+
+
+static inline void place(sleep_queue_t *queue, int index, process_t *proc) {
+    queue->heap[index] = proc;
+    proc->sleep_queue_index = index;
+}
+
+static void sift_up(sleep_queue_t *queue, int index) {
+    process_t *proc = queue->heap[index];
+    while (index > 0) {
+        int parent = (index - 1) / 2;
+        if (queue->heap[parent]->wake_up_time <= proc->wake_up_time)
+            break;
+        place(queue, index, queue->heap[parent]);
+        index = parent;
+    }
+    place(queue, index, proc);
+}
+
+static void sift_down(sleep_queue_t *queue, int index) {
+    process_t *proc = queue->heap[index];
+    while (true) {
+        int child = index * 2 + 1;
+        if (child >= queue->count)
+            break;
+        if (child + 1 < queue->count && queue->heap[child + 1]->wake_up_time < queue->heap[child]->wake_up_time)
+            child++;
+        if (proc->wake_up_time <= queue->heap[child]->wake_up_time)
+            break;
+        place(queue, index, queue->heap[child]);
+        index = child;
+    }
+    place(queue, index, proc);
+}
+
+// add a sleeping process, by its wake_up_time. O(log n)
+void sleepq_insert(sleep_queue_t *queue, process_t *proc) {
+    if (queue->count == queue->capacity) {
+        int capacity = queue->capacity == 0 ? INITIAL_CAPACITY : queue->capacity * 2;
+        process_t **heap = kmalloc(capacity * sizeof(process_t *));
+        if (queue->heap != NULL) {
+            memcpy(heap, queue->heap, queue->count * sizeof(process_t *));
+            kfree(queue->heap);
+        }
+        queue->heap = heap;
+        queue->capacity = capacity;
+    }
+
+    queue->heap[queue->count] = proc;
+    queue->count++;
+    sift_up(queue, queue->count - 1);
+}
+
+// the process to wake up first, or NULL. O(1)
+process_t *sleepq_peek(sleep_queue_t *queue) {
+    return queue->count == 0 ? NULL : queue->heap[0];
+}
+
+// extract the process to wake up first, or NULL. O(log n)
+process_t *sleepq_pop(sleep_queue_t *queue) {
+    if (queue->count == 0)
+        return NULL;
+    process_t *proc = queue->heap[0];
+    sleepq_remove(queue, proc);
+    return proc;
+}
+
+// remove a process woken up before its time. O(log n)
+void sleepq_remove(sleep_queue_t *queue, process_t *proc) {
+    int index = proc->sleep_queue_index;
+    if (index < 0 || index >= queue->count || queue->heap[index] != proc)
+        return; // not in the queue
+
+    queue->count--;
+    proc->sleep_queue_index = -1;
+    if (index == queue->count)
+        return;
+
+    // the last one takes its place, then moves to where it belongs
+    place(queue, index, queue->heap[queue->count]);
+    sift_down(queue, index);
+    sift_up(queue, index);
+}
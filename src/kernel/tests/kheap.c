@@ -1,6 +1,10 @@
 #include <memory/kheap.h>
+#include <drivers/timer.h>
+#include <klog.h>
 #include "framework.h"
 
+MODULE("UNITTEST");
+
 
 
 void test_kernel_heap() {
@@ -28,7 +32,63 @@ void test_kernel_heap() {
     assert(kernel_heap_free_size() == free_mem);
 
     kernel_heap_verify();
+
+    // a freed block of the same size class should be found and reused
+    void *big = kmalloc(3000);
+    void *guard = kmalloc(20);
+    kfree(big);
+    void *again = kmalloc(2500);
+    assert(again == big);
+    kfree(again);
+    kfree(guard);
+    assert(kernel_heap_free_size() == free_mem);
+
+    kernel_heap_verify();
+}
+
+
+
+
+// the heap should grow when needed, and give memory back when freed
+void test_kernel_heap_growth() {
+    uint32_t free_mem = kernel_heap_free_size();
+    uint32_t total_size = kernel_heap_total_size();
+
+    void *p = kmalloc(free_mem + 4096);
+    assert(p != NULL);
+    assert(kernel_heap_total_size() > total_size);
+    kernel_heap_verify();
+
+    kfree(p);
+    assert(kernel_heap_total_size() == total_size);
+    assert(kernel_heap_free_size() == free_mem);
+    kernel_heap_verify();
 }
 
+static uint32_t time_alloc_free_loop(bool zero, size_t size, int iterations) {
+    uint64_t start = timer_get_uptime_msecs();
+    for (int i = 0; i < iterations; i++) {
+        void *p = zero ? kmalloc(size) : kmalloc_nozero(size);
+        kfree(p);
+    }
+    return (uint32_t)(timer_get_uptime_msecs() - start);
+}
 
+// compares the cost of clearing memory on allocation, with a cluster sized buffer.
+// a benchmark, not part of the boot time tests, see run_frameworked_benchmarks()
+void test_kernel_heap_benchmark() {
+    uint32_t free_mem = kernel_heap_free_size();
+    int iterations = 1000;
+    size_t size = 64 * 1024;
+
+    uint32_t zeroed_msecs = time_alloc_free_loop(true, size, iterations);
+    uint32_t nozero_msecs = time_alloc_free_loop(false, size, iterations);
+
+    klog_info("kmalloc/kfree of %u bytes, %d times: zeroed %u msecs, nozero %u msecs",
+        size, iterations, zeroed_msecs, nozero_msecs);
+    #ifdef DEBUG_HEAP_POISON
+        klog_info("(heap poisoning is enabled, kfree() fills memory in both cases)");
+    #endif
 
+    assert(kernel_heap_free_size() == free_mem);
+}
@@ -0,0 +1,64 @@
+#include <multitask/process.h>
+#include <multitask/scheduler.h>
+#include <multitask/mutex.h>
+#include <klib/string.h>
+#include "framework.h"
+
+
+static mutex_t test_mutex;
+static volatile bool holder_has_mutex;
+static volatile bool waiter_got_mutex;
+static volatile int finished_processes;
+static volatile uint8_t holder_priority_while_waited;
+static volatile uint8_t holder_priority_after_release;
+
+// a user priority process, holding the mutex while sleeping, as during disk i/o
+static void mutex_holder() {
+    acquire_mutex(&test_mutex);
+    holder_has_mutex = true;
+    while (test_mutex.waiting_processes == 0)
+        proc_sleep(1);
+
+    lock_scheduler();
+    holder_priority_while_waited = running_process()->priority;
+    unlock_scheduler();
+
+    release_mutex(&test_mutex);
+    holder_priority_after_release = running_process()->priority;
+    __sync_fetch_and_add(&finished_processes, 1);
+    proc_exit(0);
+}
+
+// a driver priority process, that blocks until the holder lets go
+static void mutex_waiter() {
+    while (!holder_has_mutex)
+        proc_sleep(1);
+    acquire_mutex(&test_mutex);
+    waiter_got_mutex = true;
+    release_mutex(&test_mutex);
+    __sync_fetch_and_add(&finished_processes, 1);
+    proc_exit(0);
+}
+
+// needs multitasking, see run_frameworked_multitasking_tests()
+void test_mutex_priority_inheritance() {
+    memset((char *)&test_mutex, 0, sizeof(test_mutex));
+    holder_has_mutex = false;
+    waiter_got_mutex = false;
+    finished_processes = 0;
+
+    process_t *holder = create_process("Mutex holder", mutex_holder, PRIORITY_USER_PROGRAM, NULL, NULL);
+    process_t *waiter = create_process("Mutex waiter", mutex_waiter, PRIORITY_DRIVERS, NULL, NULL);
+    start_process(holder);
+    start_process(waiter);
+
+    for (int i = 0; i < 1000 && finished_processes < 2; i++)
+        proc_sleep(1);
+
+    assert(finished_processes == 2);
+    assert(waiter_got_mutex);
+    assert(holder_priority_while_waited == PRIORITY_DRIVERS);
+    assert(holder_priority_after_release == PRIORITY_USER_PROGRAM);
+    assert(test_mutex.owner == NULL);
+    assert(test_mutex.waiting_processes == 0);
+}
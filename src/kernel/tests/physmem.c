@@ -0,0 +1,42 @@
+#include <memory/physmem.h>
+#include "framework.h"
+
+
+void test_physical_memory() {
+    phys_mem_info_t before, after;
+    get_physical_memory_info(&before);
+
+    // a 5 pages request is served by an 8 pages block, the rest is given back
+    uint32_t block = (uint32_t)allocate_consecutive_physical_pages(5 * 4096, 0);
+    assert(block != 0);
+    assert((block / 4096) % 8 == 0);
+    get_physical_memory_info(&after);
+    assert(after.pages_free == before.pages_free - 5);
+
+    uint32_t page = (uint32_t)allocate_physical_page((void *)0x100000);
+    assert(page >= 0x100000);
+    assert(page < block || page >= block + 5 * 4096);
+
+    free_physical_page((void *)page);
+    free_consecutive_physical_pages((void *)block, 5 * 4096);
+    get_physical_memory_info(&after);
+    assert(after.pages_free == before.pages_free);
+}
+
+void test_physical_page_refcount() {
+    phys_mem_info_t before, after;
+    get_physical_memory_info(&before);
+
+    void *page = allocate_physical_page((void *)0x100000);
+    assert(get_page_frame(page)->refcount == 1);
+    physical_page_add_ref(page);
+    assert(get_page_frame(page)->refcount == 2);
+
+    // the page survives until the last reference is dropped
+    assert(physical_page_release(page) == 1);
+    get_physical_memory_info(&after);
+    assert(after.pages_free == before.pages_free - 1);
+    assert(physical_page_release(page) == 0);
+    get_physical_memory_info(&after);
+    assert(after.pages_free == before.pages_free);
+}
@@ -0,0 +1,114 @@
+#include <multitask/process.h>
+#include <multitask/fairq.h>
+#include <multitask/sleepq.h>
+#include <memory/kheap.h>
+#include <klib/string.h>
+#include "framework.h"
+
+#define QUEUE_PROCS   20
+
+static process_t procs[QUEUE_PROCS];
+
+
+// returns the subtree height, or -1 if order or AVL balance is broken
+static int check_subtree(process_t *node) {
+    if (node == NULL)
+        return 0;
+    process_t *left = node->fair_node.left;
+    process_t *right = node->fair_node.right;
+    if (left != NULL && left->vruntime > node->vruntime)
+        return -1;
+    if (right != NULL && right->vruntime < node->vruntime)
+        return -1;
+
+    int left_height = check_subtree(left);
+    int right_height = check_subtree(right);
+    if (left_height < 0 || right_height < 0)
+        return -1;
+    if (left_height - right_height > 1 || right_height - left_height > 1)
+        return -1;
+    int height = 1 + (left_height > right_height ? left_height : right_height);
+    return node->fair_node.height == height ? height : -1;
+}
+
+static void count_walked(process_t *proc, void *data) {
+    (*(int *)data)++;
+}
+
+void test_fair_queue() {
+    fair_queue_t queue;
+    memset((char *)&queue, 0, sizeof(queue));
+    memset((char *)procs, 0, sizeof(procs));
+    assert(fairq_first(&queue) == NULL);
+    assert(fairq_pop_first(&queue) == NULL);
+
+    // scrambled vruntimes, with some ties broken by pid
+    for (int i = 0; i < QUEUE_PROCS; i++) {
+        procs[i].pid = i + 1;
+        procs[i].vruntime = (i * 7) % QUEUE_PROCS / 2;
+        fairq_insert(&queue, &procs[i]);
+        assert(check_subtree(queue.root) > 0);
+    }
+    assert(queue.count == QUEUE_PROCS);
+    int walked = 0;
+    fairq_walk(&queue, count_walked, &walked);
+    assert(walked == QUEUE_PROCS);
+
+    // removing from the middle of the tree keeps it balanced
+    fairq_remove(&queue, &procs[5]);
+    fairq_remove(&queue, queue.root);
+    fairq_remove(&queue, &procs[12]);
+    assert(queue.count == QUEUE_PROCS - 3);
+    assert(check_subtree(queue.root) > 0);
+
+    // the rest come out in vruntime order
+    process_t *prev = NULL;
+    process_t *proc;
+    while ((proc = fairq_pop_first(&queue)) != NULL) {
+        if (prev != NULL)
+            assert(prev->vruntime < proc->vruntime || (prev->vruntime == proc->vruntime && prev->pid < proc->pid));
+        assert(check_subtree(queue.root) >= 0);
+        prev = proc;
+    }
+    assert(queue.count == 0);
+    assert(queue.root == NULL);
+}
+
+void test_sleep_queue() {
+    sleep_queue_t queue;
+    memset((char *)&queue, 0, sizeof(queue));
+    memset((char *)procs, 0, sizeof(procs));
+    assert(sleepq_peek(&queue) == NULL);
+    assert(sleepq_pop(&queue) == NULL);
+
+    for (int i = 0; i < QUEUE_PROCS; i++) {
+        procs[i].pid = i + 1;
+        procs[i].sleep_queue_index = -1;
+        procs[i].wake_up_time = 1000 + (i * 13) % QUEUE_PROCS;
+        sleepq_insert(&queue, &procs[i]);
+    }
+    assert(queue.count == QUEUE_PROCS);
+    assert(sleepq_peek(&queue)->wake_up_time == 1000);
+
+    // woken up early, from the top, the middle and the end of the heap
+    process_t *top = sleepq_peek(&queue);
+    sleepq_remove(&queue, top);
+    assert(top->sleep_queue_index == -1);
+    sleepq_remove(&queue, queue.heap[queue.count / 2]);
+    sleepq_remove(&queue, queue.heap[queue.count - 1]);
+    assert(queue.count == QUEUE_PROCS - 3);
+
+    // removing one not in the queue changes nothing
+    sleepq_remove(&queue, top);
+    assert(queue.count == QUEUE_PROCS - 3);
+
+    uint64_t last = 0;
+    process_t *proc;
+    while ((proc = sleepq_pop(&queue)) != NULL) {
+        assert(proc->wake_up_time >= last);
+        last = proc->wake_up_time;
+    }
+    assert(queue.count == 0);
+
+    kfree(queue.heap);
+}
@@ -0,0 +1,50 @@
+#include <memory/slab.h>
+#include "framework.h"
+
+
+static int constructed = 0;
+
+static void test_ctor(void *object) {
+    *(uint32_t *)object = 0x12345678;
+    constructed++;
+}
+
+void test_slab() {
+    kmem_cache_stats_t stats;
+    kmem_cache_t *cache = kmem_cache_create("test", 24, test_ctor);
+    assert(cache != NULL);
+
+    void *p1 = kmem_cache_alloc(cache);
+    void *p2 = kmem_cache_alloc(cache);
+    assert(p1 != NULL && p2 != NULL && p1 != p2);
+    assert(*(uint32_t *)p1 == 0x12345678);
+
+    // one slab was populated, constructor ran for all its objects
+    kmem_cache_get_stats(cache, &stats);
+    assert(stats.slabs == 1);
+    assert(stats.objects_in_use == 2);
+    assert(constructed == (int)stats.objects_per_slab);
+
+    // a freed object is the next one to be handed out
+    kmem_cache_free(cache, p1);
+    void *p3 = kmem_cache_alloc(cache);
+    assert(p3 == p1);
+
+    // filling the slab should bring in a second one
+    int count = stats.objects_per_slab + 1;
+    void *objects[count];
+    for (int i = 0; i < count; i++)
+        objects[i] = kmem_cache_alloc(cache);
+    kmem_cache_get_stats(cache, &stats);
+    assert(stats.slabs == 2);
+
+    for (int i = 0; i < count; i++)
+        kmem_cache_free(cache, objects[i]);
+    kmem_cache_free(cache, p2);
+    kmem_cache_free(cache, p3);
+    kmem_cache_get_stats(cache, &stats);
+    assert(stats.objects_in_use == 0);
+    assert(stats.allocations == stats.frees);
+
+    kmem_cache_destroy(cache);
+}
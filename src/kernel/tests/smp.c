@@ -0,0 +1,40 @@
+#include <multitask/process.h>
+#include <multitask/scheduler.h>
+#include <drivers/timer.h>
+#include <smp.h>
+#include "framework.h"
+
+#define SPIN_MSECS   50
+
+
+static volatile uint32_t cpus_seen;
+static volatile int finished_spinners;
+
+// cpu bound, notes every cpu it finds itself on
+static void spinner() {
+    uint64_t until = clock_monotonic_ns() + (uint64_t)SPIN_MSECS * 1000000;
+    while (clock_monotonic_ns() < until)
+        __sync_fetch_and_or(&cpus_seen, 1 << smp_this_cpu_index());
+
+    __sync_fetch_and_add(&finished_spinners, 1);
+    proc_exit(0);
+}
+
+// needs multitasking, see run_frameworked_multitasking_tests()
+void test_processes_spread_over_cpus() {
+    int online = smp_cpus_online();
+    int spinners = online < 2 ? 2 : online;
+    cpus_seen = 0;
+    finished_spinners = 0;
+
+    for (int i = 0; i < spinners; i++)
+        start_process(create_process("Spinner", spinner, PRIORITY_USER_PROGRAM, NULL, NULL));
+
+    for (int i = 0; i < 1000 && finished_spinners < spinners; i++)
+        proc_sleep(1);
+    assert(finished_spinners == spinners);
+
+    // with more than one cpu, idle ones are woken up or steal work
+    int distinct = __builtin_popcount(cpus_seen);
+    assert(distinct >= (online < 2 ? 1 : 2));
+}
@@ -42,6 +42,24 @@ void test_strings() {
     // remember, strtok() alters the string in place nulling out all delimiters
     assert(memcmp(buffer, "Hello\0there\0\0this\0is-a\0test\0\0\0\0phrase\0", 38) == 0);
 
+    // strtok_r() keeps its place in the caller, two strings can be tokenized at once
+    char other[16];
+    char *next1 = NULL;
+    char *next2 = NULL;
+    strcpy(buffer, "/bin//sh");
+    strcpy(other, "a,b");
+    assert(strcmp(strtok_r(buffer, "/", &next1), "bin") == 0);
+    assert(strcmp(strtok_r(other, ",", &next2), "a") == 0);
+    assert(strcmp(strtok_r(NULL, "/", &next1), "sh") == 0);
+    assert(strcmp(strtok_r(NULL, ",", &next2), "b") == 0);
+    assert(strtok_r(NULL, "/", &next1) == NULL);
+    assert(strtok_r(NULL, ",", &next2) == NULL);
+    next1 = NULL;
+    strcpy(buffer, "///");
+    assert(strtok_r(buffer, "/", &next1) == NULL);
+    next1 = NULL;
+    assert(strtok_r(NULL, "/", &next1) == NULL);
+
     // strchr()
     strcpy(buffer, "Hello there!");
     assert(strchr(buffer, 'o') == &buffer[4]);
@@ -9,22 +9,54 @@
 MODULE("UNITTEST");
 
 void test_kernel_heap();
+void test_kernel_heap_growth();
+void test_kernel_heap_benchmark();
 void test_paths();
 void test_printf();
 void test_strbuff();
 void test_strings();
+void test_slab();
+void test_physical_memory();
+void test_physical_page_refcount();
 void test_vfs();
+void test_fair_queue();
+void test_sleep_queue();
+void test_mutex_priority_inheritance();
+void test_processes_spread_over_cpus();
 
 
 // final code to be run
 bool run_frameworked_unit_tests() {
     unit_test_t tests[] = {
         unit_test(test_kernel_heap),
+        unit_test(test_kernel_heap_growth),
         unit_test(test_paths),
         unit_test(test_printf),
         unit_test(test_strbuff),
         unit_test(test_strings),
+        unit_test(test_slab),
+        unit_test(test_physical_memory),
+        unit_test(test_physical_page_refcount),
+        unit_test(test_fair_queue),
+        unit_test(test_sleep_queue),
         // unit_test(test_vfs),
     };
     return run_tests(tests);
 }
+
+// tests that need other processes to run, called from a process once multitasking starts
+bool run_frameworked_multitasking_tests() {
+    unit_test_t tests[] = {
+        unit_test(test_mutex_priority_inheritance),
+        unit_test(test_processes_spread_over_cpus),
+    };
+    return run_tests(tests);
+}
+
+// timing runs, too slow for every boot, run when "bench" is in the kernel cmdline
+bool run_frameworked_benchmarks() {
+    unit_test_t tests[] = {
+        unit_test(test_kernel_heap_benchmark),
+    };
+    return run_tests(tests);
+}
@@ -35,6 +35,8 @@ char *strerror(int err);
 #define ERR_READING_FILE         -20
 #define ERR_WRITING_FILE         -21
 #define ERR_HANDLES_EXHAUSTED    -22
+#define ERR_NO_ADDRESS_SPACE     -23
+#define ERR_TRY_AGAIN            -24   // e.g. futex value changed before we could wait
 
 
 #endif
\ No newline at end of file
@@ -10,8 +10,10 @@ typedef struct exec_metrics {
     char *name;
     uint32_t iterations_count;
     uint32_t iterations_msecs;
+    uint32_t iterations_usecs;
     uint32_t iterations_per_second;
     uint32_t msecs_per_iteration;
+    uint32_t nsecs_per_iteration;
     bool     unreliable;
 } exec_metrics;
 
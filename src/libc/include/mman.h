@@ -0,0 +1,30 @@
+#ifndef _MMAN_H
+#define _MMAN_H
+
+#include <ctypes.h>
+
+
+// these should mirror kernel's ones
+#define PROT_NONE       0x00
+#define PROT_READ       0x01
+#define PROT_WRITE      0x02
+#define PROT_EXEC       0x04
+
+#define MAP_SHARED      0x01
+#define MAP_PRIVATE     0x02
+#define MAP_ANONYMOUS   0x20
+
+
+// methods supported by userland only (libc and user programs)
+#ifndef __is_libk
+
+// maps anonymous (zero filled) memory, or a file, read only. returns NULL on failure.
+// anonymous MAP_SHARED memory is shared with forked children, MAP_PRIVATE is copied on write.
+// pages are populated on first touch. addr is a hint, currently ignored.
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, int offset);
+
+// unmaps a whole mapping, as returned by mmap()
+int munmap(void *addr, size_t length);
+
+#endif // __is_libk
+#endif // _MMAN_H
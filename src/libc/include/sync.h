@@ -0,0 +1,37 @@
+#ifndef _SYNC_H
+#define _SYNC_H
+
+#include <ctypes.h>
+
+
+// mutexes and condition variables, for processes sharing memory (mmap() with MAP_SHARED).
+// they only enter the kernel (SYS_FUTEX) when they have to wait or wake someone.
+// all zeros is the initial state, so they can be static or memset().
+
+typedef struct mutex {
+    volatile uint32_t state;    // 0 free, 1 locked, 2 locked and maybe waited for
+} mutex_t;
+
+typedef struct cond {
+    volatile uint32_t sequence; // changes on every signal, waiters sleep on it
+} cond_t;
+
+#define MUTEX_INITIALIZER   { 0 }
+#define COND_INITIALIZER    { 0 }
+
+
+// methods supported by userland only (libc and user programs)
+#ifndef __is_libk
+
+void mutex_lock(mutex_t *mutex);
+bool mutex_trylock(mutex_t *mutex); // false if already locked
+void mutex_unlock(mutex_t *mutex);
+
+// unlocks the mutex, waits for a signal, locks the mutex again.
+// wake ups may be spurious, re-check the condition in a loop.
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);     // wakes up one waiter
+void cond_broadcast(cond_t *cond);  // wakes up all waiters
+
+#endif // __is_libk
+#endif // _SYNC_H
@@ -54,12 +54,21 @@
 #define SYS_YIELD            59  // no args
 #define SYS_EXIT             60  // arg1 = exit code
 #define SYS_SBRK             61  // arg1 = signed desired diff, returns pointer to new area
+#define SYS_MMAP             62  // arg1 = length, arg2 = prot, arg3 = flags, arg4 = handle, arg5 = offset, returns address
+#define SYS_MUNMAP           63  // arg1 = address, arg2 = length
 
 // clock info
 #define SYS_GET_UPTIME       80  // returns msecs since boot (32 bits = 49 days)
 #define SYS_GET_CLOCK        81  // arg1 = dtime pointer
+#define SYS_GET_UPTIME_NS    82  // arg1 = pointer to nsecs since boot (64 bits)
 
 // IPC send, receive, shared memory
+#define SYS_FUTEX            90  // arg1 = address, arg2 = op, arg3 = value, returns woken processes for wake
+
+// futex operations, wait blocks only if *address still equals value,
+// wake unblocks up to value processes waiting on the address
+#define FUTEX_WAIT            1
+#define FUTEX_WAKE            2
 
 // networking? sockets? where is all the fun?
 
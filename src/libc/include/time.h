@@ -16,13 +16,14 @@ typedef struct clocktime {
 } clocktime_t;
 
 
-// methods supported by userland only
-#ifdef __is_libc
+// methods supported by userland only (libc and user programs)
+#ifndef __is_libk
 
 
 void uptime(uint64_t *uptime_msecs);
+void uptime_ns(uint64_t *uptime_nsecs);  // sub-microsecond resolution, where the cpu has a TSC
 void clocktime(clocktime_t *time);
 
 
-#endif // __is_libc
+#endif // __is_libk
 #endif // _TIME_H
@@ -25,8 +25,8 @@ void take_exec_metrics(function *func, char *name, exec_metrics *metrics) {
 
     // find out how many times the function can run in a single second.
     // if the function is too fast, halve the time window
-    uint64_t msecs_started, msecs_finished;
-    uint32_t msecs_elapsed, time_window_msecs, iterations, remaining;
+    uint64_t nsecs_started, nsecs_finished;
+    uint32_t nsecs_elapsed, usecs_elapsed, msecs_elapsed, time_window_msecs, iterations, remaining;
     bool good_measurement;
 
     // start with these. iterations will tripple, time window with halve
@@ -35,17 +35,23 @@ void take_exec_metrics(function *func, char *name, exec_metrics *metrics) {
     good_measurement = false;
 
     while (true) {
-        msecs_started = 0;
-        msecs_finished = 0;
+        nsecs_started = 0;
+        nsecs_finished = 0;
 
         syslog_info("%s: Trying %d iterations, up to %d msecs...", name, iterations, time_window_msecs);
 
         remaining = iterations;
-        uptime(&msecs_started);
+        uptime_ns(&nsecs_started);
         while (remaining--)
             func();
-        uptime(&msecs_finished);
-        msecs_elapsed = (uint32_t)(msecs_finished - msecs_started);
+        uptime_ns(&nsecs_finished);
+
+        // 32 bits hold about 4 seconds, more than the largest window.
+        // user programs have no 64 bit division, keep math in 32 bits
+        uint64_t elapsed = nsecs_finished - nsecs_started;
+        nsecs_elapsed = HIGH_DWORD(elapsed) ? 0xFFFFFFFF : LOW_DWORD(elapsed);
+        usecs_elapsed = nsecs_elapsed / 1000;
+        msecs_elapsed = usecs_elapsed / 1000;
 
         // if we were slow enough to exhaust the timing window, stop
         if (msecs_elapsed > time_window_msecs) {
@@ -78,13 +84,20 @@ void take_exec_metrics(function *func, char *name, exec_metrics *metrics) {
     metrics->func = func;
     metrics->iterations_count = iterations;
     metrics->iterations_msecs = msecs_elapsed;
+    metrics->iterations_usecs = usecs_elapsed;
     metrics->unreliable = !good_measurement;
 
-    // shall we have enough bits to multiply with 1000 ???
-    metrics->iterations_per_second = (iterations * 1000 / msecs_elapsed);
+    // multiplying with a million fits 32 bits only for a few thousand iterations
+    if (usecs_elapsed == 0)
+        metrics->iterations_per_second = 0;
+    else if (iterations <= 4000)
+        metrics->iterations_per_second = iterations * 1000000 / usecs_elapsed;
+    else
+        metrics->iterations_per_second = iterations * 1000 / (msecs_elapsed > 0 ? msecs_elapsed : 1);
 
     // hoping integer division does not bite us
     metrics->msecs_per_iteration = (msecs_elapsed / iterations);
+    metrics->nsecs_per_iteration = (nsecs_elapsed / iterations);
 }
 
 
@@ -0,0 +1,69 @@
+#include <ctypes.h>
+#include <syscall.h>
+#include <sync.h>
+
+#ifdef __is_libc
+
+// see "Futexes Are Tricky", Ulrich Drepper, for the mutex states
+
+#define MUTEX_FREE        0
+#define MUTEX_LOCKED      1
+#define MUTEX_CONTENDED   2
+
+#define WAKE_ALL          0x7FFFFFFF
+
+
+static inline int futex(volatile uint32_t *address, int op, uint32_t value) {
+    return syscall(SYS_FUTEX, (int)address, op, (int)value, 0, 0);
+}
+
+void mutex_lock(mutex_t *mutex) {
+    uint32_t state = __sync_val_compare_and_swap(&mutex->state, MUTEX_FREE, MUTEX_LOCKED);
+    if (state == MUTEX_FREE)
+        return;
+
+    // from now on we don't know if others wait, so we leave it contended,
+    // for the unlock to wake someone up
+    if (state != MUTEX_CONTENDED)
+        state = __sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED);
+    while (state != MUTEX_FREE) {
+        futex(&mutex->state, FUTEX_WAIT, MUTEX_CONTENDED);
+        state = __sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED);
+    }
+}
+
+bool mutex_trylock(mutex_t *mutex) {
+    return __sync_bool_compare_and_swap(&mutex->state, MUTEX_FREE, MUTEX_LOCKED);
+}
+
+void mutex_unlock(mutex_t *mutex) {
+    if (__sync_fetch_and_sub(&mutex->state, 1) != MUTEX_LOCKED) {
+        mutex->state = MUTEX_FREE;
+        futex(&mutex->state, FUTEX_WAKE, 1);
+    }
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex) {
+    uint32_t sequence = cond->sequence;
+    mutex_unlock(mutex);
+
+    // a signal after the unlock changes the sequence, the kernel won't block us
+    futex(&cond->sequence, FUTEX_WAIT, sequence);
+
+    // others may have been woken up with us, assume contention
+    while (__sync_lock_test_and_set(&mutex->state, MUTEX_CONTENDED) != MUTEX_FREE)
+        futex(&mutex->state, FUTEX_WAIT, MUTEX_CONTENDED);
+}
+
+void cond_signal(cond_t *cond) {
+    __sync_fetch_and_add(&cond->sequence, 1);
+    futex(&cond->sequence, FUTEX_WAKE, 1);
+}
+
+void cond_broadcast(cond_t *cond) {
+    __sync_fetch_and_add(&cond->sequence, 1);
+    futex(&cond->sequence, FUTEX_WAKE, WAKE_ALL);
+}
+
+
+#endif // __is_libc
@@ -0,0 +1,19 @@
+#include <ctypes.h>
+#include <syscall.h>
+#include <mman.h>
+
+#ifdef __is_libc
+
+
+void *mmap(void *addr, size_t length, int prot, int flags, int fd, int offset) {
+    (void)addr;
+    int result = syscall(SYS_MMAP, (int)length, prot, flags, fd, offset);
+    return result < 0 ? NULL : (void *)result;
+}
+
+int munmap(void *addr, size_t length) {
+    return syscall(SYS_MUNMAP, (int)addr, (int)length, 0, 0, 0);
+}
+
+
+#endif
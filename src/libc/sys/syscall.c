@@ -1,5 +1,56 @@
 
 
+#include <ctypes.h>
+
+#define CPUID_FEATURE_SEP    (1 << 11)   // sysenter / sysexit
+#define CPUID_FEATURE_MSR    (1 << 5)    // the kernel configures sysenter through them
+
+
+// the kernel configures SYSENTER on the same conditions, see init_sysenter()
+static bool detect_sysenter() {
+    uint32_t eax, ebx, ecx, edx;
+    __asm__ __volatile__("cpuid" : "=a"(eax), "=b"(ebx), "=c"(ecx), "=d"(edx) : "a"(1), "c"(0));
+    if ((edx & (CPUID_FEATURE_SEP | CPUID_FEATURE_MSR)) != (CPUID_FEATURE_SEP | CPUID_FEATURE_MSR))
+        return false;
+
+    // early Pentium Pro report SEP without supporting it
+    uint32_t family = (eax >> 8) & 0xF;
+    uint32_t model = (eax >> 4) & 0xF;
+    uint32_t stepping = eax & 0xF;
+    return !(family == 6 && model < 3 && stepping < 3);
+}
+
+// SYSENTER skips the IDT gate dispatch. we also run in ring 0, so we push
+// the frame INT 0x80 would push (EFLAGS, CS, return address), pass its
+// address in EBP, and the kernel returns with IRET, as for INT 0x80.
+static int sysenter_syscall(int sysno, int arg1, int arg2, int arg3, int arg4, int arg5) {
+    int return_value = 0;
+
+    // all operands are loaded before we move the stack
+    __asm__ __volatile__(
+        "movl %1, %%eax \n\t"
+        "movl %2, %%ebx \n\t"
+        "movl %3, %%ecx \n\t"
+        "movl %4, %%edx \n\t"
+        "movl %5, %%esi \n\t"
+        "movl %6, %%edi \n\t"
+        "pushl %%ebp \n\t"
+        "pushfl \n\t"
+        "pushl %%cs \n\t"
+        "pushl $1f \n\t"
+        "movl %%esp, %%ebp \n\t"
+        "sysenter \n\t"
+        "1: \n\t"
+        "popl %%ebp \n\t"
+        "movl %%eax, %0 \n\t"
+        : "=g" (return_value)
+        : "g"(sysno), "g"(arg1), "g"(arg2), "g"(arg3), "g"(arg4), "g"(arg5)
+        : "%eax", "%ebx", "%ecx", "%edx", "%esi", "%edi", "memory"
+    );
+
+    return return_value;
+}
+
 /**
  * Central function to call int 80, observice our kernel's ABI
  * Essentially, the ABI says the following:
@@ -13,10 +64,17 @@
  *   EDI will contain argument No 5
  * Regarding response:
  *   EAX will contain the response code. To be interpreted as a signed int of 32 bits
+ * Where the cpu supports it, SYSENTER is used instead, with the same registers
  */
 int syscall(int sysno, int arg1, int arg2, int arg3, int arg4, int arg5) {
+    static int use_sysenter = -1;
     int return_value = 0;
 
+    if (use_sysenter < 0)
+        use_sysenter = detect_sysenter() ? 1 : 0;
+    if (use_sysenter)
+        return sysenter_syscall(sysno, arg1, arg2, arg3, arg4, arg5);
+
     // maybe this helps: https://forum.osdev.org/viewtopic.php?f=1&t=9510&sid=b88edf5c775e3d8c05287a8c471c1986&start=15
 
     // the sections are: (assembly : output : input : clobbered registers)
@@ -8,6 +8,10 @@ void uptime(uint64_t *uptime_msecs) {
     syscall(SYS_GET_UPTIME, (int)uptime_msecs, 0, 0, 0, 0);
 }
 
+void uptime_ns(uint64_t *uptime_nsecs) {
+    syscall(SYS_GET_UPTIME_NS, (int)uptime_nsecs, 0, 0, 0, 0);
+}
+
 
 void clocktime(clocktime_t *time) {
     syscall(SYS_GET_CLOCK, (int)time, 0, 0, 0, 0);
@@ -1,12 +1,44 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
+#define FORK_LATENCY_ITERATIONS   100
+
+
+// forks children that exit right away, to measure the cost of fork()
+static void measure_fork_latency() {
+    uint64_t start_nsecs;
+    uint64_t end_nsecs;
+    int exit_code;
+
+    uptime_ns(&start_nsecs);
+    for (int i = 0; i < FORK_LATENCY_ITERATIONS; i++) {
+        int pid = fork();
+        if (pid == 0)
+            exit(0);
+        if (pid < 0) {
+            printf("fork() failed, err = %d\n", pid);
+            return;
+        }
+        wait(&exit_code);
+    }
+    uptime_ns(&end_nsecs);
+
+    // no 64 bit division in user programs, 32 bits of nsecs last 4 seconds
+    uint32_t total_usecs = (uint32_t)(end_nsecs - start_nsecs) / 1000;
+    printf("%d fork/exit/wait cycles took %u msecs, %u usecs per cycle\n",
+        FORK_LATENCY_ITERATIONS,
+        total_usecs / 1000,
+        total_usecs / FORK_LATENCY_ITERATIONS);
+}
 
 
 int main(int argc, char *argv[]) {
     (void)argc;
     (void)argv;
 
+    measure_fork_latency();
+
     printf("Hi, I am the parent, PID %d, PPID %d\n", getpid(), getppid());
     int err = fork();
     if (err < 0) {
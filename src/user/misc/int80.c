@@ -1,14 +1,52 @@
 #include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <metrics.h>
+#include <syscall.h>
 
 
+// syscall round trips, the old way and the way libc's syscall() does them.
+// getting the pid is almost no work in the kernel, so we measure the transition.
+
+void int80_round_trip() {
+    int pid;
+    __asm__ __volatile__(
+        "int $0x80"
+        : "=a"(pid)
+        : "a"(SYS_GET_PID), "b"(0), "c"(0), "d"(0), "S"(0), "D"(0)
+        : "memory"
+    );
+}
+
+void libc_round_trip() {
+    // getpid() goes through syscall(), sysenter where supported
+    getpid();
+}
 
 int main(int argc, char *argv[]) {
     (void)argc;
     (void)argv;
 
-    printf("Hello from int80.c user program!\n");
+    exec_metrics metrics[2];
+    memset(metrics, 0, sizeof(metrics));
 
-    return 123;
-}
+    printf("Measuring syscall round trips... (this may take several seconds)");
+    take_exec_metrics(int80_round_trip, "int 0x80",        &metrics[0]);
+    take_exec_metrics(libc_round_trip,  "libc syscall()",  &metrics[1]);
+    printf("\n");
 
+    printf("Path                 iterations elapsed    ns/call calls/sec trusted\n");
+    //      12345678901234567890 123456789 12345678 1234567890 123456789 123
+    for (int i = 0; i < (int)(sizeof(metrics)/sizeof(metrics[0])); i++) {
+        printf("%-20s %9u %8u %10u %9u  %s\n",
+            metrics[i].name,
+            metrics[i].iterations_count,
+            metrics[i].iterations_msecs,
+            metrics[i].nsecs_per_iteration,
+            metrics[i].iterations_per_second,
+            metrics[i].unreliable ? "no" : "yes"
+        );
+    }
 
+    return 0;
+}
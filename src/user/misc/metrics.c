@@ -56,14 +56,14 @@ void main(int argc, char *argv[]) {
     take_exec_metrics(very_fast_function,   "very_fast()",   &metrics[3]);
     printf("\n");
 
-    printf("Function name        iterations elapsed ms/call calls/sec trusted\n");
-    //      12345678901234567890 123456789 1234567 1234567 123456789 123
+    printf("Function name        iterations elapsed    ns/call calls/sec trusted\n");
+    //      12345678901234567890 123456789 12345678 1234567890 123456789 123
     for (int i = 0; i < (int)(sizeof(metrics)/sizeof(metrics[0])); i++) {
-        printf("%-20s %9u %8u %7u %9u  %s\n",
+        printf("%-20s %9u %8u %10u %9u  %s\n",
             metrics[i].name,
             metrics[i].iterations_count,
             metrics[i].iterations_msecs,
-            metrics[i].msecs_per_iteration,
+            metrics[i].nsecs_per_iteration,
             metrics[i].iterations_per_second,
             metrics[i].unreliable ? "no" : "yes"
         );
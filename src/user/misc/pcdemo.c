@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <mman.h>
+#include <sync.h>
+
+#define QUEUE_SLOTS      8
+#define ITEMS_TO_SEND    1000
+
+
+// a bounded queue in shared memory, the parent produces, the child consumes
+struct shared_queue {
+    mutex_t lock;
+    cond_t not_empty;
+    cond_t not_full;
+    int head;
+    int count;
+    int items[QUEUE_SLOTS];
+};
+
+
+static void produce(struct shared_queue *queue) {
+    for (int i = 1; i <= ITEMS_TO_SEND; i++) {
+        mutex_lock(&queue->lock);
+        while (queue->count == QUEUE_SLOTS)
+            cond_wait(&queue->not_full, &queue->lock);
+        queue->items[(queue->head + queue->count) % QUEUE_SLOTS] = i;
+        queue->count++;
+        cond_signal(&queue->not_empty);
+        mutex_unlock(&queue->lock);
+    }
+}
+
+// returns the sum of what it received
+static int consume(struct shared_queue *queue) {
+    int sum = 0;
+    for (int i = 0; i < ITEMS_TO_SEND; i++) {
+        mutex_lock(&queue->lock);
+        while (queue->count == 0)
+            cond_wait(&queue->not_empty, &queue->lock);
+        sum += queue->items[queue->head];
+        queue->head = (queue->head + 1) % QUEUE_SLOTS;
+        queue->count--;
+        cond_signal(&queue->not_full);
+        mutex_unlock(&queue->lock);
+    }
+    return sum;
+}
+
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    // zero filled, which is the initial state of mutexes and condition variables
+    struct shared_queue *queue = mmap(NULL, sizeof(struct shared_queue),
+        PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (queue == NULL) {
+        printf("mmap() of shared memory failed\n");
+        return 1;
+    }
+
+    int pid = fork();
+    if (pid < 0) {
+        printf("fork() failed, err = %d\n", pid);
+        return 1;
+    }
+    if (pid == 0) {
+        int sum = consume(queue);
+        exit(sum == ITEMS_TO_SEND * (ITEMS_TO_SEND + 1) / 2 ? 0 : 1);
+    }
+
+    uint64_t start_nsecs;
+    uint64_t end_nsecs;
+    uptime_ns(&start_nsecs);
+    produce(queue);
+
+    int exit_code = 0;
+    wait(&exit_code);
+    uptime_ns(&end_nsecs);
+
+    // no 64 bit division in user programs, 32 bits of nsecs last 4 seconds
+    uint32_t total_usecs = (uint32_t)(end_nsecs - start_nsecs) / 1000;
+    printf("Passed %d items through %d shared slots in %u msecs, consumer %s\n",
+        ITEMS_TO_SEND, QUEUE_SLOTS, total_usecs / 1000,
+        exit_code == 0 ? "got them all" : "got a wrong sum");
+
+    munmap(queue, sizeof(struct shared_queue));
+    return exit_code;
+}
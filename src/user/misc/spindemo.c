@@ -0,0 +1,60 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define WORKERS           4
+#define ROUNDS_PER_WORKER 10000000   // well below the 4 seconds we can time
+
+
+// pure cpu work, nothing to block on, the result keeps the compiler from skipping it
+static uint32_t spin(uint32_t rounds) {
+    volatile uint32_t value = 1;
+    for (uint32_t i = 0; i < rounds; i++)
+        value = value * 1664525 + 1013904223;
+    return value;
+}
+
+// no 64 bit division in user programs, 32 bits of nsecs last 4 seconds
+static uint32_t msecs_since(uint64_t start_nsecs) {
+    uint64_t now_nsecs;
+    uptime_ns(&now_nsecs);
+    return (uint32_t)(now_nsecs - start_nsecs) / 1000000;
+}
+
+
+int main(int argc, char *argv[]) {
+    (void)argc;
+    (void)argv;
+
+    // the same work, alone and then by as many processes at once
+    uint64_t start_nsecs;
+    uptime_ns(&start_nsecs);
+    spin(ROUNDS_PER_WORKER);
+    uint32_t alone_msecs = msecs_since(start_nsecs);
+    printf("One process did one share of work in %u msecs\n", alone_msecs);
+
+    uptime_ns(&start_nsecs);
+    for (int i = 0; i < WORKERS; i++) {
+        int pid = fork();
+        if (pid < 0) {
+            printf("fork() failed, err = %d\n", pid);
+            return 1;
+        }
+        if (pid == 0) {
+            spin(ROUNDS_PER_WORKER);
+            exit(0);
+        }
+    }
+
+    int exit_code;
+    for (int i = 0; i < WORKERS; i++)
+        wait(&exit_code);
+    uint32_t together_msecs = msecs_since(start_nsecs);
+
+    // on one cpu it takes about WORKERS times longer, with more cpus about the same
+    printf("%d processes did %d shares of work in %u msecs, %u.%02u times the work per msec\n",
+        WORKERS, WORKERS, together_msecs,
+        together_msecs == 0 ? 0 : WORKERS * alone_msecs / together_msecs,
+        together_msecs == 0 ? 0 : (WORKERS * alone_msecs * 100 / together_msecs) % 100);
+    return 0;
+}
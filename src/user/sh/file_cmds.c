@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errors.h>
+#include <mman.h>
 
 struct built_in_info {
     char *name;
@@ -109,14 +110,28 @@ void cmd_cat(int argc, char *argv[]) {
         return;
     }
 
+    // map the file, instead of copying it through a buffer
     char buffer[64 + 1];
-    while (true) {
-        memset(buffer, 0, sizeof(buffer));
-        int bytes = read(h, buffer, sizeof(buffer) - 1);
-        printf("%s", buffer);
-
-        if (bytes < (int)(sizeof(buffer) - 1))
-            break;
+    int size = seek(h, 0, SEEK_END);
+    char *contents = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, h, 0) : NULL;
+    if (contents != NULL) {
+        for (int offset = 0; offset < size; offset += sizeof(buffer) - 1) {
+            int chunk = size - offset < (int)(sizeof(buffer) - 1) ? size - offset : (int)(sizeof(buffer) - 1);
+            memcpy(buffer, contents + offset, chunk);
+            buffer[chunk] = '\0';
+            printf("%s", buffer);
+        }
+        munmap(contents, size);
+    } else {
+        seek(h, 0, SEEK_START);
+        while (true) {
+            memset(buffer, 0, sizeof(buffer));
+            int bytes = read(h, buffer, sizeof(buffer) - 1);
+            printf("%s", buffer);
+
+            if (bytes < (int)(sizeof(buffer) - 1))
+                break;
+        }
     }
     printf("\n");
     close(h);